@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *        The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KQUEUE_RING_H_
+#define _KQUEUE_RING_H_
+
+/*
+ * Bounded multi-producer/multi-consumer queue of pointers.
+ *
+ * Items live in a power-of-two ring of slots. Producers and consumers
+ * reserve slots by taking tickets from free-running head and tail
+ * counters, so the ring index is just (ticket & kq_mask) and full and
+ * empty are (tail - head == capacity) and (tail == head). The only
+ * lock is one spinlock held for a few instructions per operation;
+ * threads go to sleep on a wchan only when the ring is actually full
+ * or empty, and wakeups are skipped when nobody is asleep.
+ *
+ * (A fully lock-free version would need a compare-and-swap, which
+ * the MIPS port doesn't export; the critical section here is short
+ * enough that it makes little difference on System/161.)
+ *
+ * The capacity need not be a power of two; the slot array is
+ * rounded up, but no more than CAPACITY items are ever queued.
+ *
+ * The batch operations move several items per lock acquisition.
+ * kqueue_ring_putbatch blocks until all N items have been queued;
+ * kqueue_ring_getbatch blocks until at least one item is available
+ * and returns as many as are there, up to MAX.
+ */
+
+#include <spinlock.h>
+
+struct kqueue_ring {
+	char *kq_name;
+	void **kq_slots;		/* ring of 2^k slots */
+	unsigned kq_mask;		/* 2^k - 1 */
+	unsigned kq_capacity;		/* max items queued */
+	unsigned kq_head;		/* next ticket to take from */
+	unsigned kq_tail;		/* next ticket to put into */
+	unsigned kq_putwaiters;		/* threads asleep on kq_notfull */
+	unsigned kq_getwaiters;		/* threads asleep on kq_notempty */
+	struct wchan *kq_notfull;
+	struct wchan *kq_notempty;
+	struct spinlock kq_lock;
+};
+
+struct kqueue_ring *kqueue_ring_create(const char *name, unsigned capacity);
+void kqueue_ring_destroy(struct kqueue_ring *kq);
+
+void kqueue_ring_put(struct kqueue_ring *kq, void *item);
+void *kqueue_ring_get(struct kqueue_ring *kq);
+
+void kqueue_ring_putbatch(struct kqueue_ring *kq, void **items, unsigned n);
+unsigned kqueue_ring_getbatch(struct kqueue_ring *kq, void **items,
+			      unsigned max);
+
+
+#endif /* _KQUEUE_RING_H_ */
@@ -51,6 +51,8 @@ int arraytest(int, char **);
 int arraytest2(int, char **);
 int bitmaptest(int, char **);
 int threadlisttest(int, char **);
+int kqueueringtest(int, char **);
+int kqueueringbench(int, char **);
 
 /* thread tests */
 int threadtest(int, char **);
@@ -557,6 +557,8 @@ static const char *testmenu[] = {
 	"[at2] Large array test              ",
 	"[bt]  Bitmap test                   ",
 	"[tlt] Threadlist test               ",
+	"[kqt] kqueue_ring test              ",
+	"[kqb] kqueue_ring benchmark         ",
 	"[km1] Kernel malloc test            ",
 	"[km2] kmalloc stress test           ",
 	"[km3] Large kmalloc test            ",
@@ -671,6 +673,8 @@ static struct {
 	{ "at2",	arraytest2 },
 	{ "bt",		bitmaptest },
 	{ "tlt",	threadlisttest },
+	{ "kqt",	kqueueringtest },
+	{ "kqb",	kqueueringbench },
 	{ "km1",	kmalloctest },
 	{ "km2",	kmallocstress },
 	{ "km3",	kmalloctest3 },
@@ -0,0 +1,322 @@
+/*
+ * Copyright (c) 2013
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Tests and benchmark for kqueue_ring.
+ *
+ * kqt checks that every item sent by several producers comes out
+ * exactly once, using both the single and the batched operations.
+ *
+ * kqbench times the same producer/consumer workload through a
+ * semaphore-based bounded buffer (mutex plus empty/full counts, as
+ * in the original producer/consumer solution) and through a
+ * kqueue_ring, singly and batched.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <kqueue_ring.h>
+#include <test.h>
+
+#define KQT_PRODUCERS	4
+#define KQT_CONSUMERS	4
+#define KQT_ITEMS	2000		/* per producer */
+#define KQT_CAPACITY	10
+#define KQT_BATCH	8
+
+/* How each run moves items. */
+enum kqt_mode {
+	KQT_SEM,		/* semaphore bounded buffer */
+	KQT_RING,		/* kqueue_ring, one at a time */
+	KQT_RINGBATCH,		/* kqueue_ring, batched */
+};
+
+static const char *const kqt_modenames[] = {
+	"semaphores",
+	"kqueue_ring",
+	"kqueue_ring batched",
+};
+
+static enum kqt_mode kqt_mode;
+static struct semaphore *kqt_done;
+
+/* The kqueue_ring under test. */
+static struct kqueue_ring *kqt_ring;
+
+/* The semaphore bounded buffer. */
+static void *kqt_buf[KQT_CAPACITY];
+static unsigned kqt_bufhead, kqt_buftail;
+static struct semaphore *kqt_mutex, *kqt_empty, *kqt_full;
+
+/* Count of times each value was received, for checking. */
+static unsigned char kqt_seen[KQT_PRODUCERS * KQT_ITEMS];
+
+/*
+ * Items are the values 1..KQT_PRODUCERS*KQT_ITEMS cast to pointers,
+ * so there's nothing to allocate. NULL means "stop".
+ */
+#define KQT_ITEM(p, i)	((void *)(uintptr_t)((p) * KQT_ITEMS + (i) + 1))
+#define KQT_VALUE(ptr)	((unsigned)(uintptr_t)(ptr) - 1)
+
+static
+void
+kqt_sem_put(void *item)
+{
+	P(kqt_empty);
+	P(kqt_mutex);
+	kqt_buf[kqt_buftail] = item;
+	kqt_buftail = (kqt_buftail + 1) % KQT_CAPACITY;
+	V(kqt_mutex);
+	V(kqt_full);
+}
+
+static
+void *
+kqt_sem_get(void)
+{
+	void *item;
+
+	P(kqt_full);
+	P(kqt_mutex);
+	item = kqt_buf[kqt_bufhead];
+	kqt_bufhead = (kqt_bufhead + 1) % KQT_CAPACITY;
+	V(kqt_mutex);
+	V(kqt_empty);
+	return item;
+}
+
+static
+void
+kqt_producer(void *junk, unsigned long num)
+{
+	void *items[KQT_BATCH];
+	unsigned i, j;
+
+	(void)junk;
+
+	for (i=0; i<KQT_ITEMS; ) {
+		switch (kqt_mode) {
+		    case KQT_SEM:
+			kqt_sem_put(KQT_ITEM(num, i++));
+			break;
+		    case KQT_RING:
+			kqueue_ring_put(kqt_ring, KQT_ITEM(num, i++));
+			break;
+		    case KQT_RINGBATCH:
+			for (j=0; j<KQT_BATCH && i<KQT_ITEMS; j++) {
+				items[j] = KQT_ITEM(num, i++);
+			}
+			kqueue_ring_putbatch(kqt_ring, items, j);
+			break;
+		}
+	}
+	V(kqt_done);
+}
+
+static
+void
+kqt_consumer(void *junk, unsigned long num)
+{
+	void *items[KQT_BATCH];
+	unsigned i, n;
+	bool stop = false;
+
+	(void)junk;
+	(void)num;
+
+	while (!stop) {
+		switch (kqt_mode) {
+		    case KQT_SEM:
+			items[0] = kqt_sem_get();
+			n = 1;
+			break;
+		    case KQT_RING:
+			items[0] = kqueue_ring_get(kqt_ring);
+			n = 1;
+			break;
+		    case KQT_RINGBATCH:
+		    default:
+			n = kqueue_ring_getbatch(kqt_ring, items, KQT_BATCH);
+			break;
+		}
+		for (i=0; i<n; i++) {
+			if (items[i] == NULL) {
+				if (stop) {
+					/*
+					 * Got more than one stop token
+					 * in a batch; the rest belong
+					 * to other consumers.
+					 */
+					kqueue_ring_put(kqt_ring, NULL);
+				}
+				stop = true;
+				continue;
+			}
+			/* only this thread touches this byte */
+			kqt_seen[KQT_VALUE(items[i])]++;
+		}
+	}
+	V(kqt_done);
+}
+
+static
+void
+kqt_sendstop(void)
+{
+	unsigned i;
+
+	for (i=0; i<KQT_CONSUMERS; i++) {
+		if (kqt_mode == KQT_SEM) {
+			kqt_sem_put(NULL);
+		}
+		else {
+			kqueue_ring_put(kqt_ring, NULL);
+		}
+	}
+}
+
+/*
+ * Run the workload once in MODE and print the elapsed time. If CHECK
+ * is set, make sure every item came out exactly once.
+ */
+static
+void
+kqt_run(enum kqt_mode mode, bool check)
+{
+	struct timespec before, after, diff;
+	unsigned i;
+	int result;
+
+	kqt_mode = mode;
+	bzero(kqt_seen, sizeof(kqt_seen));
+
+	gettime(&before);
+
+	for (i=0; i<KQT_CONSUMERS; i++) {
+		result = thread_fork("kqt consumer", NULL, kqt_consumer,
+				     NULL, i);
+		if (result) {
+			panic("kqt: thread_fork: %s\n", strerror(result));
+		}
+	}
+	for (i=0; i<KQT_PRODUCERS; i++) {
+		result = thread_fork("kqt producer", NULL, kqt_producer,
+				     NULL, i);
+		if (result) {
+			panic("kqt: thread_fork: %s\n", strerror(result));
+		}
+	}
+	for (i=0; i<KQT_PRODUCERS; i++) {
+		P(kqt_done);
+	}
+	kqt_sendstop();
+	for (i=0; i<KQT_CONSUMERS; i++) {
+		P(kqt_done);
+	}
+
+	gettime(&after);
+	timespec_sub(&after, &before, &diff);
+
+	if (check) {
+		for (i=0; i<KQT_PRODUCERS * KQT_ITEMS; i++) {
+			if (kqt_seen[i] != 1) {
+				panic("kqt: %s: item %u received %u times\n",
+				      kqt_modenames[mode], i, (unsigned)kqt_seen[i]);
+			}
+		}
+	}
+
+	kprintf("kqt: %-20s %u items in %llu.%09lu seconds\n",
+		kqt_modenames[mode], KQT_PRODUCERS * KQT_ITEMS,
+		(unsigned long long) diff.tv_sec,
+		(unsigned long) diff.tv_nsec);
+}
+
+static
+void
+kqt_setup(void)
+{
+	kqt_done = sem_create("kqt_done", 0);
+	kqt_mutex = sem_create("kqt_mutex", 1);
+	kqt_empty = sem_create("kqt_empty", KQT_CAPACITY);
+	kqt_full = sem_create("kqt_full", 0);
+	kqt_ring = kqueue_ring_create("kqt_ring", KQT_CAPACITY);
+	if (kqt_done == NULL || kqt_mutex == NULL || kqt_empty == NULL ||
+	    kqt_full == NULL || kqt_ring == NULL) {
+		panic("kqt: Out of memory\n");
+	}
+	kqt_bufhead = kqt_buftail = 0;
+}
+
+static
+void
+kqt_cleanup(void)
+{
+	kqueue_ring_destroy(kqt_ring);
+	sem_destroy(kqt_full);
+	sem_destroy(kqt_empty);
+	sem_destroy(kqt_mutex);
+	sem_destroy(kqt_done);
+}
+
+int
+kqueueringtest(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting kqueue_ring test...\n");
+	kqt_setup();
+	kqt_run(KQT_RING, true);
+	kqt_run(KQT_RINGBATCH, true);
+	kqt_cleanup();
+	kprintf("kqueue_ring test done.\n");
+
+	return 0;
+}
+
+int
+kqueueringbench(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting kqueue_ring benchmark...\n");
+	kqt_setup();
+	kqt_run(KQT_SEM, false);
+	kqt_run(KQT_RING, false);
+	kqt_run(KQT_RINGBATCH, false);
+	kqt_cleanup();
+	kprintf("kqueue_ring benchmark done.\n");
+
+	return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Bounded MPMC queue. The interface is described in kqueue_ring.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <kqueue_ring.h>
+
+struct kqueue_ring *
+kqueue_ring_create(const char *name, unsigned capacity)
+{
+	struct kqueue_ring *kq;
+	unsigned nslots;
+
+	KASSERT(capacity > 0);
+
+	/* Round up to a power of two. */
+	nslots = 1;
+	while (nslots < capacity) {
+		nslots *= 2;
+	}
+
+	kq = kmalloc(sizeof(*kq));
+	if (kq == NULL) {
+		return NULL;
+	}
+
+	kq->kq_name = kstrdup(name);
+	if (kq->kq_name == NULL) {
+		kfree(kq);
+		return NULL;
+	}
+
+	kq->kq_slots = kmalloc(nslots * sizeof(kq->kq_slots[0]));
+	if (kq->kq_slots == NULL) {
+		kfree(kq->kq_name);
+		kfree(kq);
+		return NULL;
+	}
+
+	kq->kq_notfull = wchan_create(kq->kq_name);
+	if (kq->kq_notfull == NULL) {
+		kfree(kq->kq_slots);
+		kfree(kq->kq_name);
+		kfree(kq);
+		return NULL;
+	}
+
+	kq->kq_notempty = wchan_create(kq->kq_name);
+	if (kq->kq_notempty == NULL) {
+		wchan_destroy(kq->kq_notfull);
+		kfree(kq->kq_slots);
+		kfree(kq->kq_name);
+		kfree(kq);
+		return NULL;
+	}
+
+	kq->kq_mask = nslots - 1;
+	kq->kq_capacity = capacity;
+	kq->kq_head = 0;
+	kq->kq_tail = 0;
+	kq->kq_putwaiters = 0;
+	kq->kq_getwaiters = 0;
+	spinlock_init(&kq->kq_lock);
+
+	return kq;
+}
+
+void
+kqueue_ring_destroy(struct kqueue_ring *kq)
+{
+	KASSERT(kq != NULL);
+	KASSERT(kq->kq_putwaiters == 0);
+	KASSERT(kq->kq_getwaiters == 0);
+
+	spinlock_cleanup(&kq->kq_lock);
+	wchan_destroy(kq->kq_notempty);
+	wchan_destroy(kq->kq_notfull);
+	kfree(kq->kq_slots);
+	kfree(kq->kq_name);
+	kfree(kq);
+}
+
+/*
+ * Number of items queued / free slots. The counters are free-running
+ * and wrap, but unsigned subtraction gets the distance right anyway.
+ */
+static
+unsigned
+kqueue_ring_count(struct kqueue_ring *kq)
+{
+	return kq->kq_tail - kq->kq_head;
+}
+
+static
+unsigned
+kqueue_ring_space(struct kqueue_ring *kq)
+{
+	return kq->kq_capacity - kqueue_ring_count(kq);
+}
+
+/*
+ * Wait until there's room (put) or something queued (get). Must hold
+ * kq_lock.
+ */
+static
+void
+kqueue_ring_waitspace(struct kqueue_ring *kq)
+{
+	while (kqueue_ring_space(kq) == 0) {
+		kq->kq_putwaiters++;
+		wchan_sleep(kq->kq_notfull, &kq->kq_lock);
+		kq->kq_putwaiters--;
+	}
+}
+
+static
+void
+kqueue_ring_waititems(struct kqueue_ring *kq)
+{
+	while (kqueue_ring_count(kq) == 0) {
+		kq->kq_getwaiters++;
+		wchan_sleep(kq->kq_notempty, &kq->kq_lock);
+		kq->kq_getwaiters--;
+	}
+}
+
+/*
+ * Wake up to N sleepers on the other side, but don't bother going
+ * into the wchan code if nobody is asleep.
+ */
+static
+void
+kqueue_ring_wake(struct kqueue_ring *kq, struct wchan *wc,
+		 unsigned waiters, unsigned n)
+{
+	if (waiters == 0) {
+		return;
+	}
+	if (n >= waiters) {
+		wchan_wakeall(wc, &kq->kq_lock);
+	}
+	else {
+		while (n-- > 0) {
+			wchan_wakeone(wc, &kq->kq_lock);
+		}
+	}
+}
+
+void
+kqueue_ring_put(struct kqueue_ring *kq, void *item)
+{
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&kq->kq_lock);
+	kqueue_ring_waitspace(kq);
+	kq->kq_slots[kq->kq_tail++ & kq->kq_mask] = item;
+	kqueue_ring_wake(kq, kq->kq_notempty, kq->kq_getwaiters, 1);
+	spinlock_release(&kq->kq_lock);
+}
+
+void *
+kqueue_ring_get(struct kqueue_ring *kq)
+{
+	void *item;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&kq->kq_lock);
+	kqueue_ring_waititems(kq);
+	item = kq->kq_slots[kq->kq_head++ & kq->kq_mask];
+	kqueue_ring_wake(kq, kq->kq_notfull, kq->kq_putwaiters, 1);
+	spinlock_release(&kq->kq_lock);
+
+	return item;
+}
+
+void
+kqueue_ring_putbatch(struct kqueue_ring *kq, void **items, unsigned n)
+{
+	unsigned i, num;
+
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&kq->kq_lock);
+	while (n > 0) {
+		kqueue_ring_waitspace(kq);
+		num = kqueue_ring_space(kq);
+		if (num > n) {
+			num = n;
+		}
+		for (i=0; i<num; i++) {
+			kq->kq_slots[kq->kq_tail++ & kq->kq_mask] = items[i];
+		}
+		items += num;
+		n -= num;
+		kqueue_ring_wake(kq, kq->kq_notempty, kq->kq_getwaiters, num);
+	}
+	spinlock_release(&kq->kq_lock);
+}
+
+unsigned
+kqueue_ring_getbatch(struct kqueue_ring *kq, void **items, unsigned max)
+{
+	unsigned i, num;
+
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(max > 0);
+
+	spinlock_acquire(&kq->kq_lock);
+	kqueue_ring_waititems(kq);
+	num = kqueue_ring_count(kq);
+	if (num > max) {
+		num = max;
+	}
+	for (i=0; i<num; i++) {
+		items[i] = kq->kq_slots[kq->kq_head++ & kq->kq_mask];
+	}
+	kqueue_ring_wake(kq, kq->kq_notfull, kq->kq_putwaiters, num);
+	spinlock_release(&kq->kq_lock);
+
+	return num;
+}
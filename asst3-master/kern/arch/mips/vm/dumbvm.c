@@ -147,8 +147,35 @@ free_kpages(vaddr_t addr)
 	(void)addr;
 }
 
+/* Nothing is ever freed, so there's nothing to count. */
+void
+kpage_incref(vaddr_t addr)
+{
+	(void)addr;
+}
+
+unsigned
+kpage_refcount(vaddr_t addr)
+{
+	(void)addr;
+	return 1;
+}
+
 #endif
 
+/*
+ * dumbvm maps segments as contiguous blocks and has no page tables,
+ * so pages can't be lent to user space; uiomovepage falls back to
+ * copying.
+ */
+int
+vm_sharepage(vaddr_t kpage, vaddr_t uaddr)
+{
+	(void)kpage;
+	(void)uaddr;
+	return ENOSYS;
+}
+
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
@@ -43,6 +43,7 @@ static paddr_t lastpaddr;   /* one past end of last free physical page */
 typedef struct ft_entry {
         unsigned allocated:1; /* the corresponding frame is allocated */
         unsigned not_last:1; /* the frame is part of a multiframe allocation */
+        unsigned refcount:16; /* users of a single-frame allocation */
 } ft_entry_t;
 
 
@@ -212,6 +213,7 @@ static paddr_t alloc_one_frame(unsigned int npages)
                 if (frame_table[i].allocated == FALSE) {
                         frame_table[i].allocated = TRUE;
                         frame_table[i].not_last = FALSE;
+                        frame_table[i].refcount = 1;
 
                         spinlock_release(&frame_table_spinlock);
 
@@ -254,9 +256,11 @@ static paddr_t alloc_multiple_frames(unsigned int npages)
                 for (j = i; j < i + npages - 1; j++) {
                         frame_table[j].allocated = TRUE; /* mark frame allocated */
                         frame_table[j].not_last = TRUE;  /* as a contiguous block */
+                        frame_table[j].refcount = 1;
                 }
                 frame_table[j].allocated = TRUE;
                 frame_table[j].not_last = FALSE;
+                frame_table[j].refcount = 1;
 
                 spinlock_release(&frame_table_spinlock);
                 
@@ -285,6 +289,14 @@ static void free_frames(vaddr_t vaddr)
         if (frame_table[i].allocated == FALSE) { /* check for double free error */
                 panic("Double free error!!");
         }
+
+        /* a shared single frame just loses a user */
+        if (frame_table[i].refcount > 1) {
+                KASSERT(frame_table[i].not_last == FALSE);
+                frame_table[i].refcount--;
+                spinlock_release(&frame_table_spinlock);
+                return;
+        }
         
         while (frame_table[i].allocated == TRUE) { /* otherwise mark block free */
                 frame_table[i].allocated = FALSE;
@@ -319,3 +331,40 @@ free_kpages(vaddr_t addr)
         free_frames(addr);
 }
 
+/*
+ * Reference counts on single pages from alloc_kpages(1), so a page
+ * can be mapped into user address spaces (copy-on-write) while the
+ * kernel still has it. free_kpages drops one reference; the frame is
+ * only freed when the last one goes.
+ */
+void
+kpage_incref(vaddr_t addr)
+{
+        uint32_t i;
+
+        i = KVADDR_TO_PADDR(addr) >> PAGE_BITS;
+
+        spinlock_acquire(&frame_table_spinlock);
+        KASSERT(frame_table[i].allocated == TRUE);
+        KASSERT(frame_table[i].not_last == FALSE);
+        KASSERT(frame_table[i].refcount < 0xffff);
+        frame_table[i].refcount++;
+        spinlock_release(&frame_table_spinlock);
+}
+
+unsigned
+kpage_refcount(vaddr_t addr)
+{
+        unsigned count;
+        uint32_t i;
+
+        i = KVADDR_TO_PADDR(addr) >> PAGE_BITS;
+
+        spinlock_acquire(&frame_table_spinlock);
+        KASSERT(frame_table[i].allocated == TRUE);
+        count = frame_table[i].refcount;
+        spinlock_release(&frame_table_spinlock);
+
+        return count;
+}
+
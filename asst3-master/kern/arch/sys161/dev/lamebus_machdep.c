@@ -53,6 +53,12 @@
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
 
+/*
+ * Shortest interval we'll arm the timer for; anything less and the
+ * interrupt could be missed or arrive before we've returned.
+ */
+#define MIPS_TIMER_MINCYCLES 100
+
 /*
  * Access to the on-chip timer.
  *
@@ -65,17 +71,38 @@ void
 mips_timer_set(uint32_t count)
 {
 	/*
-	 * $11 == c0_compare; we can't use the symbolic name inside
-	 * the asm string.
+	 * $9 == c0_count and $11 == c0_compare; we can't use the
+	 * symbolic names inside the asm string. Zero the count first
+	 * so the interrupt comes COUNT cycles from now even if we're
+	 * rearming before the previous compare value was reached.
 	 */
 	__asm volatile(
 		".set push;"		/* save assembler mode */
 		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 $0, $9;"		/* reset the count */
 		"mtc0 %0, $11;"		/* do it */
 		".set pop"		/* restore assembler mode */
 		:: "r" (count));
 }
 
+/*
+ * Arm the on-chip timer to go off NSECS nanoseconds from now.
+ */
+void
+mainbus_settimer(uint64_t nsecs)
+{
+	uint64_t cycles;
+
+	cycles = nsecs / (1000000000 / CPU_FREQUENCY);
+	if (cycles < MIPS_TIMER_MINCYCLES) {
+		cycles = MIPS_TIMER_MINCYCLES;
+	}
+	else if (cycles > 0xffffffff) {
+		cycles = 0xffffffff;
+	}
+	mips_timer_set(cycles);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -314,9 +341,10 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
+		/*
+		 * Call hardclock. It rearms the timer for the next
+		 * tick or timeout, which clears the interrupt.
+		 */
 		hardclock();
 		seen = true;
 	}
@@ -49,12 +49,14 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <poll.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -72,6 +74,11 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Threads in poll() waiting for input.
+ */
+static struct pollhead con_pollhead;
+
 //////////////////////////////////////////////////
 
 /*
@@ -174,6 +181,7 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+	pollhead_wakeup(&con_pollhead);
 }
 
 /*
@@ -302,10 +310,34 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * Input is ready if there's anything in the buffer. (A read may still
+ * wait for the rest of a line.) Output never blocks for long.
+ */
+static
+int
+con_poll(struct device *dev, int events, int *revents, struct pollwaiter *pw)
+{
+	struct con_softc *cs = dev->d_data;
+	int result;
+
+	result = pollwaiter_register(pw, &con_pollhead);
+	if (result) {
+		return result;
+	}
+
+	*revents = events & (POLLOUT | POLLWRNORM);
+	if (cs->cs_gotchars_head != cs->cs_gotchars_tail) {
+		*revents |= events & (POLLIN | POLLRDNORM);
+	}
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +418,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollhead_init(&con_pollhead);
 
 	the_console = cs;
 	con_userlock_read = rlk;
@@ -49,6 +49,7 @@
 #include <uio.h>
 #include <membar.h>
 #include <synch.h>
+#include <vm.h>
 #include <lamebus/emu.h>
 #include <platform/bus.h>
 #include <vfs.h>
@@ -269,6 +270,7 @@ int
 emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	   uint32_t op, struct uio *uio)
 {
+	bool mine;
 	int result;
 
 	KASSERT(uio->uio_rw == UIO_READ);
@@ -278,7 +280,10 @@ emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 		return 0;
 	}
 
-	lock_acquire(sc->e_lock);
+	mine = lock_do_i_hold(sc->e_lock);
+	if (!mine) {
+		lock_acquire(sc->e_lock);
+	}
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
@@ -295,7 +300,9 @@ emu_doread(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	uio->uio_offset = emu_rreg(sc, REG_OFFSET);
 
  out:
-	lock_release(sc->e_lock);
+	if (!mine) {
+		lock_release(sc->e_lock);
+	}
 	return result;
 }
 
@@ -329,6 +336,7 @@ int
 emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	  struct uio *uio)
 {
+	bool mine;
 	int result;
 
 	KASSERT(uio->uio_rw == UIO_WRITE);
@@ -337,7 +345,10 @@ emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 		return EFBIG;
 	}
 
-	lock_acquire(sc->e_lock);
+	mine = lock_do_i_hold(sc->e_lock);
+	if (!mine) {
+		lock_acquire(sc->e_lock);
+	}
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
@@ -353,7 +364,9 @@ emu_write(struct emu_softc *sc, uint32_t handle, uint32_t len,
 	result = emu_waitdone(sc);
 
  out:
-	lock_release(sc->e_lock);
+	if (!mine) {
+		lock_release(sc->e_lock);
+	}
 	return result;
 }
 
@@ -364,9 +377,13 @@ static
 int
 emu_getsize(struct emu_softc *sc, uint32_t handle, off_t *retval)
 {
+	bool mine;
 	int result;
 
-	lock_acquire(sc->e_lock);
+	mine = lock_do_i_hold(sc->e_lock);
+	if (!mine) {
+		lock_acquire(sc->e_lock);
+	}
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_OPER, EMU_OP_GETSIZE);
@@ -375,7 +392,9 @@ emu_getsize(struct emu_softc *sc, uint32_t handle, off_t *retval)
 		*retval = emu_rreg(sc, REG_IOLEN);
 	}
 
-	lock_release(sc->e_lock);
+	if (!mine) {
+		lock_release(sc->e_lock);
+	}
 	return result;
 }
 
@@ -386,24 +405,328 @@ static
 int
 emu_trunc(struct emu_softc *sc, uint32_t handle, off_t len)
 {
+	bool mine;
 	int result;
 
 	KASSERT(len >= 0);
 
-	lock_acquire(sc->e_lock);
+	mine = lock_do_i_hold(sc->e_lock);
+	if (!mine) {
+		lock_acquire(sc->e_lock);
+	}
 
 	emu_wreg(sc, REG_HANDLE, handle);
 	emu_wreg(sc, REG_IOLEN, len);
 	emu_wreg(sc, REG_OPER, EMU_OP_TRUNC);
 	result = emu_waitdone(sc);
 
-	lock_release(sc->e_lock);
+	if (!mine) {
+		lock_release(sc->e_lock);
+	}
 	return result;
 }
 
 //
 ////////////////////////////////////////////////////////////
 
+////////////////////////////////////////////////////////////
+//
+// Data cache
+//
+// Every trip to the emulator costs an interrupt and a copy through
+// the I/O window, so we keep file data around in page-sized pieces.
+// A miss fetches a whole EMU_MAXIO window at once, which is as much
+// as the hardware will move per operation, and fills as many pages as
+// that covers. Writes go straight through to the host and throw away
+// whatever they overlap.
+//
+// We assume nobody changes the files on the host side while we have
+// them cached. Everything here is protected by e_lock.
+//
+
+struct emufs_page {
+	struct emufs_vnode *ep_vnode;	/* file this belongs to */
+	uint32_t ep_offset;		/* file offset, page-aligned */
+	uint32_t ep_len;		/* valid bytes; short means EOF */
+	vaddr_t ep_data;		/* the data */
+	struct emufs_page *ep_next;	/* next page of this file */
+	struct emufs_page *ep_lruprev;	/* LRU list */
+	struct emufs_page *ep_lrunext;
+};
+
+/*
+ * LRU list handling.
+ */
+static
+void
+emufs_lru_remove(struct emufs_fs *ef, struct emufs_page *ep)
+{
+	if (ep->ep_lruprev != NULL) {
+		ep->ep_lruprev->ep_lrunext = ep->ep_lrunext;
+	}
+	else {
+		ef->ef_lruhead = ep->ep_lrunext;
+	}
+	if (ep->ep_lrunext != NULL) {
+		ep->ep_lrunext->ep_lruprev = ep->ep_lruprev;
+	}
+	else {
+		ef->ef_lrutail = ep->ep_lruprev;
+	}
+}
+
+static
+void
+emufs_lru_addhead(struct emufs_fs *ef, struct emufs_page *ep)
+{
+	ep->ep_lruprev = NULL;
+	ep->ep_lrunext = ef->ef_lruhead;
+	if (ef->ef_lruhead != NULL) {
+		ef->ef_lruhead->ep_lruprev = ep;
+	}
+	else {
+		ef->ef_lrutail = ep;
+	}
+	ef->ef_lruhead = ep;
+}
+
+/*
+ * Find the cached page of EV at OFFSET, if any.
+ */
+static
+struct emufs_page *
+emufs_cache_find(struct emufs_vnode *ev, uint32_t offset)
+{
+	struct emufs_page *ep;
+
+	for (ep = ev->ev_pages; ep != NULL; ep = ep->ep_next) {
+		if (ep->ep_offset == offset) {
+			return ep;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Unhook EP from its file's list.
+ */
+static
+void
+emufs_cache_unlink(struct emufs_page *ep)
+{
+	struct emufs_page **pp;
+
+	for (pp = &ep->ep_vnode->ev_pages; *pp != ep; pp = &(*pp)->ep_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = ep->ep_next;
+}
+
+/*
+ * Get a page to cache OFFSET of EV in, taking it from the least
+ * recently used file data if we're at the limit or out of memory.
+ * KEEP, if not NULL, is a page the caller still needs, and is never
+ * taken. Returns NULL if there's nothing to be had.
+ */
+static
+struct emufs_page *
+emufs_cache_alloc(struct emufs_fs *ef, struct emufs_vnode *ev,
+		  uint32_t offset, struct emufs_page *keep)
+{
+	struct emufs_page *ep;
+
+	ep = NULL;
+	if (ef->ef_ncached < EMUFS_CACHEPAGES) {
+		ep = kmalloc(sizeof(*ep));
+		if (ep != NULL) {
+			ep->ep_data = alloc_kpages(1);
+			if (ep->ep_data == 0) {
+				kfree(ep);
+				ep = NULL;
+			}
+			else {
+				ef->ef_ncached++;
+			}
+		}
+	}
+	if (ep == NULL) {
+		ep = ef->ef_lrutail;
+		if (ep == NULL || ep == keep) {
+			return NULL;
+		}
+		emufs_lru_remove(ef, ep);
+		emufs_cache_unlink(ep);
+
+		/*
+		 * If the data page was lent to a process by
+		 * uiomovepage, leave it to them and start afresh.
+		 */
+		if (kpage_refcount(ep->ep_data) > 1) {
+			free_kpages(ep->ep_data);
+			ep->ep_data = alloc_kpages(1);
+			if (ep->ep_data == 0) {
+				kfree(ep);
+				KASSERT(ef->ef_ncached > 0);
+				ef->ef_ncached--;
+				return NULL;
+			}
+		}
+	}
+
+	ep->ep_vnode = ev;
+	ep->ep_offset = offset;
+	ep->ep_len = 0;
+	ep->ep_next = ev->ev_pages;
+	ev->ev_pages = ep;
+	emufs_lru_addhead(ef, ep);
+	return ep;
+}
+
+/*
+ * Drop the cached pages of EV that overlap [START, END), along with
+ * any short (EOF) page, since the end of file may be moving.
+ */
+static
+void
+emufs_cache_inval(struct emufs_fs *ef, struct emufs_vnode *ev,
+		  off_t start, off_t end)
+{
+	struct emufs_page *ep, **pp;
+
+	KASSERT(lock_do_i_hold(ev->ev_emu->e_lock));
+
+	pp = &ev->ev_pages;
+	while (*pp != NULL) {
+		ep = *pp;
+		if (ep->ep_len < PAGE_SIZE ||
+		    ((off_t)ep->ep_offset < end &&
+		     (off_t)ep->ep_offset + PAGE_SIZE > start)) {
+			*pp = ep->ep_next;
+			emufs_lru_remove(ef, ep);
+			free_kpages(ep->ep_data);
+			kfree(ep);
+			KASSERT(ef->ef_ncached > 0);
+			ef->ef_ncached--;
+		}
+		else {
+			pp = &ep->ep_next;
+		}
+	}
+}
+
+/*
+ * Drop everything cached for EV.
+ */
+static
+void
+emufs_cache_purge(struct emufs_fs *ef, struct emufs_vnode *ev)
+{
+	emufs_cache_inval(ef, ev, 0, (off_t)0x100000000ULL);
+	KASSERT(ev->ev_pages == NULL);
+}
+
+/*
+ * Fetch the I/O window starting at OFFSET (page-aligned) of EV and
+ * cache the pages it covers. Fills in at least the first page,
+ * unless no page can be had at all, in which case ENOMEM.
+ */
+static
+int
+emufs_cache_fill(struct emufs_fs *ef, struct emufs_vnode *ev, uint32_t offset)
+{
+	struct emu_softc *sc = ev->ev_emu;
+	struct emufs_page *ep, *first;
+	uint32_t got, pos, len;
+	int result;
+
+	KASSERT(lock_do_i_hold(sc->e_lock));
+	KASSERT(offset % PAGE_SIZE == 0);
+
+	emu_wreg(sc, REG_HANDLE, ev->ev_handle);
+	emu_wreg(sc, REG_IOLEN, EMU_MAXIO);
+	emu_wreg(sc, REG_OFFSET, offset);
+	emu_wreg(sc, REG_OPER, EMU_OP_READ);
+	result = emu_waitdone(sc);
+	if (result) {
+		return result;
+	}
+
+	membar_load_load();
+	got = emu_rreg(sc, REG_IOLEN);
+	KASSERT(got <= EMU_MAXIO);
+
+	/*
+	 * Once we have the first page, which is the one the caller
+	 * wants, stop rather than recycle it for the rest.
+	 */
+	first = NULL;
+	pos = 0;
+	do {
+		len = got - pos;
+		if (len > PAGE_SIZE) {
+			len = PAGE_SIZE;
+		}
+
+		/*
+		 * A page we already have holds the same data, and may
+		 * be mapped into a process, so don't write it.
+		 */
+		ep = emufs_cache_find(ev, offset + pos);
+		if (ep == NULL) {
+			ep = emufs_cache_alloc(ef, ev, offset + pos, first);
+			if (ep == NULL) {
+				return pos == 0 ? ENOMEM : 0;
+			}
+			/* Fresh page; nobody else can see it yet (uio.h). */
+			KASSERT(kpage_refcount(ep->ep_data) == 1);
+			memcpy((void *)ep->ep_data, (char *)sc->e_iobuf + pos,
+			       len);
+			ep->ep_len = len;
+		}
+		if (first == NULL) {
+			first = ep;
+		}
+
+		pos += len;
+	} while (len == PAGE_SIZE && pos < got);
+
+	return 0;
+}
+
+/*
+ * Get the cached page holding OFFSET of EV, fetching it if needed.
+ */
+static
+int
+emufs_cache_get(struct emufs_fs *ef, struct emufs_vnode *ev, uint32_t offset,
+		struct emufs_page **ret)
+{
+	struct emufs_page *ep;
+	int result;
+
+	offset -= offset % PAGE_SIZE;
+
+	ep = emufs_cache_find(ev, offset);
+	if (ep == NULL) {
+		result = emufs_cache_fill(ef, ev, offset);
+		if (result) {
+			return result;
+		}
+		ep = emufs_cache_find(ev, offset);
+		KASSERT(ep != NULL);
+	}
+	else {
+		emufs_lru_remove(ef, ep);
+		emufs_lru_addhead(ef, ep);
+	}
+
+	*ret = ep;
+	return 0;
+}
+
+//
+////////////////////////////////////////////////////////////
+
 ////////////////////////////////////////////////////////////
 //
 // vnode functions
@@ -499,6 +822,8 @@ emufs_reclaim(struct vnode *v)
 	 */
 	spinlock_release(&ev->ev_v.vn_countlock);
 
+	emufs_cache_purge(ef, ev);
+
 	/* emu_close retries on I/O error */
 	result = emu_close(ev->ev_emu, ev->ev_handle);
 	if (result) {
@@ -535,38 +860,70 @@ emufs_reclaim(struct vnode *v)
 
 /*
  * VOP_READ
+ *
+ * Comes out of the data cache; if we can't get a cache page at all,
+ * go to the device directly as before.
  */
 static
 int
 emufs_read(struct vnode *v, struct uio *uio)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	uint32_t amt;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	struct emufs_page *ep;
+	uint32_t amt, pageoff;
 	size_t oldresid;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
+	lock_acquire(ev->ev_emu->e_lock);
+
+	result = 0;
 	while (uio->uio_resid > 0) {
-		amt = uio->uio_resid;
-		if (amt > EMU_MAXIO) {
-			amt = EMU_MAXIO;
+		if (uio->uio_offset > (off_t)0xffffffff) {
+			/* beyond the largest size the file can have */
+			break;
 		}
 
-		oldresid = uio->uio_resid;
-
-		result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
+		result = emufs_cache_get(ef, ev, uio->uio_offset, &ep);
+		if (result == ENOMEM) {
+			amt = uio->uio_resid;
+			if (amt > EMU_MAXIO) {
+				amt = EMU_MAXIO;
+			}
+
+			oldresid = uio->uio_resid;
+			result = emu_read(ev->ev_emu, ev->ev_handle, amt, uio);
+			if (result || uio->uio_resid == oldresid) {
+				break;
+			}
+			continue;
+		}
 		if (result) {
-			return result;
+			break;
 		}
 
-		if (uio->uio_resid == oldresid) {
-			/* nothing read - EOF */
+		pageoff = uio->uio_offset - ep->ep_offset;
+		if (pageoff >= ep->ep_len) {
+			/* EOF */
+			break;
+		}
+		if (pageoff == 0 && ep->ep_len == PAGE_SIZE) {
+			result = uiomovepage((void *)ep->ep_data, PAGE_SIZE,
+					     uio);
+		}
+		else {
+			result = uiomove((char *)ep->ep_data + pageoff,
+					 ep->ep_len - pageoff, uio);
+		}
+		if (result) {
 			break;
 		}
 	}
 
-	return 0;
+	lock_release(ev->ev_emu->e_lock);
+	return result;
 }
 
 /*
@@ -590,19 +947,23 @@ emufs_getdirentry(struct vnode *v, struct uio *uio)
 }
 
 /*
- * VOP_WRITE
+ * Common code for VOP_WRITE and VOP_APPEND. Call with e_lock held.
  */
 static
 int
-emufs_write(struct vnode *v, struct uio *uio)
+emufs_dowrite(struct emufs_fs *ef, struct emufs_vnode *ev, struct uio *uio)
 {
-	struct emufs_vnode *ev = v->vn_data;
 	uint32_t amt;
 	size_t oldresid;
 	int result;
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
+	KASSERT(lock_do_i_hold(ev->ev_emu->e_lock));
+
+	emufs_cache_inval(ef, ev, uio->uio_offset,
+			  uio->uio_offset + uio->uio_resid);
 
+	result = 0;
 	while (uio->uio_resid > 0) {
 		amt = uio->uio_resid;
 		if (amt > EMU_MAXIO) {
@@ -613,7 +974,7 @@ emufs_write(struct vnode *v, struct uio *uio)
 
 		result = emu_write(ev->ev_emu, ev->ev_handle, amt, uio);
 		if (result) {
-			return result;
+			break;
 		}
 
 		if (uio->uio_resid == oldresid) {
@@ -622,7 +983,60 @@ emufs_write(struct vnode *v, struct uio *uio)
 		}
 	}
 
-	return 0;
+	if (result) {
+		ev->ev_sizevalid = false;
+	}
+	else if (ev->ev_sizevalid && uio->uio_offset > ev->ev_size) {
+		ev->ev_size = uio->uio_offset;
+	}
+
+	return result;
+}
+
+/*
+ * VOP_WRITE
+ */
+static
+int
+emufs_write(struct vnode *v, struct uio *uio)
+{
+	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	int result;
+
+	lock_acquire(ev->ev_emu->e_lock);
+	result = emufs_dowrite(ef, ev, uio);
+	lock_release(ev->ev_emu->e_lock);
+	return result;
+}
+
+/*
+ * VOP_APPEND
+ *
+ * Find the end of file and write there without letting go of e_lock,
+ * so no other write can get in between.
+ */
+static
+int
+emufs_append(struct vnode *v, struct uio *uio)
+{
+	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	int result;
+
+	lock_acquire(ev->ev_emu->e_lock);
+	if (!ev->ev_sizevalid) {
+		result = emu_getsize(ev->ev_emu, ev->ev_handle, &ev->ev_size);
+		if (result) {
+			lock_release(ev->ev_emu->e_lock);
+			return result;
+		}
+		ev->ev_sizevalid = true;
+	}
+	uio->uio_offset = ev->ev_size;
+	result = emufs_dowrite(ef, ev, uio);
+	lock_release(ev->ev_emu->e_lock);
+	return result;
 }
 
 /*
@@ -655,10 +1069,18 @@ emufs_stat(struct vnode *v, struct stat *statbuf)
 
 	bzero(statbuf, sizeof(struct stat));
 
-	result = emu_getsize(ev->ev_emu, ev->ev_handle, &statbuf->st_size);
-	if (result) {
-		return result;
+	/* the size is cached after the first time */
+	lock_acquire(ev->ev_emu->e_lock);
+	if (!ev->ev_sizevalid) {
+		result = emu_getsize(ev->ev_emu, ev->ev_handle, &ev->ev_size);
+		if (result) {
+			lock_release(ev->ev_emu->e_lock);
+			return result;
+		}
+		ev->ev_sizevalid = true;
 	}
+	statbuf->st_size = ev->ev_size;
+	lock_release(ev->ev_emu->e_lock);
 
 	result = VOP_GETTYPE(v, &statbuf->st_mode);
 	if (result) {
@@ -725,7 +1147,64 @@ int
 emufs_truncate(struct vnode *v, off_t len)
 {
 	struct emufs_vnode *ev = v->vn_data;
-	return emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	int result;
+
+	lock_acquire(ev->ev_emu->e_lock);
+
+	emufs_cache_inval(ef, ev, len, (off_t)0x100000000ULL);
+	result = emu_trunc(ev->ev_emu, ev->ev_handle, len);
+	ev->ev_size = len;
+	ev->ev_sizevalid = (result == 0);
+
+	lock_release(ev->ev_emu->e_lock);
+	return result;
+}
+
+/*
+ * VOP_READAHEAD
+ *
+ * Pull the windows covering [POS, POS+LEN) into the cache now, so
+ * the reads that follow don't each wait on the device.
+ */
+static
+int
+emufs_readahead(struct vnode *v, off_t pos, off_t len)
+{
+	struct emufs_vnode *ev = v->vn_data;
+	struct emufs_fs *ef = v->vn_fs->fs_data;
+	struct emufs_page *ep;
+	off_t end;
+	int result;
+
+	end = pos + len;
+	if (end > (off_t)0x100000000ULL) {
+		end = (off_t)0x100000000ULL;
+	}
+	pos -= pos % PAGE_SIZE;
+
+	lock_acquire(ev->ev_emu->e_lock);
+
+	result = 0;
+	while (pos < end) {
+		ep = emufs_cache_find(ev, pos);
+		if (ep == NULL) {
+			result = emufs_cache_fill(ef, ev, pos);
+			if (result) {
+				break;
+			}
+			ep = emufs_cache_find(ev, pos);
+			KASSERT(ep != NULL);
+		}
+		if (ep->ep_len < PAGE_SIZE) {
+			/* EOF */
+			break;
+		}
+		pos += PAGE_SIZE;
+	}
+
+	lock_release(ev->ev_emu->e_lock);
+	return result;
 }
 
 /*
@@ -751,6 +1230,11 @@ emufs_creat(struct vnode *dir, const char *name, bool excl, mode_t mode,
 		return result;
 	}
 
+	/* the directory may have grown */
+	lock_acquire(ev->ev_emu->e_lock);
+	ev->ev_sizevalid = false;
+	lock_release(ev->ev_emu->e_lock);
+
 	result = emufs_loadvnode(ef, handle, isdir, &newguy);
 	vfs_biglock_release();
 	if (result) {
@@ -1088,11 +1572,15 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_readlink = emufs_readlink_notlink,
 	.vop_getdirentry = emufs_uio_op_notdir,
 	.vop_write = emufs_write,
+	.vop_append = emufs_append,
 	.vop_ioctl = emufs_ioctl,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_file_gettype,
 	.vop_isseekable = emufs_isseekable,
 	.vop_fsync = emufs_fsync,
+	.vop_readahead = emufs_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
 	.vop_mmap = emufs_mmap,
 	.vop_truncate = emufs_truncate,
 	.vop_namefile = emufs_uio_op_notdir,
@@ -1122,11 +1610,15 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_readlink = emufs_uio_op_isdir,
 	.vop_getdirentry = emufs_getdirentry,
 	.vop_write = emufs_uio_op_isdir,
+	.vop_append = emufs_uio_op_isdir,
 	.vop_ioctl = emufs_ioctl,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_dir_gettype,
 	.vop_isseekable = emufs_isseekable,
 	.vop_fsync = emufs_void_op_isdir,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
 	.vop_mmap = emufs_void_op_isdir,
 	.vop_truncate = emufs_truncate_isdir,
 	.vop_namefile = emufs_namefile,
@@ -1185,6 +1677,9 @@ emufs_loadvnode(struct emufs_fs *ef, uint32_t handle, int isdir,
 
 	ev->ev_emu = ef->ef_emu;
 	ev->ev_handle = handle;
+	ev->ev_size = 0;
+	ev->ev_sizevalid = false;
+	ev->ev_pages = NULL;
 
 	result = vnode_init(&ev->ev_v, isdir ? &emufs_dirops : &emufs_fileops,
 			    &ef->ef_fs, ev);
@@ -1310,6 +1805,9 @@ emufs_addtovfs(struct emu_softc *sc, const char *devname)
 
 	ef->ef_emu = sc;
 	ef->ef_root = NULL;
+	ef->ef_lruhead = NULL;
+	ef->ef_lrutail = NULL;
+	ef->ef_ncached = 0;
 	ef->ef_vnodes = vnodearray_create();
 	if (ef->ef_vnodes == NULL) {
 		kfree(ef);
@@ -36,9 +36,11 @@
 #include <lib.h>
 #include <uio.h>
 #include <membar.h>
-#include <synch.h>
+#include <spinlock.h>
+#include <wchan.h>
 #include <platform/bus.h>
 #include <vfs.h>
+#include <bio.h>
 #include <lamebus/lhd.h>
 #include "autoconf.h"
 
@@ -96,41 +98,193 @@ int lhd_code_to_errno(struct lhd_softc *lh, int code)
 }
 
 /*
- * Record that an I/O has completed: save the result and poke the
- * completion semaphore.
+ * Copy one sector between the on-card buffer and the current position
+ * in a request's scatter-gather list, and advance the position.
  */
 static
 void
-lhd_iodone(struct lhd_softc *lh, int err)
+lhd_copysect(struct lhd_request *req, void *cardbuf, bool tocard)
 {
-	lh->lh_result = err;
-	V(lh->lh_done);
+	char *card = cardbuf;
+	struct iovec *seg;
+	size_t done, amt;
+
+	for (done = 0; done < LHD_SECTSIZE; done += amt) {
+		KASSERT(req->lr_curseg < req->lr_nsegs);
+		seg = &req->lr_segs[req->lr_curseg];
+
+		amt = seg->iov_len - req->lr_segoff;
+		if (amt > LHD_SECTSIZE - done) {
+			amt = LHD_SECTSIZE - done;
+		}
+		if (tocard) {
+			memcpy(card + done,
+			       (char *)seg->iov_kbase + req->lr_segoff, amt);
+		}
+		else {
+			memcpy((char *)seg->iov_kbase + req->lr_segoff,
+			       card + done, amt);
+		}
+
+		req->lr_segoff += amt;
+		if (req->lr_segoff == seg->iov_len) {
+			req->lr_curseg++;
+			req->lr_segoff = 0;
+		}
+	}
+}
+
+/*
+ * Start the next sector of the active request. For a write, this
+ * means loading the data into the on-card buffer first.
+ */
+static
+void
+lhd_startsect(struct lhd_softc *lh)
+{
+	struct lhd_request *req = lh->lh_active;
+	uint32_t statval = LHD_WORKING;
+
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+	KASSERT(req != NULL);
+	KASSERT(req->lr_cursect < req->lr_nsect);
+
+	if (req->lr_rw == UIO_WRITE) {
+		lhd_copysect(req, lh->lh_buf, true);
+		membar_store_store();
+		statval |= LHD_ISWRITE;
+	}
+
+	/* Tell it what sector we want... */
+	lhd_wreg(lh, LHD_REG_SECT, req->lr_sector + req->lr_cursect);
+
+	/* and start the operation. */
+	lhd_wreg(lh, LHD_REG_STAT, statval);
+}
+
+/*
+ * If the device is idle, start another request: NEXT if it's not
+ * NULL (the next one on a merged chain), otherwise whatever the
+ * scheduler picks.
+ */
+static
+void
+lhd_startnext(struct lhd_softc *lh, struct iosched_req *next)
+{
+	KASSERT(spinlock_do_i_hold(&lh->lh_lock));
+
+	if (lh->lh_active != NULL) {
+		return;
+	}
+
+	if (next == NULL) {
+		next = iosched_next(&lh->lh_sched);
+		if (next == NULL) {
+			return;
+		}
+	}
+
+	lh->lh_active = next->ir_owner;
+	lhd_startsect(lh);
 }
 
 /*
  * Interrupt handler for lhd.
  * Read the status register; if an operation finished, clear the status
- * register and report completion.
+ * register and move the active request along: either start its next
+ * sector right here, or, if it's finished, start the next request and
+ * report completion.
  */
 void
 lhd_irq(void *vlh)
 {
 	struct lhd_softc *lh = vlh;
+	struct lhd_request *req;
 	uint32_t val;
+	int err;
+
+	spinlock_acquire(&lh->lh_lock);
 
 	val = lhd_rdreg(lh, LHD_REG_STAT);
 
 	switch (val & LHD_STATEMASK) {
 	    case LHD_IDLE:
 	    case LHD_WORKING:
-		break;
+		spinlock_release(&lh->lh_lock);
+		return;
 	    case LHD_OK:
 	    case LHD_INVSECT:
 	    case LHD_MEDIA:
 		lhd_wreg(lh, LHD_REG_STAT, 0);
-		lhd_iodone(lh, lhd_code_to_errno(lh, val));
+		err = lhd_code_to_errno(lh, val);
 		break;
+	    default:
+		spinlock_release(&lh->lh_lock);
+		return;
 	}
+
+	req = lh->lh_active;
+	if (req == NULL) {
+		kprintf("lhd%d: Spurious completion\n", lh->lh_unit);
+		spinlock_release(&lh->lh_lock);
+		return;
+	}
+
+	if (err == 0) {
+		if (req->lr_rw == UIO_READ) {
+			membar_load_load();
+			lhd_copysect(req, lh->lh_buf, false);
+		}
+		req->lr_cursect++;
+		if (req->lr_cursect < req->lr_nsect) {
+			/* Keep going without bothering the requester. */
+			lhd_startsect(lh);
+			spinlock_release(&lh->lh_lock);
+			return;
+		}
+	}
+
+	/* The request is finished. */
+	req->lr_result = err;
+	lh->lh_active = NULL;
+	lhd_startnext(lh, req->lr_ir.ir_merged);
+	spinlock_release(&lh->lh_lock);
+
+	/* Call this last, unlocked, in case it submits more I/O. */
+	req->lr_done(req);
+}
+
+/*
+ * Queue a request. Completion is reported through req->lr_done.
+ */
+int
+lhd_submit(struct lhd_softc *lh, struct lhd_request *req)
+{
+	KASSERT(req->lr_nsect > 0);
+	KASSERT(req->lr_done != NULL);
+
+	/* Don't allow I/O past the end of the disk. */
+	if (req->lr_nsect > lh->lh_dev.d_blocks ||
+	    req->lr_sector > lh->lh_dev.d_blocks - req->lr_nsect) {
+		return EINVAL;
+	}
+
+	req->lr_result = 0;
+	req->lr_cursect = 0;
+	req->lr_curseg = 0;
+	req->lr_segoff = 0;
+
+	req->lr_ir.ir_sector = req->lr_sector;
+	req->lr_ir.ir_nsect = req->lr_nsect;
+	req->lr_ir.ir_rw = req->lr_rw;
+	req->lr_ir.ir_owner = req;
+
+	spinlock_acquire(&lh->lh_lock);
+	iosched_add(&lh->lh_sched, &req->lr_ir);
+	lhd_startnext(lh, NULL);
+	spinlock_release(&lh->lh_lock);
+
+	return 0;
 }
 
 /*
@@ -179,8 +333,75 @@ lhd_reset(struct lhd_softc *lh)
 }
 #endif
 
+/*
+ * Synchronous request: submit it and sleep until it's done.
+ */
+
+struct lhd_waiter {
+	struct lhd_softc *lw_lh;
+	bool lw_done;
+};
+
+static
+void
+lhd_syncdone(struct lhd_request *req)
+{
+	struct lhd_waiter *lw = req->lr_data;
+	struct lhd_softc *lh = lw->lw_lh;
+
+	spinlock_acquire(&lh->lh_lock);
+	lw->lw_done = true;
+	wchan_wakeall(lh->lh_wchan, &lh->lh_lock);
+	spinlock_release(&lh->lh_lock);
+}
+
+static
+int
+lhd_syncio(struct lhd_softc *lh, enum uio_rw rw, uint32_t sector,
+	   void *buf, size_t len)
+{
+	struct lhd_request req;
+	struct lhd_waiter lw;
+	struct iovec seg;
+	int result;
+
+	KASSERT(len % LHD_SECTSIZE == 0);
+
+	seg.iov_kbase = buf;
+	seg.iov_len = len;
+
+	req.lr_rw = rw;
+	req.lr_sector = sector;
+	req.lr_nsect = len / LHD_SECTSIZE;
+	req.lr_segs = &seg;
+	req.lr_nsegs = 1;
+	req.lr_done = lhd_syncdone;
+	req.lr_data = &lw;
+
+	lw.lw_lh = lh;
+	lw.lw_done = false;
+
+	result = lhd_submit(lh, &req);
+	if (result) {
+		return result;
+	}
+
+	spinlock_acquire(&lh->lh_lock);
+	while (!lw.lw_done) {
+		wchan_sleep(lh->lh_wchan, &lh->lh_lock);
+	}
+	spinlock_release(&lh->lh_lock);
+
+	return req.lr_result;
+}
+
 /*
  * I/O function (for both reads and writes)
+ *
+ * A kernel buffer that covers the whole transfer is handed to the
+ * device as a single request. Anything else (user buffers in
+ * particular, which can't be touched from the interrupt handler) is
+ * bounced through a kernel buffer, LHD_MAXBOUNCE bytes at a time.
  */
 static
 int
@@ -192,8 +413,8 @@ lhd_io(struct device *d, struct uio *uio)
 	uint32_t sectoff = uio->uio_offset % LHD_SECTSIZE;
 	uint32_t len = uio->uio_resid / LHD_SECTSIZE;
 	uint32_t lenoff = uio->uio_resid % LHD_SECTSIZE;
-	uint32_t i;
-	uint32_t statval = LHD_WORKING;
+	size_t amt;
+	char *bounce;
 	int result;
 
 	/* Don't allow I/O that isn't sector-aligned. */
@@ -202,72 +423,137 @@ lhd_io(struct device *d, struct uio *uio)
 	}
 
 	/* Don't allow I/O past the end of the disk. */
-	/* XXX this check can overflow */
-	if (sector+len > lh->lh_dev.d_blocks) {
+	if (len > lh->lh_dev.d_blocks ||
+	    sector > lh->lh_dev.d_blocks - len) {
 		return EINVAL;
 	}
 
-	/* Set up the value to write into the status register. */
-	if (uio->uio_rw==UIO_WRITE) {
-		statval |= LHD_ISWRITE;
+	if (len == 0) {
+		return 0;
+	}
+
+	if (uio->uio_segflg == UIO_SYSSPACE &&
+	    uio->uio_iov->iov_len >= uio->uio_resid) {
+		amt = uio->uio_resid;
+		result = lhd_syncio(lh, uio->uio_rw, sector,
+				    uio->uio_iov->iov_kbase, amt);
+		if (result) {
+			return result;
+		}
+		uioskip(amt, uio);
+		return 0;
 	}
 
-	/* Loop over all the sectors we were asked to do. */
-	for (i=0; i<len; i++) {
+	amt = uio->uio_resid;
+	if (amt > LHD_MAXBOUNCE) {
+		amt = LHD_MAXBOUNCE;
+	}
+	bounce = kmalloc(amt);
+	if (bounce == NULL) {
+		return ENOMEM;
+	}
 
-		/* Wait until nobody else is using the device. */
-		P(lh->lh_clear);
+	result = 0;
+	while (uio->uio_resid > 0) {
+		amt = uio->uio_resid;
+		if (amt > LHD_MAXBOUNCE) {
+			amt = LHD_MAXBOUNCE;
+		}
 
 		/*
-		 * Are we writing? If so, transfer the data to the
-		 * on-card buffer.
+		 * Don't advance the uio for a write until the data is
+		 * on the disk, so a failed write isn't counted.
 		 */
 		if (uio->uio_rw == UIO_WRITE) {
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-			membar_store_store();
+			result = uiopeek(bounce, amt, uio);
 			if (result) {
-				V(lh->lh_clear);
-				return result;
+				break;
 			}
 		}
 
-		/* Tell it what sector we want... */
-		lhd_wreg(lh, LHD_REG_SECT, sector+i);
+		result = lhd_syncio(lh, uio->uio_rw, sector, bounce, amt);
+		if (result) {
+			break;
+		}
 
-		/* and start the operation. */
-		lhd_wreg(lh, LHD_REG_STAT, statval);
+		if (uio->uio_rw == UIO_READ) {
+			result = uiomove(bounce, amt, uio);
+			if (result) {
+				break;
+			}
+		}
+		else {
+			uioskip(amt, uio);
+		}
 
-		/* Now wait until the interrupt handler tells us we're done. */
-		P(lh->lh_done);
+		sector += amt / LHD_SECTSIZE;
+	}
 
-		/* Get the result value saved by the interrupt handler. */
-		result = lh->lh_result;
+	kfree(bounce);
+	return result;
+}
 
-		/*
-		 * Are we reading? If so, and if we succeeded,
-		 * transfer the data out of the on-card buffer.
-		 */
-		if (result==0 && uio->uio_rw==UIO_READ) {
-			membar_load_load();
-			result = uiomove(lh->lh_buf, LHD_SECTSIZE, uio);
-		}
+/*
+ * Asynchronous I/O for the bio layer. Each bio gets a request of its
+ * own; the completion hook runs in the interrupt handler and hands
+ * the result back with bio_complete.
+ */
 
-		/* Tell another thread it's cleared to go ahead. */
-		V(lh->lh_clear);
+struct lhd_bioreq {
+	struct lhd_request lb_req;
+	struct iovec lb_seg;
+	struct bio *lb_bio;
+};
 
-		/* If we failed, return the error. */
-		if (result) {
-			return result;
-		}
+static
+void
+lhd_biodone(struct lhd_request *req)
+{
+	struct lhd_bioreq *lb = req->lr_data;
+	struct bio *bio = lb->lb_bio;
+	int result = req->lr_result;
+
+	kfree(lb);
+	bio_complete(bio, result);
+}
+
+static
+int
+lhd_strategy(struct device *d, struct bio *bio)
+{
+	struct lhd_softc *lh = d->d_data;
+	struct lhd_bioreq *lb;
+	int result;
+
+	lb = kmalloc(sizeof(*lb));
+	if (lb == NULL) {
+		return ENOMEM;
 	}
 
-	return 0;
+	lb->lb_seg.iov_kbase = bio->bio_data;
+	lb->lb_seg.iov_len = bio->bio_len;
+	lb->lb_bio = bio;
+
+	lb->lb_req.lr_rw = bio->bio_rw;
+	lb->lb_req.lr_sector = bio->bio_block;
+	lb->lb_req.lr_nsect = bio->bio_len / LHD_SECTSIZE;
+	lb->lb_req.lr_segs = &lb->lb_seg;
+	lb->lb_req.lr_nsegs = 1;
+	lb->lb_req.lr_done = lhd_biodone;
+	lb->lb_req.lr_data = lb;
+
+	result = lhd_submit(lh, &lb->lb_req);
+	if (result) {
+		kfree(lb);
+	}
+	return result;
 }
 
 static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_strategy = lhd_strategy,
 };
 
 /*
@@ -277,6 +563,7 @@ int
 config_lhd(struct lhd_softc *lh, int lhdno)
 {
 	char name[32];
+	char *schedname;
 
 	/* Figure out what our name is. */
 	snprintf(name, sizeof(name), "lhd%d", lhdno);
@@ -284,17 +571,21 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 	/* Get a pointer to the on-chip buffer. */
 	lh->lh_buf = bus_map_area(lh->lh_busdata, lh->lh_buspos, LHD_BUFFER);
 
-	/* Create the semaphores. */
-	lh->lh_clear = sem_create("lhd-clear", 1);
-	if (lh->lh_clear == NULL) {
+	/* Set up the request queue. */
+	spinlock_init(&lh->lh_lock);
+	lh->lh_active = NULL;
+	lh->lh_wchan = wchan_create("lhd");
+	if (lh->lh_wchan == NULL) {
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
-	lh->lh_done = sem_create("lhd-done", 0);
-	if (lh->lh_done == NULL) {
-		sem_destroy(lh->lh_clear);
-		lh->lh_clear = NULL;
+	schedname = kstrdup(name);
+	if (schedname == NULL) {
+		wchan_destroy(lh->lh_wchan);
+		spinlock_cleanup(&lh->lh_lock);
 		return ENOMEM;
 	}
+	iosched_init(&lh->lh_sched, schedname, &lh->lh_lock);
 
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_ops = &lhd_devops;
@@ -30,13 +30,55 @@
 #ifndef _LAMEBUS_LHD_H_
 #define _LAMEBUS_LHD_H_
 
+#include <spinlock.h>
+#include <uio.h>
 #include <device.h>
+#include <iosched.h>
 
 /*
  * Our sector size
  */
 #define LHD_SECTSIZE  512
 
+/*
+ * Largest transfer lhd_io does in one request when it has to bounce
+ * the data through a kernel buffer.
+ */
+#define LHD_MAXBOUNCE  (64*LHD_SECTSIZE)
+
+/*
+ * An I/O request: a run of consecutive sectors, transferred to or
+ * from a scatter-gather list of kernel buffers. The total length of
+ * the segments must be LR_NSECT sectors; individual segments need
+ * not be sector multiples.
+ *
+ * Requests are queued with lhd_submit and started in the order chosen
+ * by the device's I/O scheduler (see iosched.h). The driver moves each sector
+ * to or from the segments and starts the next one from its interrupt
+ * handler, so the requester is not woken until the whole request is
+ * finished (or fails). LR_DONE is then called, in interrupt context,
+ * with LR_RESULT set.
+ */
+struct lhd_request {
+	/* Filled in by the requester */
+	enum uio_rw lr_rw;		/* read or write */
+	uint32_t lr_sector;		/* first sector */
+	uint32_t lr_nsect;		/* number of sectors */
+	struct iovec *lr_segs;		/* scatter-gather list */
+	unsigned lr_nsegs;		/* number of segments */
+	void (*lr_done)(struct lhd_request *);	/* completion hook */
+	void *lr_data;			/* for the requester's use */
+
+	/* Filled in by the driver */
+	int lr_result;			/* 0 or errno */
+
+	/* Private to the driver */
+	uint32_t lr_cursect;		/* sectors done so far */
+	unsigned lr_curseg;		/* current segment */
+	size_t lr_segoff;		/* offset within current segment */
+	struct iosched_req lr_ir;	/* scheduler's view of us */
+};
+
 /*
  * Hardware device data associated with lhd (LAMEbus hard disk)
  */
@@ -51,9 +93,10 @@ struct lhd_softc {
 	 */
 
 	void *lh_buf;			/* Pointer to on-card I/O buffer */
-	int lh_result;			/* Result from I/O operation */
-	struct semaphore *lh_clear;	/* Synchronization */
-	struct semaphore *lh_done;
+	struct spinlock lh_lock;	/* Protects the request queue */
+	struct lhd_request *lh_active;	/* Request the device is doing */
+	struct iosched lh_sched;	/* Requests waiting their turn */
+	struct wchan *lh_wchan;		/* For lhd_io to wait on */
 
 	struct device lh_dev;		/* VFS device structure */
 };
@@ -61,4 +104,7 @@ struct lhd_softc {
 /* Functions called by lower-level drivers */
 void lhd_irq(/*struct lhd_softc*/ void *);	/* Interrupt handler */
 
+/* Queue an I/O request */
+int lhd_submit(struct lhd_softc *lh, struct lhd_request *req);
+
 #endif /* _LAMEBUS_LHD_H_ */
@@ -658,11 +658,15 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_readlink = vopfail_uio_isdir,
 	.vop_getdirentry = semfs_getdirentry,
 	.vop_write = vopfail_uio_isdir,
+	.vop_append = vopfail_uio_isdir,
 	.vop_ioctl = semfs_ioctl,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
 	.vop_fsync = semfs_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = semfs_namefile,
@@ -691,11 +695,15 @@ static const struct vnode_ops semfs_semops = {
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = semfs_write,
+	.vop_append = semfs_write,
 	.vop_ioctl = semfs_ioctl,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
 	.vop_fsync = semfs_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
 	.vop_mmap = vopfail_mmap_perm,
 	.vop_truncate = semfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
@@ -33,58 +33,225 @@
  * Block allocation.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
 /*
- * Zero out a disk block.
+ * The volume is divided into groups of SFS_BALLOC_GROUP blocks, and
+ * we keep a count of free blocks in each, so searches can skip full
+ * groups without looking at the bitmap. Allocations without a hint
+ * are next-fit: they start where the last allocation left off.
+ */
+
+/*
+ * Set up the allocator state for a volume whose freemap has just
+ * been loaded.
  */
-static
 int
-sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
+sfs_balloc_init(struct sfs_fs *sfs)
 {
-	/* static -> automatically initialized to zero */
-	static char zeros[SFS_BLOCKSIZE];
+	uint32_t nblocks = sfs->sfs_sb.sb_nblocks;
+	uint32_t block;
+	unsigned g;
 
-	return sfs_writeblock(sfs, block, zeros, SFS_BLOCKSIZE);
+	sfs->sfs_ngroups = DIVROUNDUP(nblocks, SFS_BALLOC_GROUP);
+	sfs->sfs_groupfree = kmalloc(sfs->sfs_ngroups * sizeof(uint32_t));
+	if (sfs->sfs_groupfree == NULL) {
+		return ENOMEM;
+	}
+	for (g=0; g<sfs->sfs_ngroups; g++) {
+		sfs->sfs_groupfree[g] = 0;
+	}
+	for (block=0; block<nblocks; block++) {
+		if (!bitmap_isset(sfs->sfs_freemap, block)) {
+			sfs->sfs_groupfree[block / SFS_BALLOC_GROUP]++;
+		}
+	}
+	sfs->sfs_allocnext = 0;
+	return 0;
 }
 
 /*
- * Allocate a block.
+ * Zero out a disk block. This just leaves a dirty zeroed buffer in
+ * the buffer cache; the caller is presumably about to use it, and if
+ * it overwrites the whole block, the zeros never reach the disk.
  */
 int
-sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
+sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 {
+	struct buf *buf;
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	result = buffer_get(sfs->sfs_device, block, &buf);
 	if (result) {
 		return result;
 	}
-	sfs->sfs_freemapdirty = true;
+	bzero(buffer_map(buf), SFS_BLOCKSIZE);
+	buffer_markdirty(buf);
+	buffer_release(buf);
+	return 0;
+}
 
-	if (*diskblock >= sfs->sfs_sb.sb_nblocks) {
+/*
+ * Update the bookkeeping for a block that's just been marked in use.
+ */
+static
+void
+sfs_balloc_taken(struct sfs_fs *sfs, daddr_t block)
+{
+	if (block >= sfs->sfs_sb.sb_nblocks) {
 		panic("sfs: %s: balloc: invalid block %u\n",
-		      sfs->sfs_sb.sb_volname, *diskblock);
+		      sfs->sfs_sb.sb_volname, block);
+	}
+	KASSERT(sfs->sfs_groupfree[block / SFS_BALLOC_GROUP] > 0);
+	sfs->sfs_groupfree[block / SFS_BALLOC_GROUP]--;
+	sfs->sfs_freemapdirty = true;
+	sfs->sfs_allocnext = (block + 1) % sfs->sfs_sb.sb_nblocks;
+}
+
+/*
+ * Find and mark the first free block at or after HINT, skipping full
+ * groups, and wrapping around at the end of the volume.
+ */
+static
+int
+sfs_balloc_search(struct sfs_fs *sfs, daddr_t hint, daddr_t *diskblock)
+{
+	uint32_t nblocks = sfs->sfs_sb.sb_nblocks;
+	uint32_t start, gstart, gend;
+	unsigned g, n;
+
+	g = hint / SFS_BALLOC_GROUP;
+	start = hint;
+
+	/* Visit the first group twice: from HINT now, from its start last */
+	for (n=0; n<=sfs->sfs_ngroups; n++) {
+		if (sfs->sfs_groupfree[g] > 0) {
+			gstart = g * SFS_BALLOC_GROUP;
+			gend = gstart + SFS_BALLOC_GROUP;
+			if (gend > nblocks) {
+				gend = nblocks;
+			}
+			if (start < gstart) {
+				start = gstart;
+			}
+			if (bitmap_alloc_range(sfs->sfs_freemap, start, gend,
+					       diskblock) == 0) {
+				return 0;
+			}
+		}
+		g = (g + 1) % sfs->sfs_ngroups;
+		start = g * SFS_BALLOC_GROUP;
 	}
+	return ENOSPC;
+}
+
+/*
+ * Allocate a block: the first free one at or after HINT, wrapping
+ * around to the start of the volume if necessary. Pass 0 for HINT
+ * if there's no block to be near, to continue from the last
+ * allocation.
+ */
+int
+sfs_balloc(struct sfs_fs *sfs, daddr_t hint, daddr_t *diskblock)
+{
+	int result;
+
+	if (hint == 0 || hint >= sfs->sfs_sb.sb_nblocks) {
+		hint = sfs->sfs_allocnext;
+	}
+
+	result = sfs_balloc_search(sfs, hint, diskblock);
+	if (result) {
+		return result;
+	}
+	sfs_balloc_taken(sfs, *diskblock);
 
 	/* Clear block before returning it */
 	result = sfs_clearblock(sfs, *diskblock);
 	if (result) {
-		bitmap_unmark(sfs->sfs_freemap, *diskblock);
+		sfs_bfree(sfs, *diskblock);
 	}
 	return result;
 }
 
 /*
- * Free a block.
+ * Allocate a run of NBLOCKS contiguous blocks, the first such run at
+ * or after HINT (runs don't wrap around the end of the volume). The
+ * blocks are not cleared; whoever uses them must do that, with
+ * sfs_clearblock, or overwrite them completely.
+ */
+int
+sfs_balloc_run(struct sfs_fs *sfs, daddr_t hint, uint32_t nblocks,
+	       daddr_t *start)
+{
+	uint32_t volblocks = sfs->sfs_sb.sb_nblocks;
+	uint32_t block, scanned, runstart, runlen, skip, i;
+
+	KASSERT(nblocks > 0);
+
+	if (hint >= volblocks) {
+		hint = 0;
+	}
+
+	block = hint;
+	runstart = runlen = 0;
+	for (scanned = 0; scanned < volblocks; ) {
+		if (block >= volblocks) {
+			block = 0;
+			runlen = 0;
+		}
+		if (block % SFS_BALLOC_GROUP == 0 &&
+		    sfs->sfs_groupfree[block / SFS_BALLOC_GROUP] == 0) {
+			/* Whole group is full */
+			skip = SFS_BALLOC_GROUP;
+			if (skip > volblocks - block) {
+				skip = volblocks - block;
+			}
+			block += skip;
+			scanned += skip;
+			runlen = 0;
+			continue;
+		}
+		if (bitmap_isset(sfs->sfs_freemap, block)) {
+			runlen = 0;
+		}
+		else {
+			if (runlen == 0) {
+				runstart = block;
+			}
+			runlen++;
+			if (runlen == nblocks) {
+				goto found;
+			}
+		}
+		block++;
+		scanned++;
+	}
+	return ENOSPC;
+
+ found:
+	for (i=0; i<nblocks; i++) {
+		bitmap_mark(sfs->sfs_freemap, runstart + i);
+		sfs_balloc_taken(sfs, runstart + i);
+	}
+	*start = runstart;
+	return 0;
+}
+
+/*
+ * Free a block. Any cached copy is discarded, pending writes and all.
  */
 void
 sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
+	buffer_drop(sfs->sfs_device, diskblock);
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
+	sfs->sfs_groupfree[diskblock / SFS_BALLOC_GROUP]++;
 	sfs->sfs_freemapdirty = true;
 }
 
@@ -100,4 +267,3 @@ sfs_bused(struct sfs_fs *sfs, daddr_t diskblock)
 	}
 	return bitmap_isset(sfs->sfs_freemap, diskblock);
 }
-
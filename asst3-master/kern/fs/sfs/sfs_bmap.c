@@ -36,165 +36,448 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/*
+ * Where a file block is mapped. Blocks below SFS_NDIRECT are direct
+ * blocks; after that come the blocks reached through the single,
+ * double, and triple indirect blocks, in that order. LEVELS is the
+ * number of indirect blocks to go through (0 for a direct block) and
+ * OFFSETS[k] is the entry to take from the k'th of them, counting
+ * from the one named in the inode.
+ */
+struct sfs_bmappath {
+	uint32_t *top;			/* slot in the inode */
+	unsigned levels;		/* 0-3 */
+	uint32_t offsets[3];
+};
+
+/*
+ * Return the inode slot for the indirect block at indirection LEVEL.
+ */
+static
+uint32_t *
+sfs_bmap_indirect(struct sfs_vnode *sv, unsigned level)
+{
+	switch (level) {
+	    case 1: return &sv->sv_i.sfi_indirect;
+	    case 2: return &sv->sv_i.sfi_dindirect;
+	    case 3: return &sv->sv_i.sfi_tindirect;
+	}
+	panic("sfs: bmap: invalid indirection level %u\n", level);
+	return NULL;
+}
+
+/*
+ * Work out the path to FILEBLOCK. Fails with EFBIG if the block is
+ * past the largest file the inode can map.
+ */
+static
+int
+sfs_bmap_locate(struct sfs_vnode *sv, uint32_t fileblock,
+		struct sfs_bmappath *path)
+{
+	uint32_t range;
+	unsigned level, k;
+
+	if (fileblock < SFS_NDIRECT) {
+		path->top = &sv->sv_i.sfi_direct[fileblock];
+		path->levels = 0;
+		return 0;
+	}
+	fileblock -= SFS_NDIRECT;
+
+	/* RANGE is the number of blocks mapped at each level */
+	range = SFS_DBPERIDB;
+	for (level = 1; level <= 3; level++) {
+		if (fileblock < range) {
+			break;
+		}
+		fileblock -= range;
+		range *= SFS_DBPERIDB;
+	}
+	if (level > 3) {
+		return EFBIG;
+	}
+
+	path->top = sfs_bmap_indirect(sv, level);
+	path->levels = level;
+	for (k = level; k > 0; k--) {
+		path->offsets[k-1] = fileblock % SFS_DBPERIDB;
+		fileblock /= SFS_DBPERIDB;
+	}
+	return 0;
+}
+
+/*
+ * Allocate a block for a file, as close after the last block
+ * allocated for it as possible, so files that are written in order
+ * come out contiguous on disk.
+ */
+static
+int
+sfs_bmap_alloc(struct sfs_vnode *sv, daddr_t *diskblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	int result;
+
+	if (sv->sv_resvleft > 0) {
+		/* Take the next block of the run sfs_bmap_reserve got */
+		result = sfs_clearblock(sfs, sv->sv_resvnext);
+		if (result) {
+			return result;
+		}
+		*diskblock = sv->sv_resvnext++;
+		sv->sv_resvleft--;
+		sv->sv_allochint = *diskblock;
+		return 0;
+	}
+
+	result = sfs_balloc(sfs, sv->sv_allochint, diskblock);
+	if (result) {
+		return result;
+	}
+	sv->sv_allochint = *diskblock;
+	return 0;
+}
+
+/*
+ * Before a write of LEN bytes at POS, reserve a contiguous run of
+ * blocks for the part of it past the end of the file, so that the
+ * blocks the write allocates come out in one piece even if other
+ * files are allocating at the same time. If there's no run that
+ * long, try shorter ones; if there's nothing, sfs_bmap_alloc will
+ * allocate block by block as usual. sfs_bmap_unreserve must be called
+ * after the write to give back whatever wasn't used.
+ */
+void
+sfs_bmap_reserve(struct sfs_vnode *sv, off_t pos, size_t len)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t first, end, n;
+	daddr_t start;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(sv->sv_resvleft == 0);
+
+	/* File blocks past EOF that the write will need */
+	first = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	if (pos / SFS_BLOCKSIZE > first) {
+		first = pos / SFS_BLOCKSIZE;
+	}
+	end = DIVROUNDUP(pos + len, SFS_BLOCKSIZE);
+	if (end <= first + 1) {
+		/* Zero or one block; nothing to gain */
+		return;
+	}
+
+	n = end - first;
+	if (n > SFS_RESERVE_MAX) {
+		n = SFS_RESERVE_MAX;
+	}
+	for (; n > 1; n /= 2) {
+		if (sfs_balloc_run(sfs, sv->sv_allochint, n, &start) == 0) {
+			sv->sv_resvnext = start;
+			sv->sv_resvleft = n;
+			return;
+		}
+	}
+}
+
+/*
+ * Give back any blocks sfs_bmap_reserve got that weren't used.
+ */
+void
+sfs_bmap_unreserve(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	while (sv->sv_resvleft > 0) {
+		sfs_bfree(sfs, sv->sv_resvnext++);
+		sv->sv_resvleft--;
+	}
+}
+
 /*
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
  * file. If DOALLOC is set, and no such block exists, one will be
- * allocated.
+ * allocated, along with any indirect blocks needed to reach it.
  */
 int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	 daddr_t *diskblock)
 {
-	/*
-	 * I/O buffer for handling indirect blocks.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
-	daddr_t block;
-	daddr_t idblock;
-	uint32_t idnum, idoff;
+	struct sfs_bmappath path;
+	struct buf *idbuf;
+	uint32_t *iddata;
+	daddr_t block, next;
+	unsigned k;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	COMPILE_ASSERT(SFS_DBPERIDB * sizeof(uint32_t) == SFS_BLOCKSIZE);
 
-	/* Since we're using a static buffer, we'd better be locked. */
+	/* We may update the inode and freemap; we'd better be locked. */
 	KASSERT(vfs_biglock_do_i_hold());
 
+	result = sfs_bmap_locate(sv, fileblock, &path);
+	if (result) {
+		return result;
+	}
+
 	/*
-	 * If the block we want is one of the direct blocks...
+	 * Get the block named in the inode: either the data block
+	 * itself or the top indirect block. Allocate it if needed.
 	 */
-	if (fileblock < SFS_NDIRECT) {
-		/*
-		 * Get the block number
-		 */
-		block = sv->sv_i.sfi_direct[fileblock];
-
-		/*
-		 * Do we need to allocate?
-		 */
-		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+	block = *path.top;
+	if (block == 0) {
+		if (!doalloc) {
+			*diskblock = 0;
+			return 0;
+		}
+		result = sfs_bmap_alloc(sv, &block);
+		if (result) {
+			return result;
+		}
+		*path.top = block;
+		sv->sv_dirty = true;
+	}
+
+	/*
+	 * Walk down through the indirect blocks. A newly allocated
+	 * indirect block was left zeroed in the buffer cache by
+	 * sfs_balloc, so reading it is cheap.
+	 */
+	for (k = 0; k < path.levels; k++) {
+		result = buffer_read(sfs->sfs_device, block, &idbuf);
+		if (result) {
+			return result;
+		}
+		iddata = buffer_map(idbuf);
+
+		next = iddata[path.offsets[k]];
+		if (next == 0 && doalloc) {
+			result = sfs_bmap_alloc(sv, &next);
 			if (result) {
+				buffer_release(idbuf);
 				return result;
 			}
-
-			/* Remember what we allocated; mark inode dirty */
-			sv->sv_i.sfi_direct[fileblock] = block;
-			sv->sv_dirty = true;
+			iddata[path.offsets[k]] = next;
+			buffer_markdirty(idbuf);
 		}
+		buffer_release(idbuf);
 
-		/*
-		 * Hand back the block
-		 */
-		if (block != 0 && !sfs_bused(sfs, block)) {
-			panic("sfs: %s: Data block %u (block %u of file %u) "
-			      "marked free\n", sfs->sfs_sb.sb_volname,
-			      block, fileblock, sv->sv_ino);
+		if (next == 0) {
+			/* Not mapped, and we weren't asked to allocate */
+			*diskblock = 0;
+			return 0;
 		}
-		*diskblock = block;
-		return 0;
+		block = next;
 	}
 
-	/*
-	 * It's not a direct block; it must be in the indirect block.
-	 * Subtract off the number of direct blocks, so FILEBLOCK is
-	 * now the offset into the indirect block space.
-	 */
+	/* Hand back the result and return. */
+	if (!sfs_bused(sfs, block)) {
+		panic("sfs: %s: Data block %u (block %u of file %u) "
+		      "marked free\n", sfs->sfs_sb.sb_volname,
+		      block, fileblock, sv->sv_ino);
+	}
+	*diskblock = block;
+	return 0;
+}
 
-	fileblock -= SFS_NDIRECT;
+/*
+ * Look up the disk blocks for NBLOCKS consecutive blocks of a file
+ * starting at FILEBLOCK, without allocating anything; unmapped blocks
+ * come back as 0. The indirect blocks on the current path are kept
+ * held from one block to the next, so each is read once for the whole
+ * range rather than once per block as calling sfs_bmap in a loop
+ * would.
+ */
+int
+sfs_bmap_range(struct sfs_vnode *sv, uint32_t fileblock, uint32_t nblocks,
+	       daddr_t *diskblocks)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_bmappath path;
+	struct buf *idbufs[3] = { NULL, NULL, NULL };
+	daddr_t idblocks[3];
+	daddr_t block;
+	uint32_t i;
+	unsigned k;
+	int result = 0;
 
-	/* Get the indirect block number and offset w/i that indirect block */
-	idnum = fileblock / SFS_DBPERIDB;
-	idoff = fileblock % SFS_DBPERIDB;
+	KASSERT(vfs_biglock_do_i_hold());
 
-	/*
-	 * We only have one indirect block. If the offset we were asked for
-	 * is too large, we can't handle it, so fail.
-	 */
-	if (idnum >= SFS_NINDIRECT) {
-		return EFBIG;
-	}
+	for (i=0; i<nblocks; i++, fileblock++) {
+		if (sfs_bmap_locate(sv, fileblock, &path)) {
+			/* Past the largest possible file: unmapped */
+			diskblocks[i] = 0;
+			continue;
+		}
 
-	/* Get the disk block number of the indirect block. */
-	idblock = sv->sv_i.sfi_indirect;
+		block = *path.top;
+		for (k = 0; k < path.levels && block != 0; k++) {
+			if (idbufs[k] == NULL || idblocks[k] != block) {
+				if (idbufs[k] != NULL) {
+					buffer_release(idbufs[k]);
+					idbufs[k] = NULL;
+				}
+				result = buffer_read(sfs->sfs_device, block,
+						     &idbufs[k]);
+				if (result) {
+					idbufs[k] = NULL;
+					goto done;
+				}
+				idblocks[k] = block;
+			}
+			block = ((uint32_t *)buffer_map(idbufs[k]))
+				[path.offsets[k]];
+		}
+		diskblocks[i] = block;
+	}
 
-	if (idblock==0 && !doalloc) {
-		/*
-		 * There's no indirect block allocated. We weren't
-		 * asked to allocate anything, so pretend the indirect
-		 * block was filled with all zeros.
-		 */
-		*diskblock = 0;
-		return 0;
+ done:
+	for (k = 0; k < 3; k++) {
+		if (idbufs[k] != NULL) {
+			buffer_release(idbufs[k]);
+		}
 	}
-	else if (idblock==0) {
-		/*
-		 * There's no indirect block allocated, but we need to
-		 * allocate a block whose number needs to be stored in
-		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
-		 */
-		result = sfs_balloc(sfs, &idblock);
+	return result;
+}
+
+/*
+ * Write back indirect block BLOCK, at indirection LEVEL, and all the
+ * indirect blocks under it.
+ */
+static
+int
+sfs_bmap_syncindirect(struct sfs_fs *sfs, daddr_t block, unsigned level)
+{
+	struct buf *idbuf;
+	uint32_t *iddata;
+	uint32_t j;
+	int result;
+
+	if (level > 1) {
+		result = buffer_read(sfs->sfs_device, block, &idbuf);
 		if (result) {
 			return result;
 		}
+		iddata = buffer_map(idbuf);
+		for (j=0; j<SFS_DBPERIDB; j++) {
+			if (iddata[j] == 0) {
+				continue;
+			}
+			result = sfs_bmap_syncindirect(sfs, iddata[j],
+						       level - 1);
+			if (result) {
+				buffer_release(idbuf);
+				return result;
+			}
+		}
+		buffer_release(idbuf);
+	}
+	return buffer_syncblock(sfs->sfs_device, block);
+}
 
-		/* Remember the block we just allocated */
-		sv->sv_i.sfi_indirect = idblock;
+/*
+ * Write back all of a file's indirect blocks. For fsync.
+ */
+int
+sfs_bmap_sync(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t *slot;
+	unsigned level;
+	int result;
 
-		/* Mark the inode dirty */
-		sv->sv_dirty = true;
+	KASSERT(vfs_biglock_do_i_hold());
 
-		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
-	}
-	else {
-		/*
-		 * We already have an indirect block allocated; load it.
-		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+	for (level = 1; level <= 3; level++) {
+		slot = sfs_bmap_indirect(sv, level);
+		if (*slot == 0) {
+			continue;
+		}
+		result = sfs_bmap_syncindirect(sfs, *slot, level);
 		if (result) {
 			return result;
 		}
 	}
+	return 0;
+}
 
-	/* Get the block out of the indirect block buffer */
-	block = idbuf[idoff];
+/*
+ * Free every block at or past file block KEEP under the indirect
+ * block BLOCK, which is at indirection LEVEL and maps file blocks
+ * starting at BASE. Sets *ISEMPTY if nothing is left under BLOCK, in
+ * which case the caller should free BLOCK itself.
+ */
+static
+int
+sfs_itrunc_indirect(struct sfs_fs *sfs, daddr_t block, unsigned level,
+		    uint32_t base, uint32_t keep, bool *isempty)
+{
+	struct buf *idbuf;
+	uint32_t *iddata;
+	uint32_t range, entbase, j;
+	unsigned k;
+	bool iddirty = false, hasnonzero = false, subempty;
+	int result;
 
-	/* If there's no block there, allocate one */
-	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
-		if (result) {
-			return result;
-		}
+	/* Number of file blocks mapped by each entry */
+	range = 1;
+	for (k = 1; k < level; k++) {
+		range *= SFS_DBPERIDB;
+	}
+
+	result = buffer_read(sfs->sfs_device, block, &idbuf);
+	if (result) {
+		return result;
+	}
+	iddata = buffer_map(idbuf);
 
-		/* Remember the block we allocated */
-		idbuf[idoff] = block;
+	for (j=0; j<SFS_DBPERIDB; j++) {
+		entbase = base + j * range;
 
-		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			return result;
+		/* Discard anything that's past the new EOF */
+		if (iddata[j] != 0 && entbase + range > keep) {
+			if (level == 1) {
+				subempty = true;
+			}
+			else {
+				result = sfs_itrunc_indirect(sfs, iddata[j],
+							     level - 1,
+							     entbase, keep,
+							     &subempty);
+				if (result) {
+					break;
+				}
+			}
+			if (subempty) {
+				sfs_bfree(sfs, iddata[j]);
+				iddata[j] = 0;
+				iddirty = true;
+			}
+		}
+
+		/* Remember if we see any nonzero blocks in here */
+		if (iddata[j] != 0) {
+			hasnonzero = true;
 		}
 	}
 
-	/* Hand back the result and return. */
-	if (block != 0 && !sfs_bused(sfs, block)) {
-		panic("sfs: %s: Data block %u (block %u of file %u) "
-		      "marked free\n", sfs->sfs_sb.sb_volname,
-		      block, fileblock, sv->sv_ino);
+	if (iddirty) {
+		buffer_markdirty(idbuf);
 	}
-	*diskblock = block;
-	return 0;
+	buffer_release(idbuf);
+
+	*isempty = !hasnonzero;
+	return result;
 }
 
 /*
@@ -203,27 +486,17 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 int
 sfs_itrunc(struct sfs_vnode *sv, off_t len)
 {
-	/*
-	 * I/O buffer for handling the indirect block.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
 
 	/* Length in blocks (divide rounding up) */
 	uint32_t blocklen = DIVROUNDUP(len, SFS_BLOCKSIZE);
 
-	uint32_t i, j;
-	daddr_t block, idblock;
-	uint32_t baseblock, highblock;
+	uint32_t i, base, range;
+	uint32_t *slot;
+	daddr_t block;
+	unsigned level;
+	bool isempty;
 	int result;
-	int hasnonzero, iddirty;
-
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
 
 	vfs_biglock_acquire();
 
@@ -240,55 +513,32 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		}
 	}
 
-	/* Indirect block number */
-	idblock = sv->sv_i.sfi_indirect;
-
-	/* The lowest block in the indirect block */
-	baseblock = SFS_NDIRECT;
-
-	/* The highest block in the indirect block */
-	highblock = baseblock + SFS_DBPERIDB - 1;
-
-	if (blocklen < highblock && idblock != 0) {
-		/* We're past the proposed EOF; may need to free stuff */
-
-		/* Read the indirect block */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
-		if (result) {
-			vfs_biglock_release();
-			return result;
-		}
-
-		hasnonzero = 0;
-		iddirty = 0;
-		for (j=0; j<SFS_DBPERIDB; j++) {
-			/* Discard any blocks that are past the new EOF */
-			if (blocklen < baseblock+j && idbuf[j] != 0) {
-				sfs_bfree(sfs, idbuf[j]);
-				idbuf[j] = 0;
-				iddirty = 1;
-			}
-			/* Remember if we see any nonzero blocks in here */
-			if (idbuf[j]!=0) {
-				hasnonzero=1;
-			}
-		}
-
-		if (!hasnonzero) {
-			/* The whole indirect block is empty now; free it */
-			sfs_bfree(sfs, idblock);
-			sv->sv_i.sfi_indirect = 0;
-			sv->sv_dirty = true;
-		}
-		else if (iddirty) {
-			/* The indirect block is dirty; write it back */
-			result = sfs_writeblock(sfs, idblock, idbuf,
-						sizeof(idbuf));
+	/*
+	 * Now the single, double, and triple indirect blocks. Each
+	 * maps RANGE blocks starting at BASE; if any of that is past
+	 * the new EOF, go through it, and if it ends up empty, free
+	 * the indirect block too.
+	 */
+	base = SFS_NDIRECT;
+	range = SFS_DBPERIDB;
+	for (level = 1; level <= 3; level++) {
+		slot = sfs_bmap_indirect(sv, level);
+		if (*slot != 0 && base + range > blocklen) {
+			result = sfs_itrunc_indirect(sfs, *slot, level,
+						     base, blocklen,
+						     &isempty);
 			if (result) {
 				vfs_biglock_release();
 				return result;
 			}
+			if (isempty) {
+				sfs_bfree(sfs, *slot);
+				*slot = 0;
+				sv->sv_dirty = true;
+			}
 		}
+		base += range;
+		range *= SFS_DBPERIDB;
 	}
 
 	/* Set the file size */
@@ -300,4 +550,3 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	vfs_biglock_release();
 	return 0;
 }
-
@@ -31,6 +31,12 @@
  * SFS filesystem
  *
  * Directory I/O
+ *
+ * Name lookups go through an in-memory hash of the directory's
+ * entries, built the first time the directory is searched and kept up
+ * to date by sfs_writedir, which every change to a directory goes
+ * through. If there's no memory for the hash, lookups fall back to
+ * scanning the directory.
  */
 #include <types.h>
 #include <kern/errno.h>
@@ -39,6 +45,31 @@
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Initial and maximum number of hash buckets */
+#define SFS_DIRHASH_MINBUCKETS	16
+#define SFS_DIRHASH_MAXBUCKETS	4096
+
+/*
+ * One directory entry, or one empty slot.
+ */
+struct sfs_dirhash_entry {
+	struct sfs_dirhash_entry *de_next;	/* bucket or free list */
+	int de_slot;
+	uint32_t de_ino;
+	char de_name[SFS_NAMELEN];
+};
+
+/*
+ * Name hash for a directory. Empty slots are kept on their own list,
+ * so sfs_dir_link can reuse one without scanning.
+ */
+struct sfs_dirhash {
+	struct sfs_dirhash_entry **dh_buckets;
+	unsigned dh_nbuckets;
+	unsigned dh_count;			/* names in the table */
+	struct sfs_dirhash_entry *dh_empty;	/* empty slots */
+};
+
 /*
  * Read the directory entry out of slot SLOT of a directory vnode.
  * The "slot" is the index of the directory entry, starting at 0.
@@ -55,23 +86,6 @@ sfs_readdir(struct sfs_vnode *sv, int slot, struct sfs_direntry *sd)
 	return sfs_metaio(sv, actualpos, sd, sizeof(*sd), UIO_READ);
 }
 
-/*
- * Write (overwrite) the directory entry in slot SLOT of a directory
- * vnode.
- */
-static
-int
-sfs_writedir(struct sfs_vnode *sv, int slot, struct sfs_direntry *sd)
-{
-	off_t actualpos;
-
-	/* Compute the actual position in the directory. */
-	KASSERT(slot>=0);
-	actualpos = slot * sizeof(struct sfs_direntry);
-
-	return sfs_metaio(sv, actualpos, sd, sizeof(*sd), UIO_WRITE);
-}
-
 /*
  * Compute the number of entries in a directory.
  * This actually computes the number of existing slots, and does not
@@ -95,13 +109,295 @@ sfs_dir_nentries(struct sfs_vnode *sv)
 	return size / sizeof(struct sfs_direntry);
 }
 
+////////////////////////////////////////////////////////////
+// Name hash
+
+static
+unsigned
+sfs_dirhash_func(const char *name, unsigned nbuckets)
+{
+	unsigned h = 5381;
+
+	while (*name) {
+		h = h*33 + (unsigned char)*name++;
+	}
+	return h % nbuckets;
+}
+
 /*
- * Search a directory for a particular filename in a directory, and
- * return its inode number, its slot, and/or the slot number of an
- * empty directory slot if one is found.
+ * Free a directory's name hash, if it has one.
  */
+void
+sfs_dirhash_destroy(struct sfs_vnode *sv)
+{
+	struct sfs_dirhash *dh = sv->sv_dirhash;
+	struct sfs_dirhash_entry *de;
+	unsigned i;
+
+	if (dh == NULL) {
+		return;
+	}
+	for (i=0; i<dh->dh_nbuckets; i++) {
+		while ((de = dh->dh_buckets[i]) != NULL) {
+			dh->dh_buckets[i] = de->de_next;
+			kfree(de);
+		}
+	}
+	while ((de = dh->dh_empty) != NULL) {
+		dh->dh_empty = de->de_next;
+		kfree(de);
+	}
+	kfree(dh->dh_buckets);
+	kfree(dh);
+	sv->sv_dirhash = NULL;
+}
+
+/*
+ * Double the number of buckets, if we're not at the limit already.
+ * Failing to grow isn't an error; the chains just get longer.
+ */
+static
+void
+sfs_dirhash_grow(struct sfs_dirhash *dh)
+{
+	struct sfs_dirhash_entry **newbuckets, *de;
+	unsigned newnbuckets, i, h;
+
+	if (dh->dh_nbuckets >= SFS_DIRHASH_MAXBUCKETS) {
+		return;
+	}
+	newnbuckets = dh->dh_nbuckets * 2;
+	newbuckets = kmalloc(newnbuckets * sizeof(newbuckets[0]));
+	if (newbuckets == NULL) {
+		return;
+	}
+	for (i=0; i<newnbuckets; i++) {
+		newbuckets[i] = NULL;
+	}
+	for (i=0; i<dh->dh_nbuckets; i++) {
+		while ((de = dh->dh_buckets[i]) != NULL) {
+			dh->dh_buckets[i] = de->de_next;
+			h = sfs_dirhash_func(de->de_name, newnbuckets);
+			de->de_next = newbuckets[h];
+			newbuckets[h] = de;
+		}
+	}
+	kfree(dh->dh_buckets);
+	dh->dh_buckets = newbuckets;
+	dh->dh_nbuckets = newnbuckets;
+}
+
+/*
+ * Record directory entry SD, in slot SLOT, in the hash.
+ */
+static
 int
-sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+sfs_dirhash_add(struct sfs_dirhash *dh, int slot,
+		const struct sfs_direntry *sd)
+{
+	struct sfs_dirhash_entry *de;
+	unsigned h;
+
+	de = kmalloc(sizeof(*de));
+	if (de == NULL) {
+		return ENOMEM;
+	}
+	de->de_slot = slot;
+	de->de_ino = sd->sfd_ino;
+	strcpy(de->de_name, sd->sfd_name);
+
+	if (sd->sfd_ino == SFS_NOINO) {
+		de->de_next = dh->dh_empty;
+		dh->dh_empty = de;
+		return 0;
+	}
+
+	if (dh->dh_count >= dh->dh_nbuckets * 2) {
+		sfs_dirhash_grow(dh);
+	}
+	h = sfs_dirhash_func(de->de_name, dh->dh_nbuckets);
+	de->de_next = dh->dh_buckets[h];
+	dh->dh_buckets[h] = de;
+	dh->dh_count++;
+	return 0;
+}
+
+/*
+ * Forget directory entry SD, which was in slot SLOT.
+ */
+static
+void
+sfs_dirhash_remove(struct sfs_dirhash *dh, int slot,
+		   const struct sfs_direntry *sd)
+{
+	struct sfs_dirhash_entry **dep, *de;
+
+	if (sd->sfd_ino == SFS_NOINO) {
+		dep = &dh->dh_empty;
+	}
+	else {
+		dep = &dh->dh_buckets[sfs_dirhash_func(sd->sfd_name,
+						       dh->dh_nbuckets)];
+	}
+	for (; *dep != NULL; dep = &(*dep)->de_next) {
+		if ((*dep)->de_slot == slot) {
+			de = *dep;
+			*dep = de->de_next;
+			if (de->de_ino != SFS_NOINO) {
+				dh->dh_count--;
+			}
+			kfree(de);
+			return;
+		}
+	}
+}
+
+/*
+ * Build the name hash for a directory, reading it a block at a time.
+ * On failure the directory just doesn't get a hash.
+ */
+static
+int
+sfs_dirhash_build(struct sfs_vnode *sv)
+{
+	const int maxn = SFS_BLOCKSIZE / sizeof(struct sfs_direntry);
+	struct sfs_direntry *sds;
+	struct sfs_dirhash *dh;
+	int nentries, slot, n, i, result;
+	unsigned j;
+
+	KASSERT(sv->sv_dirhash == NULL);
+
+	/* A block's worth at a time; too big for the kernel stack */
+	sds = kmalloc(maxn * sizeof(struct sfs_direntry));
+	if (sds == NULL) {
+		return ENOMEM;
+	}
+
+	dh = kmalloc(sizeof(*dh));
+	if (dh == NULL) {
+		kfree(sds);
+		return ENOMEM;
+	}
+	dh->dh_buckets = kmalloc(SFS_DIRHASH_MINBUCKETS *
+				 sizeof(dh->dh_buckets[0]));
+	if (dh->dh_buckets == NULL) {
+		kfree(dh);
+		kfree(sds);
+		return ENOMEM;
+	}
+	for (j=0; j<SFS_DIRHASH_MINBUCKETS; j++) {
+		dh->dh_buckets[j] = NULL;
+	}
+	dh->dh_nbuckets = SFS_DIRHASH_MINBUCKETS;
+	dh->dh_count = 0;
+	dh->dh_empty = NULL;
+	sv->sv_dirhash = dh;
+
+	nentries = sfs_dir_nentries(sv);
+	for (slot = 0; slot < nentries; slot += n) {
+		n = nentries - slot;
+		if (n > maxn) {
+			n = maxn;
+		}
+		result = sfs_metaio(sv, slot * sizeof(struct sfs_direntry),
+				    sds, n * sizeof(struct sfs_direntry),
+				    UIO_READ);
+		if (result) {
+			sfs_dirhash_destroy(sv);
+			kfree(sds);
+			return result;
+		}
+		for (i=0; i<n; i++) {
+			/* Ensure null termination, just in case */
+			sds[i].sfd_name[sizeof(sds[i].sfd_name)-1] = 0;
+			result = sfs_dirhash_add(dh, slot + i, &sds[i]);
+			if (result) {
+				sfs_dirhash_destroy(sv);
+				kfree(sds);
+				return result;
+			}
+		}
+	}
+	kfree(sds);
+	return 0;
+}
+
+/*
+ * Look up NAME in the hash.
+ */
+static
+struct sfs_dirhash_entry *
+sfs_dirhash_find(struct sfs_dirhash *dh, const char *name)
+{
+	struct sfs_dirhash_entry *de;
+
+	for (de = dh->dh_buckets[sfs_dirhash_func(name, dh->dh_nbuckets)];
+	     de != NULL;
+	     de = de->de_next) {
+		if (!strcmp(de->de_name, name)) {
+			return de;
+		}
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////
+// Directory operations
+
+/*
+ * Write (overwrite) the directory entry in slot SLOT of a directory
+ * vnode, and update the name hash to match.
+ */
+static
+int
+sfs_writedir(struct sfs_vnode *sv, int slot, struct sfs_direntry *sd)
+{
+	struct sfs_dirhash *dh = sv->sv_dirhash;
+	struct sfs_direntry oldsd;
+	off_t actualpos;
+	bool appending;
+	int result;
+
+	/* Compute the actual position in the directory. */
+	KASSERT(slot>=0);
+	actualpos = slot * sizeof(struct sfs_direntry);
+	appending = slot >= sfs_dir_nentries(sv);
+
+	/* Find out what we're replacing, so we can unhash it. */
+	if (dh != NULL && !appending) {
+		result = sfs_readdir(sv, slot, &oldsd);
+		if (result) {
+			return result;
+		}
+		oldsd.sfd_name[sizeof(oldsd.sfd_name)-1] = 0;
+	}
+
+	result = sfs_metaio(sv, actualpos, sd, sizeof(*sd), UIO_WRITE);
+	if (result) {
+		return result;
+	}
+
+	if (dh != NULL) {
+		if (!appending) {
+			sfs_dirhash_remove(dh, slot, &oldsd);
+		}
+		if (sfs_dirhash_add(dh, slot, sd)) {
+			/* Out of memory; do without the hash */
+			sfs_dirhash_destroy(sv);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Search a directory for a particular filename by reading every
+ * entry. This is what sfs_dir_findname does when the directory has
+ * no name hash.
+ */
+static
+int
+sfs_dir_scan(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot)
 {
 	struct sfs_direntry tsd;
@@ -146,6 +442,40 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+/*
+ * Search a directory for a particular filename in a directory, and
+ * return its inode number, its slot, and/or the slot number of an
+ * empty directory slot if one is found.
+ */
+int
+sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+		uint32_t *ino, int *slot, int *emptyslot)
+{
+	struct sfs_dirhash_entry *de;
+
+	if (sv->sv_dirhash == NULL) {
+		if (sfs_dirhash_build(sv)) {
+			return sfs_dir_scan(sv, name, ino, slot, emptyslot);
+		}
+	}
+
+	if (emptyslot != NULL && sv->sv_dirhash->dh_empty != NULL) {
+		*emptyslot = sv->sv_dirhash->dh_empty->de_slot;
+	}
+
+	de = sfs_dirhash_find(sv->sv_dirhash, name);
+	if (de == NULL) {
+		return ENOENT;
+	}
+	if (slot != NULL) {
+		*slot = de->de_slot;
+	}
+	if (ino != NULL) {
+		*ino = de->de_ino;
+	}
+	return 0;
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
@@ -41,6 +41,7 @@
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -106,7 +107,9 @@ sfs_freemapio(struct sfs_fs *sfs, enum uio_rw rw)
 }
 
 /*
- * Sync routine for the vnode table.
+ * Sync routine for the vnode table. This only writes the inodes into
+ * the buffer cache (not VOP_FSYNC, which would force each file's
+ * blocks out one at a time); sfs_sync then writes the whole cache.
  */
 static
 int
@@ -118,7 +121,7 @@ sfs_sync_vnodes(struct sfs_fs *sfs)
 	num = vnodearray_num(sfs->sfs_vnodes);
 	for (i=0; i<num; i++) {
 		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+		sfs_sync_inode(v->vn_data);
 	}
 	return 0;
 }
@@ -143,6 +146,33 @@ sfs_sync_freemap(struct sfs_fs *sfs)
 	return 0;
 }
 
+/*
+ * Write the freemap all the way to disk, not just into the buffer
+ * cache. For fsync, which needs the blocks it's forcing out to be
+ * recorded as allocated.
+ */
+int
+sfs_fsync_freemap(struct sfs_fs *sfs)
+{
+	uint32_t j, freemapblocks;
+	int result;
+
+	result = sfs_sync_freemap(sfs);
+	if (result) {
+		return result;
+	}
+
+	freemapblocks = SFS_FS_FREEMAPBLOCKS(sfs);
+	for (j=0; j<freemapblocks; j++) {
+		result = buffer_syncblock(sfs->sfs_device,
+					 SFS_FREEMAP_START+j);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
 /*
  * Sync routine for the superblock.
  */
@@ -229,6 +259,16 @@ sfs_sync(struct fs *fs)
 		return result;
 	}
 
+	/*
+	 * All of the above only updated the buffer cache. Now write
+	 * back everything dirty in it.
+	 */
+	result = buffer_sync(sfs->sfs_device);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
 	vfs_biglock_release();
 	return 0;
 }
@@ -262,6 +302,9 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
+	if (sfs->sfs_groupfree != NULL) {
+		kfree(sfs->sfs_groupfree);
+	}
 	vnodearray_destroy(sfs->sfs_vnodes);
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
@@ -290,6 +333,12 @@ sfs_unmount(struct fs *fs)
 	KASSERT(sfs->sfs_superdirty == false);
 	KASSERT(sfs->sfs_freemapdirty == false);
 
+	/* Discard the (clean) idle inodes we were keeping around */
+	sfs_icache_flush(sfs);
+
+	/* Throw away our (clean) buffers */
+	buffer_flushdev(sfs->sfs_device);
+
 	/* The vfs layer takes care of the device for us */
 	sfs->sfs_device = NULL;
 
@@ -355,11 +404,17 @@ sfs_fs_create(void)
 	if (sfs->sfs_vnodes == NULL) {
 		goto cleanup_object;
 	}
+	sfs_icache_init(sfs);
 
 	/* freemap */
 	sfs->sfs_freemap = NULL;
 	sfs->sfs_freemapdirty = false;
 
+	/* allocator state */
+	sfs->sfs_groupfree = NULL;
+	sfs->sfs_ngroups = 0;
+	sfs->sfs_allocnext = 0;
+
 	return sfs;
 
 cleanup_object:
@@ -421,6 +476,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	result = sfs_readblock(sfs, SFS_SUPER_BLOCK, &sfs->sfs_sb,
 			       sizeof(sfs->sfs_sb));
 	if (result) {
+		buffer_flushdev(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
 		vfs_biglock_release();
@@ -434,6 +490,18 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 			"(0x%x, should be 0x%x)\n",
 			sfs->sfs_sb.sb_magic,
 			SFS_MAGIC);
+		buffer_flushdev(dev);
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return EINVAL;
+	}
+
+	if (sfs->sfs_sb.sb_version > SFS_VERSION) {
+		kprintf("sfs: Unsupported format revision %u (newest "
+			"known is %u)\n", sfs->sfs_sb.sb_version,
+			SFS_VERSION);
+		buffer_flushdev(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
 		vfs_biglock_release();
@@ -451,6 +519,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	/* Load free block bitmap */
 	sfs->sfs_freemap = bitmap_create(SFS_FS_FREEMAPBITS(sfs));
 	if (sfs->sfs_freemap == NULL) {
+		buffer_flushdev(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
 		vfs_biglock_release();
@@ -458,6 +527,15 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 	}
 	result = sfs_freemapio(sfs, UIO_READ);
 	if (result) {
+		buffer_flushdev(dev);
+		sfs->sfs_device = NULL;
+		sfs_fs_destroy(sfs);
+		vfs_biglock_release();
+		return result;
+	}
+	result = sfs_balloc_init(sfs);
+	if (result) {
+		buffer_flushdev(dev);
 		sfs->sfs_device = NULL;
 		sfs_fs_destroy(sfs);
 		vfs_biglock_release();
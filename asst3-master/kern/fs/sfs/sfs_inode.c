@@ -36,9 +36,221 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <vfs.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Blocks mapped per sfs_bmap_range call when syncing a file */
+#define SFS_SYNC_BATCH  32
+
+
+////////////////////////////////////////////////////////////
+// Inode cache
+
+/*
+ * Every sfs_vnode in memory is on its volume's inode hash, keyed by
+ * inode number. Active ones (with a live struct vnode) are also in
+ * sfs_vnodes. When an inode that still has links is reclaimed, it
+ * isn't freed right away but kept idle, on an LRU list, so that
+ * opening the file again soon doesn't have to reread it (and, for a
+ * directory, rebuild its name hash). Up to SFS_ICACHE_MAX are kept.
+ * An idle inode was synced when it went idle and can't change until
+ * it's reactivated, so discarding one is just a matter of freeing it.
+ *
+ * Everything here is protected by the vfs biglock.
+ */
+
+/* Statistics. */
+static unsigned sfs_icache_hits;	/* found active */
+static unsigned sfs_icache_idlehits;	/* found idle */
+static unsigned sfs_icache_misses;	/* read from disk */
+
+static
+unsigned
+sfs_vnhash_func(uint32_t ino)
+{
+	return ino % SFS_VNHASH_SIZE;
+}
+
+static
+struct sfs_vnode *
+sfs_vnhash_find(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct sfs_vnode *sv;
+
+	for (sv = sfs->sfs_vnhash[sfs_vnhash_func(ino)];
+	     sv != NULL;
+	     sv = sv->sv_hashnext) {
+		if (sv->sv_ino == ino) {
+			return sv;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+sfs_vnhash_insert(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	unsigned h = sfs_vnhash_func(sv->sv_ino);
+
+	sv->sv_hashnext = sfs->sfs_vnhash[h];
+	sfs->sfs_vnhash[h] = sv;
+}
+
+static
+void
+sfs_vnhash_remove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	struct sfs_vnode **svp;
+
+	for (svp = &sfs->sfs_vnhash[sfs_vnhash_func(sv->sv_ino)];
+	     *svp != sv;
+	     svp = &(*svp)->sv_hashnext) {
+		KASSERT(*svp != NULL);
+	}
+	*svp = sv->sv_hashnext;
+	sv->sv_hashnext = NULL;
+}
+
+/*
+ * Add an sfs_vnode to sfs_vnodes. The index is remembered so it can
+ * be taken out again without a search.
+ */
+static
+int
+sfs_vnarray_add(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	return vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn,
+			      &sv->sv_arrayix);
+}
+
+/*
+ * Take an sfs_vnode out of sfs_vnodes, by moving the last one into
+ * its place.
+ */
+static
+void
+sfs_vnarray_remove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	struct vnode *last;
+	unsigned num;
+	int result;
+
+	num = vnodearray_num(sfs->sfs_vnodes);
+	if (sv->sv_arrayix >= num ||
+	    vnodearray_get(sfs->sfs_vnodes, sv->sv_arrayix) !=
+	    &sv->sv_absvn) {
+		panic("sfs: %s: reclaim vnode %u not in vnode pool\n",
+		      sfs->sfs_sb.sb_volname, sv->sv_ino);
+	}
+	last = vnodearray_get(sfs->sfs_vnodes, num - 1);
+	vnodearray_set(sfs->sfs_vnodes, sv->sv_arrayix, last);
+	((struct sfs_vnode *)last->vn_data)->sv_arrayix = sv->sv_arrayix;
+
+	/* shrinking can't fail */
+	result = vnodearray_setsize(sfs->sfs_vnodes, num - 1);
+	KASSERT(result == 0);
+}
+
+static
+void
+sfs_idle_remove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	KASSERT(sv->sv_idle);
+
+	if (sv->sv_idleprev != NULL) {
+		sv->sv_idleprev->sv_idlenext = sv->sv_idlenext;
+	}
+	else {
+		sfs->sfs_idlehead = sv->sv_idlenext;
+	}
+	if (sv->sv_idlenext != NULL) {
+		sv->sv_idlenext->sv_idleprev = sv->sv_idleprev;
+	}
+	else {
+		sfs->sfs_idletail = sv->sv_idleprev;
+	}
+	sv->sv_idleprev = sv->sv_idlenext = NULL;
+	sv->sv_idle = false;
+	sfs->sfs_nidle--;
+}
+
+/*
+ * Free an inode that's been taken out of everything.
+ */
+static
+void
+sfs_vnode_free(struct sfs_vnode *sv)
+{
+	sfs_dirhash_destroy(sv);
+	kfree(sv);
+}
+
+/*
+ * Discard the least recently used idle inode.
+ */
+static
+void
+sfs_idle_evict(struct sfs_fs *sfs)
+{
+	struct sfs_vnode *sv = sfs->sfs_idlehead;
+
+	KASSERT(sv != NULL);
+	sfs_idle_remove(sfs, sv);
+	sfs_vnhash_remove(sfs, sv);
+	sfs_vnode_free(sv);
+}
+
+/*
+ * Set up the inode cache for a new volume.
+ */
+void
+sfs_icache_init(struct sfs_fs *sfs)
+{
+	unsigned i;
+
+	for (i=0; i<SFS_VNHASH_SIZE; i++) {
+		sfs->sfs_vnhash[i] = NULL;
+	}
+	sfs->sfs_idlehead = sfs->sfs_idletail = NULL;
+	sfs->sfs_nidle = 0;
+}
+
+/*
+ * Discard all the idle inodes, for unmount. There must not be any
+ * active ones.
+ */
+void
+sfs_icache_flush(struct sfs_fs *sfs)
+{
+	KASSERT(vnodearray_num(sfs->sfs_vnodes) == 0);
+
+	while (sfs->sfs_idlehead != NULL) {
+		sfs_idle_evict(sfs);
+	}
+}
+
+void
+sfs_icache_printstats(void)
+{
+	unsigned lookups;
+
+	vfs_biglock_acquire();
+	lookups = sfs_icache_hits + sfs_icache_idlehits + sfs_icache_misses;
+	kprintf("SFS inode cache: %u lookups, %u hits on open inodes, "
+		"%u on idle ones, %u misses\n", lookups, sfs_icache_hits,
+		sfs_icache_idlehits, sfs_icache_misses);
+	kprintf("    (%u%% hit rate; up to %u idle inodes kept per "
+		"volume)\n",
+		lookups ?
+		(sfs_icache_hits + sfs_icache_idlehits) * 100 / lookups : 0,
+		SFS_ICACHE_MAX);
+	vfs_biglock_release();
+}
+
+////////////////////////////////////////////////////////////
+// Inode operations
 
 /*
  * Write an on-disk inode structure back out to disk.
@@ -60,6 +272,61 @@ sfs_sync_inode(struct sfs_vnode *sv)
 	return 0;
 }
 
+/*
+ * Force a file to disk: its data blocks, its indirect blocks, its
+ * inode, and the freemap that records those blocks as in use. Other
+ * files' dirty blocks are left for the flusher.
+ */
+int
+sfs_sync_file(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t diskblocks[SFS_SYNC_BATCH];
+	uint32_t fileblock, nblocks, n, i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	result = sfs_sync_inode(sv);
+	if (result) {
+		return result;
+	}
+
+	nblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	for (fileblock = 0; fileblock < nblocks; fileblock += n) {
+		n = nblocks - fileblock;
+		if (n > SFS_SYNC_BATCH) {
+			n = SFS_SYNC_BATCH;
+		}
+		result = sfs_bmap_range(sv, fileblock, n, diskblocks);
+		if (result) {
+			return result;
+		}
+		for (i=0; i<n; i++) {
+			if (diskblocks[i] == 0) {
+				continue;
+			}
+			result = buffer_syncblock(sfs->sfs_device,
+						  diskblocks[i]);
+			if (result) {
+				return result;
+			}
+		}
+	}
+
+	result = sfs_bmap_sync(sv);
+	if (result) {
+		return result;
+	}
+
+	result = buffer_syncblock(sfs->sfs_device, sv->sv_ino);
+	if (result) {
+		return result;
+	}
+
+	return sfs_fsync_freemap(sfs);
+}
+
 /*
  * Called when the vnode refcount (in-memory usage count) hits zero.
  *
@@ -70,7 +337,6 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
 	int result;
 
 	vfs_biglock_acquire();
@@ -109,39 +375,82 @@ sfs_reclaim(struct vnode *v)
 		return result;
 	}
 
+	/* Remove the vnode structure from the table in the struct sfs_fs. */
+	sfs_vnarray_remove(sfs, sv);
+	vnode_cleanup(&sv->sv_absvn);
+
 	/* If there are no on-disk references, discard the inode */
 	if (sv->sv_i.sfi_linkcount==0) {
 		sfs_bfree(sfs, sv->sv_ino);
+		sfs_vnhash_remove(sfs, sv);
+		sfs_vnode_free(sv);
+		vfs_biglock_release();
+		return 0;
 	}
 
-	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
-		}
+	/* Otherwise keep it around in case it's wanted again soon */
+	if (sfs->sfs_nidle >= SFS_ICACHE_MAX) {
+		sfs_idle_evict(sfs);
 	}
-	if (ix == num) {
-		panic("sfs: %s: reclaim vnode %u not in vnode pool\n",
-		      sfs->sfs_sb.sb_volname, sv->sv_ino);
+	sv->sv_idle = true;
+	sv->sv_idleprev = sfs->sfs_idletail;
+	sv->sv_idlenext = NULL;
+	if (sfs->sfs_idletail != NULL) {
+		sfs->sfs_idletail->sv_idlenext = sv;
 	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
-
-	vnode_cleanup(&sv->sv_absvn);
+	else {
+		sfs->sfs_idlehead = sv;
+	}
+	sfs->sfs_idletail = sv;
+	sfs->sfs_nidle++;
 
 	vfs_biglock_release();
 
-	/* Release the storage for the vnode structure itself. */
-	kfree(sv);
-
 	/* Done */
 	return 0;
 }
 
+/*
+ * Set up the abstract vnode for an inode that's just been read in or
+ * is coming back from idle, and add it to sfs_vnodes.
+ */
+static
+int
+sfs_vnode_activate(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	const struct vnode_ops *ops;
+	int result;
+
+	/*
+	 * Choose the function table based on the object type.
+	 */
+	switch (sv->sv_i.sfi_type) {
+	    case SFS_TYPE_FILE:
+		ops = &sfs_fileops;
+		break;
+	    case SFS_TYPE_DIR:
+		ops = &sfs_dirops;
+		break;
+	    default:
+		panic("sfs: %s: loadvnode: Invalid inode type "
+		      "(inode %u, type %u)\n", sfs->sfs_sb.sb_volname,
+		      sv->sv_ino, sv->sv_i.sfi_type);
+	}
+
+	/* Call the common vnode initializer */
+	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
+	if (result) {
+		return result;
+	}
+
+	result = sfs_vnarray_add(sfs, sv);
+	if (result) {
+		vnode_cleanup(&sv->sv_absvn);
+		return result;
+	}
+	return 0;
+}
+
 /*
  * Function to load a inode into memory as a vnode, or dig up one
  * that's already resident.
@@ -150,39 +459,43 @@ int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
 	struct sfs_vnode *sv;
-	const struct vnode_ops *ops;
-	unsigned i, num;
 	int result;
 
-	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
+	KASSERT(vfs_biglock_do_i_hold());
 
+	/* Look in the inode cache */
+	sv = sfs_vnhash_find(sfs, ino);
+	if (sv != NULL) {
 		/* Every inode in memory must be in an allocated block */
 		if (!sfs_bused(sfs, sv->sv_ino)) {
 			panic("sfs: %s: Found inode %u in unallocated block\n",
 			      sfs->sfs_sb.sb_volname, sv->sv_ino);
 		}
 
-		if (sv->sv_ino==ino) {
-			/* Found */
-
-			/* forcetype is only allowed when creating objects */
-			KASSERT(forcetype==SFS_TYPE_INVAL);
+		/* forcetype is only allowed when creating objects */
+		KASSERT(forcetype==SFS_TYPE_INVAL);
 
+		if (!sv->sv_idle) {
+			sfs_icache_hits++;
 			VOP_INCREF(&sv->sv_absvn);
 			*ret = sv;
 			return 0;
 		}
+
+		/* Idle; bring it back to life */
+		result = sfs_vnode_activate(sfs, sv);
+		if (result) {
+			return result;
+		}
+		sfs_idle_remove(sfs, sv);
+		sfs_icache_idlehits++;
+		*ret = sv;
+		return 0;
 	}
 
 	/* Didn't have it loaded; load it */
+	sfs_icache_misses++;
 
 	sv = kmalloc(sizeof(struct sfs_vnode));
 	if (sv==NULL) {
@@ -216,39 +529,23 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		sv->sv_dirty = true;
 	}
 
-	/*
-	 * Choose the function table based on the object type.
-	 */
-	switch (sv->sv_i.sfi_type) {
-	    case SFS_TYPE_FILE:
-		ops = &sfs_fileops;
-		break;
-	    case SFS_TYPE_DIR:
-		ops = &sfs_dirops;
-		break;
-	    default:
-		panic("sfs: %s: loadvnode: Invalid inode type "
-		      "(inode %u, type %u)\n", sfs->sfs_sb.sb_volname,
-		      ino, sv->sv_i.sfi_type);
-	}
-
-	/* Call the common vnode initializer */
-	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
-	if (result) {
-		kfree(sv);
-		return result;
-	}
-
 	/* Set the other fields in our vnode structure */
 	sv->sv_ino = ino;
-
-	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
+	sv->sv_allochint = ino;
+	sv->sv_dirhash = NULL;
+	sv->sv_hashnext = NULL;
+	sv->sv_idle = false;
+	sv->sv_idleprev = sv->sv_idlenext = NULL;
+	sv->sv_resvnext = 0;
+	sv->sv_resvleft = 0;
+
+	/* Set up the struct vnode and add it to our table */
+	result = sfs_vnode_activate(sfs, sv);
 	if (result) {
-		vnode_cleanup(&sv->sv_absvn);
 		kfree(sv);
 		return result;
 	}
+	sfs_vnhash_insert(sfs, sv);
 
 	/* Hand it back */
 	*ret = sv;
@@ -269,7 +566,7 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 	 * number is the block number, so just get a block.)
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, 0, &ino);
 	if (result) {
 		return result;
 	}
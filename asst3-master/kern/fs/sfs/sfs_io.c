@@ -38,97 +38,69 @@
 #include <uio.h>
 #include <vfs.h>
 #include <device.h>
+#include <buf.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/* Blocks mapped per sfs_bmap_range call when prefetching */
+#define SFS_PREFETCH_BATCH  32
+
 ////////////////////////////////////////////////////////////
 //
 // Basic block-level I/O routines
 
 /*
+ * These copy a whole block into or out of the buffer cache. They're
+ * for things that keep their own in-memory copy of a block, like the
+ * superblock, the freemap, and inodes; everything else uses buffers
+ * directly.
+ *
  * Note: sfs_readblock is used to read the superblock
  * early in mount, before sfs is fully (or even mostly)
  * initialized, and so may not use anything from sfs
  * except sfs_device.
  */
 
-/*
- * Read or write a block, retrying I/O errors.
- */
-static
-int
-sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
-{
-	int result;
-	int tries=0;
-
-	KASSERT(vfs_biglock_do_i_hold());
-
-	DEBUG(DB_SFS, "sfs: %s %llu\n",
-	      uio->uio_rw == UIO_READ ? "read" : "write",
-	      uio->uio_offset / SFS_BLOCKSIZE);
-
- retry:
-	result = DEVOP_IO(sfs->sfs_device, uio);
-	if (result == EINVAL) {
-		/*
-		 * This means the sector we requested was out of range,
-		 * or the seek address we gave wasn't sector-aligned,
-		 * or a couple of other things that are our fault.
-		 */
-		panic("sfs: %s: DEVOP_IO returned EINVAL\n",
-		      sfs->sfs_sb.sb_volname);
-	}
-	if (result == EIO) {
-		if (tries == 0) {
-			tries++;
-			kprintf("sfs: %s: block %llu I/O error, retrying\n",
-				sfs->sfs_sb.sb_volname,
-				uio->uio_offset / SFS_BLOCKSIZE);
-			goto retry;
-		}
-		else if (tries < 10) {
-			tries++;
-			goto retry;
-		}
-		else {
-			kprintf("sfs: %s: block %llu I/O error, giving up "
-				"after %d retries\n",
-				sfs->sfs_sb.sb_volname,
-				uio->uio_offset / SFS_BLOCKSIZE, tries);
-		}
-	}
-	return result;
-}
-
 /*
  * Read a block.
  */
 int
 sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 {
-	struct iovec iov;
-	struct uio ku;
+	struct buf *buf;
+	int result;
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
-	SFSUIO(&iov, &ku, data, block, UIO_READ);
-	return sfs_rwblock(sfs, &ku);
+	result = buffer_read(sfs->sfs_device, block, &buf);
+	if (result) {
+		return result;
+	}
+	memcpy(data, buffer_map(buf), len);
+	buffer_release(buf);
+	return 0;
 }
 
 /*
- * Write a block.
+ * Write a block. This only updates the cache; the block goes to disk
+ * when it's evicted or at the next sync.
  */
 int
 sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 {
-	struct iovec iov;
-	struct uio ku;
+	struct buf *buf;
+	int result;
 
 	KASSERT(len == SFS_BLOCKSIZE);
 
-	SFSUIO(&iov, &ku, data, block, UIO_WRITE);
-	return sfs_rwblock(sfs, &ku);
+	result = buffer_get(sfs->sfs_device, block, &buf);
+	if (result) {
+		return result;
+	}
+	memcpy(buffer_map(buf), data, len);
+	buffer_markdirty(buf);
+	buffer_release(buf);
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////
@@ -150,16 +122,8 @@ int
 sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
-	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
-	 */
-	static char iobuf[SFS_BLOCKSIZE];
-
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *buf;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -169,9 +133,6 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
@@ -184,40 +145,34 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Read zeros.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
-	}
-	else {
-		/*
-		 * Read the block.
-		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		return uiomovezeros(len, uio);
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
+	 * Get the block from the buffer cache. We need the old
+	 * contents even if we're writing, so we don't clobber the
+	 * part of the block we aren't writing over.
 	 */
-	result = uiomove(iobuf+skipstart, len, uio);
+	result = buffer_read(sfs->sfs_device, diskblock, &buf);
 	if (result) {
 		return result;
 	}
 
 	/*
-	 * If it was a write, write back the modified block.
+	 * Now perform the requested operation into/out of the buffer.
+	 * If it was a write, the buffer is now dirty, even if uiomove
+	 * failed partway.
 	 */
+	result = uiomove((char *)buffer_map(buf) + skipstart, len, uio);
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
+		buffer_markdirty(buf);
 	}
+	buffer_release(buf);
 
-	return 0;
+	return result;
 }
 
 /*
@@ -228,14 +183,11 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *buf;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
 	bool doalloc = (uio->uio_rw==UIO_WRITE);
-	off_t saveoff;
-	off_t diskoff;
-	off_t saveres;
-	off_t diskres;
 
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -258,29 +210,32 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	}
 
 	/*
-	 * Do the I/O directly to the uio region. Save the uio_offset,
-	 * and substitute one that makes sense to the device.
+	 * Go through the buffer cache, so we see (and leave behind)
+	 * the current contents of the block. When writing we're
+	 * replacing the whole block, so there's no need to read it.
 	 */
-	saveoff = uio->uio_offset;
-	diskoff = diskblock * SFS_BLOCKSIZE;
-	uio->uio_offset = diskoff;
-
-	/*
-	 * Temporarily set the residue to be one block size.
-	 */
-	KASSERT(uio->uio_resid >= SFS_BLOCKSIZE);
-	saveres = uio->uio_resid;
-	diskres = SFS_BLOCKSIZE;
-	uio->uio_resid = diskres;
-
-	result = sfs_rwblock(sfs, uio);
+	if (uio->uio_rw == UIO_READ) {
+		result = buffer_read(sfs->sfs_device, diskblock, &buf);
+	}
+	else {
+		result = buffer_get(sfs->sfs_device, diskblock, &buf);
+	}
+	if (result) {
+		return result;
+	}
 
 	/*
-	 * Now, restore the original uio_offset and uio_resid and update
-	 * them by the amount of I/O done.
+	 * If a write fails partway, only keep it if the buffer already
+	 * held the block. Otherwise it's zeros plus part of the user's
+	 * data, and must not go to disk; releasing it without marking
+	 * it dirty leaves it invalid.
 	 */
-	uio->uio_offset = (uio->uio_offset - diskoff) + saveoff;
-	uio->uio_resid = (uio->uio_resid - diskres) + saveres;
+	result = uiomove(buffer_map(buf), SFS_BLOCKSIZE, uio);
+	if (uio->uio_rw == UIO_WRITE &&
+	    (result == 0 || buffer_isvalid(buf))) {
+		buffer_markdirty(buf);
+	}
+	buffer_release(buf);
 
 	return result;
 }
@@ -319,6 +274,11 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		}
 	}
 
+	/* If writing past EOF, try to get the new blocks in one run */
+	if (uio->uio_rw == UIO_WRITE) {
+		sfs_bmap_reserve(sv, uio->uio_offset, uio->uio_resid);
+	}
+
 	/*
 	 * First, do any leading partial block.
 	 */
@@ -373,6 +333,10 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 
  out:
 
+	if (uio->uio_rw == UIO_WRITE) {
+		sfs_bmap_unreserve(sv);
+	}
+
 	/* If writing and we did anything, adjust file length */
 	if (uio->uio_resid != origresid &&
 	    uio->uio_rw == UIO_WRITE &&
@@ -388,6 +352,174 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	return result;
 }
 
+/*
+ * Copy LEN bytes at SRCPOS of SRC to POS of SV, a block at a time
+ * directly between buffers in the buffer cache. Destination blocks
+ * that are overwritten whole are never read, and where the source
+ * has a hole and the destination has no block, the destination is
+ * left with a hole too. *COPIED gets the amount copied, which is
+ * short at EOF of SRC or if something fails partway.
+ *
+ * SRC and SV may be the same file if the ranges don't overlap; they
+ * can then share a block, but never the same bytes of it.
+ */
+int
+sfs_copy(struct sfs_vnode *sv, off_t pos, struct sfs_vnode *src,
+	 off_t srcpos, size_t len, size_t *copied)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *buf, *srcbuf;
+	daddr_t diskblock, srcblock;
+	uint32_t off, srcoff, amt;
+	size_t done;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT(src->sv_absvn.vn_fs == sv->sv_absvn.vn_fs);
+
+	*copied = 0;
+
+	/* Stop at EOF of the source */
+	if (srcpos >= src->sv_i.sfi_size) {
+		return 0;
+	}
+	if ((off_t)len > src->sv_i.sfi_size - srcpos) {
+		len = src->sv_i.sfi_size - srcpos;
+	}
+
+	/* Get the source coming, and the new blocks in one run if we can */
+	result = sfs_prefetch(src, srcpos, len);
+	if (result) {
+		return result;
+	}
+	sfs_bmap_reserve(sv, pos, len);
+
+	done = 0;
+	while (done < len) {
+		/* Go up to the next block boundary on either side */
+		off = (pos + done) % SFS_BLOCKSIZE;
+		srcoff = (srcpos + done) % SFS_BLOCKSIZE;
+		amt = SFS_BLOCKSIZE - (off > srcoff ? off : srcoff);
+		if (amt > len - done) {
+			amt = len - done;
+		}
+
+		result = sfs_bmap(src, (srcpos + done) / SFS_BLOCKSIZE,
+				  false, &srcblock);
+		if (result) {
+			break;
+		}
+
+		if (srcblock == 0 && amt == SFS_BLOCKSIZE) {
+			/* A whole block of hole; keep it a hole if we can */
+			result = sfs_bmap(sv, (pos + done) / SFS_BLOCKSIZE,
+					  false, &diskblock);
+			if (result) {
+				break;
+			}
+			if (diskblock == 0) {
+				done += amt;
+				continue;
+			}
+		}
+
+		result = sfs_bmap(sv, (pos + done) / SFS_BLOCKSIZE,
+				  true, &diskblock);
+		if (result) {
+			break;
+		}
+
+		/* As in sfs_blockio, don't read a block we replace whole */
+		if (amt == SFS_BLOCKSIZE) {
+			result = buffer_get(sfs->sfs_device, diskblock, &buf);
+		}
+		else {
+			result = buffer_read(sfs->sfs_device, diskblock, &buf);
+		}
+		if (result) {
+			break;
+		}
+
+		if (srcblock == 0) {
+			bzero((char *)buffer_map(buf) + off, amt);
+		}
+		else {
+			result = buffer_read(sfs->sfs_device, srcblock,
+					     &srcbuf);
+			if (result) {
+				buffer_release(buf);
+				break;
+			}
+			memcpy((char *)buffer_map(buf) + off,
+			       (char *)buffer_map(srcbuf) + srcoff, amt);
+			buffer_release(srcbuf);
+		}
+		buffer_markdirty(buf);
+		buffer_release(buf);
+
+		done += amt;
+	}
+
+	sfs_bmap_unreserve(sv);
+
+	/* If we did anything, adjust file length */
+	if (done > 0 && pos + (off_t)done > (off_t)sv->sv_i.sfi_size) {
+		sv->sv_i.sfi_size = pos + done;
+		sv->sv_dirty = true;
+	}
+
+	*copied = done;
+	return result;
+}
+
+/*
+ * Start reading the blocks of a file covering LEN bytes at POS into
+ * the buffer cache, without waiting for them. Blocks past EOF, and
+ * holes, are skipped.
+ */
+int
+sfs_prefetch(struct sfs_vnode *sv, off_t pos, off_t len)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	daddr_t diskblocks[SFS_PREFETCH_BATCH];
+	uint32_t fileblock, lastblock, n, i;
+	off_t size = sv->sv_i.sfi_size;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (pos >= size || len <= 0) {
+		return 0;
+	}
+	if (len > size - pos) {
+		len = size - pos;
+	}
+
+	fileblock = pos / SFS_BLOCKSIZE;
+	lastblock = (pos + len - 1) / SFS_BLOCKSIZE;
+
+	while (fileblock <= lastblock) {
+		n = lastblock - fileblock + 1;
+		if (n > SFS_PREFETCH_BATCH) {
+			n = SFS_PREFETCH_BATCH;
+		}
+
+		result = sfs_bmap_range(sv, fileblock, n, diskblocks);
+		if (result) {
+			return result;
+		}
+		for (i=0; i<n; i++) {
+			if (diskblocks[i] != 0) {
+				buffer_readahead(sfs->sfs_device,
+						 diskblocks[i]);
+			}
+		}
+		fileblock += n;
+	}
+
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////
 // Metadata I/O
 
@@ -407,6 +539,8 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	   enum uio_rw rw)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct buf *buf;
+	char *ioptr;
 	off_t endpos;
 	uint32_t vnblock;
 	uint32_t blockoffset;
@@ -414,18 +548,6 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	bool doalloc;
 	int result;
 
-	/*
-	 * I/O buffer for metadata ops.
-	 *
-	 * Note: in real life (and when you've done the fs assignment) you
-	 * would get space from the disk buffer cache for this, not use a
-	 * static area.
-	 */
-	static char metaiobuf[SFS_BLOCKSIZE];
-
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
-
 	/* Figure out which block of the vnode (directory, whatever) this is */
 	vnblock = actualpos / SFS_BLOCKSIZE;
 	blockoffset = actualpos % SFS_BLOCKSIZE;
@@ -446,26 +568,21 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
-	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
+	/* Get the block */
+	result = buffer_read(sfs->sfs_device, diskblock, &buf);
 	if (result) {
 		return result;
 	}
+	ioptr = buffer_map(buf);
 
 	if (rw == UIO_READ) {
 		/* Copy out the selected region */
-		memcpy(data, metaiobuf + blockoffset, len);
+		memcpy(data, ioptr + blockoffset, len);
 	}
 	else {
 		/* Update the selected region */
-		memcpy(metaiobuf + blockoffset, data, len);
-
-		/* Write the block back */
-		result = sfs_writeblock(sfs, diskblock,
-					metaiobuf, sizeof(metaiobuf));
-		if (result) {
-			return result;
-		}
+		memcpy(ioptr + blockoffset, data, len);
+		buffer_markdirty(buf);
 
 		/* Update the vnode size if needed */
 		endpos = actualpos + len;
@@ -474,6 +591,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 			sv->sv_dirty = true;
 		}
 	}
+	buffer_release(buf);
 
 	/* Done */
 	return 0;
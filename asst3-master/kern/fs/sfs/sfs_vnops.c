@@ -128,6 +128,27 @@ sfs_write(struct vnode *v, struct uio *uio)
 	return result;
 }
 
+/*
+ * Called for write() on files opened with O_APPEND. The size is read
+ * under the same lock sfs_io() runs under, so appends can't overlap.
+ */
+static
+int
+sfs_append(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	KASSERT(uio->uio_rw==UIO_WRITE);
+
+	vfs_biglock_acquire();
+	uio->uio_offset = sv->sv_i.sfi_size;
+	result = sfs_io(sv, uio);
+	vfs_biglock_release();
+
+	return result;
+}
+
 /*
  * Called for ioctl()
  */
@@ -214,8 +235,8 @@ sfs_isseekable(struct vnode *v)
 }
 
 /*
- * Called for fsync(), and also on filesystem unmount, global sync(),
- * and some other cases.
+ * Called for fsync(). Writes the file all the way to disk rather than
+ * leaving it in the buffer cache for the flusher.
  */
 static
 int
@@ -225,7 +246,48 @@ sfs_fsync(struct vnode *v)
 	int result;
 
 	vfs_biglock_acquire();
-	result = sfs_sync_inode(sv);
+	result = sfs_sync_file(sv);
+	vfs_biglock_release();
+
+	return result;
+}
+
+/*
+ * Called for readahead hints. sfs_prefetch() does the work.
+ */
+static
+int
+sfs_readahead(struct vnode *v, off_t pos, off_t len)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	vfs_biglock_acquire();
+	result = sfs_prefetch(sv, pos, len);
+	vfs_biglock_release();
+
+	return result;
+}
+
+/*
+ * Called for copy_file_range(). We can only do it ourselves for
+ * another SFS file on the same volume.
+ */
+static
+int
+sfs_copyrange(struct vnode *v, off_t pos, struct vnode *srcv, off_t srcpos,
+	      size_t len, size_t *copied)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	if (srcv->vn_fs != v->vn_fs || srcv->vn_ops != &sfs_fileops) {
+		*copied = 0;
+		return EXDEV;
+	}
+
+	vfs_biglock_acquire();
+	result = sfs_copy(sv, pos, srcv->vn_data, srcpos, len, copied);
 	vfs_biglock_release();
 
 	return result;
@@ -594,11 +656,15 @@ const struct vnode_ops sfs_fileops = {
 	.vop_readlink = vopfail_uio_notdir,
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = sfs_write,
+	.vop_append = sfs_append,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
 	.vop_fsync = sfs_fsync,
+	.vop_readahead = sfs_readahead,
+	.vop_copyrange = sfs_copyrange,
+	.vop_poll = vopnop_poll,
 	.vop_mmap = sfs_mmap,
 	.vop_truncate = sfs_truncate,
 	.vop_namefile = vopfail_uio_notdir,
@@ -628,11 +694,15 @@ const struct vnode_ops sfs_dirops = {
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_nosys,
 	.vop_write = vopfail_uio_isdir,
+	.vop_append = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
 	.vop_fsync = sfs_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
 	.vop_mmap = vopfail_mmap_isdir,
 	.vop_truncate = vopfail_truncate_isdir,
 	.vop_namefile = sfs_namefile,
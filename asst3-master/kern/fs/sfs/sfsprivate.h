@@ -42,17 +42,33 @@ extern const struct vnode_ops sfs_dirops;
     uio_kinit(iov, uio, ptr, SFS_BLOCKSIZE, ((off_t)(block))*SFS_BLOCKSIZE, rw)
 
 
+/* Blocks per allocation group (see sfs_balloc.c) */
+#define SFS_BALLOC_GROUP  512
+
+/* Most blocks sfs_io reserves ahead for one write */
+#define SFS_RESERVE_MAX   64
+
 /* Functions in sfs_balloc.c */
-int sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock);
+int sfs_balloc_init(struct sfs_fs *sfs);
+int sfs_clearblock(struct sfs_fs *sfs, daddr_t block);
+int sfs_balloc(struct sfs_fs *sfs, daddr_t hint, daddr_t *diskblock);
+int sfs_balloc_run(struct sfs_fs *sfs, daddr_t hint, uint32_t nblocks,
+		daddr_t *start);
 void sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock);
 int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
 
 /* Functions in sfs_bmap.c */
 int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		daddr_t *diskblock);
+int sfs_bmap_range(struct sfs_vnode *sv, uint32_t fileblock,
+		uint32_t nblocks, daddr_t *diskblocks);
+int sfs_bmap_sync(struct sfs_vnode *sv);
+void sfs_bmap_reserve(struct sfs_vnode *sv, off_t pos, size_t len);
+void sfs_bmap_unreserve(struct sfs_vnode *sv);
 int sfs_itrunc(struct sfs_vnode *sv, off_t len);
 
 /* Functions in sfs_dir.c */
+void sfs_dirhash_destroy(struct sfs_vnode *sv);
 int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot);
 int sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino,
@@ -62,13 +78,19 @@ int sfs_lookonce(struct sfs_vnode *sv, const char *name,
 		struct sfs_vnode **ret,
 		int *slot);
 
+/* Functions in sfs_fsops.c */
+int sfs_fsync_freemap(struct sfs_fs *sfs);
+
 /* Functions in sfs_inode.c */
 int sfs_sync_inode(struct sfs_vnode *sv);
+int sfs_sync_file(struct sfs_vnode *sv);
 int sfs_reclaim(struct vnode *v);
 int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		struct sfs_vnode **ret);
 int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
 int sfs_getroot(struct fs *fs, struct vnode **ret);
+void sfs_icache_init(struct sfs_fs *sfs);
+void sfs_icache_flush(struct sfs_fs *sfs);
 
 /* Functions in sfs_io.c */
 int sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
@@ -76,6 +98,9 @@ int sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
 int sfs_io(struct sfs_vnode *sv, struct uio *uio);
 int sfs_metaio(struct sfs_vnode *sv, off_t pos, void *data, size_t len,
 	       enum uio_rw rw);
+int sfs_prefetch(struct sfs_vnode *sv, off_t pos, off_t len);
+int sfs_copy(struct sfs_vnode *sv, off_t pos, struct sfs_vnode *src,
+	     off_t srcpos, size_t len, size_t *copied);
 
 
 #endif /* _SFSPRIVATE_H_ */
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+/*
+ * Header for tmpfs, a file system that keeps everything in memory.
+ *
+ * File data lives in whole pages taken from the frame allocator;
+ * directories are arrays of name/node pairs. Nothing is ever
+ * written anywhere, so the contents vanish at unmount.
+ */
+
+#include <array.h>
+#include <fs.h>
+#include <vnode.h>
+
+struct uio;	/* in uio.h */
+
+#ifndef TMPFS_INLINE
+#define TMPFS_INLINE INLINE
+#endif
+
+/*
+ * Constants
+ */
+
+#define TMPFS_MAXPAGES	256		/* Default size limit, in pages */
+
+/* Node types */
+#define TMPFS_TYPE_FILE	1
+#define TMPFS_TYPE_DIR	2
+
+/*
+ * Directory entry. Each entry holds a vnode reference on the node it
+ * names, so a node's refcount is its link count plus however many
+ * other users it has.
+ */
+struct tmpfs_dirent {
+	char *td_name;				/* Name */
+	struct tmpfs_node *td_node;		/* What it names */
+};
+DECLARRAY(tmpfs_dirent, TMPFS_INLINE);
+
+/*
+ * A file or directory. The vnode lives as long as the node does;
+ * VOP_RECLAIM is only reached once the last link is gone.
+ */
+struct tmpfs_node {
+	struct vnode tn_absvn;			/* Abstract vnode */
+	struct tmpfs *tn_tmpfs;			/* Back-pointer to fs */
+	unsigned tn_type;			/* TMPFS_TYPE_* */
+	unsigned tn_ino;			/* Inode number, for stat */
+	unsigned tn_nlinks;			/* Directory entries naming us */
+	struct tmpfs_node *tn_prev;		/* List of all nodes */
+	struct tmpfs_node *tn_next;
+
+	/* files */
+	off_t tn_size;				/* File size */
+	vaddr_t *tn_pages;			/* Data pages (0 for holes) */
+	unsigned tn_maxpages;			/* Size of tn_pages */
+
+	/* directories */
+	struct tmpfs_node *tn_parent;		/* Parent, NULL once removed */
+	struct tmpfs_direntarray *tn_dents;	/* Entries; NULL for holes */
+	unsigned tn_ndents;			/* Non-NULL entries */
+};
+
+/*
+ * The structure for one tmpfs instance.
+ */
+struct tmpfs {
+	struct fs tf_absfs;			/* Abstract fs object */
+	struct lock *tf_lock;			/* Lock for everything */
+	struct tmpfs_node *tf_root;		/* Root directory */
+	struct tmpfs_node *tf_nodes;		/* All nodes */
+	unsigned tf_nextino;			/* Next inode number */
+	unsigned tf_usedpages;			/* Data pages allocated */
+	unsigned tf_maxpages;			/* Limit on the above */
+};
+
+/*
+ * Arrays
+ */
+
+DEFARRAY(tmpfs_dirent, TMPFS_INLINE);
+
+
+/*
+ * Functions.
+ */
+
+/* in tmpfs_obj.c */
+void tmpfs_dirent_destroy(struct tmpfs_dirent *);
+struct tmpfs_dirent *tmpfs_dir_find(struct tmpfs_node *dir, const char *name,
+				    unsigned *slot_ret);
+int tmpfs_dir_add(struct tmpfs_node *dir, const char *name,
+		  struct tmpfs_node *node);
+void tmpfs_dir_drop(struct tmpfs_node *dir, unsigned slot);
+void tmpfs_freepages(struct tmpfs_node *file, unsigned firstpage);
+int tmpfs_io(struct tmpfs_node *file, struct uio *uio);
+int tmpfs_truncate_node(struct tmpfs_node *file, off_t len);
+
+/* in tmpfs_vnops.c */
+struct tmpfs_node *tmpfs_node_create(struct tmpfs *, unsigned type);
+void tmpfs_node_destroy(struct tmpfs_node *);
+
+
+#endif /* TMPFS_H */
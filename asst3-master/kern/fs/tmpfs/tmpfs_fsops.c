@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <vfs.h>
+#include <fs.h>
+#include <vnode.h>
+
+#include "tmpfs.h"
+
+////////////////////////////////////////////////////////////
+// fs-level operations
+
+/*
+ * Sync doesn't need to do anything.
+ */
+static
+int
+tmpfs_sync(struct fs *fs)
+{
+	(void)fs;
+	return 0;
+}
+
+/*
+ * There can be any number of tmpfs instances, so we don't have a
+ * volume name; they're known by the device name they were added as.
+ */
+static
+const char *
+tmpfs_getvolname(struct fs *fs)
+{
+	(void)fs;
+	return NULL;
+}
+
+/*
+ * Get the root directory vnode.
+ */
+static
+int
+tmpfs_getroot(struct fs *fs, struct vnode **ret)
+{
+	struct tmpfs *tf = fs->fs_data;
+
+	VOP_INCREF(&tf->tf_root->tn_absvn);
+	*ret = &tf->tf_root->tn_absvn;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// mount and unmount logic
+
+/*
+ * Destructor for struct tmpfs. Throws away every node, and with
+ * them all the file data.
+ */
+static
+void
+tmpfs_destroy(struct tmpfs *tf)
+{
+	struct tmpfs_node *tn;
+
+	lock_acquire(tf->tf_lock);
+	while (tf->tf_nodes != NULL) {
+		tn = tf->tf_nodes;
+
+		/*
+		 * The remaining references belong to directory
+		 * entries (and the root's to us); they all go away
+		 * together, so just collapse the count.
+		 */
+		spinlock_acquire(&tn->tn_absvn.vn_countlock);
+		tn->tn_absvn.vn_refcount = 1;
+		spinlock_release(&tn->tn_absvn.vn_countlock);
+
+		tmpfs_node_destroy(tn);
+	}
+	KASSERT(tf->tf_usedpages == 0);
+	lock_release(tf->tf_lock);
+
+	lock_destroy(tf->tf_lock);
+	kfree(tf);
+}
+
+/*
+ * Unmount routine. Fails if anything other than directory entries
+ * (and our own hold on the root) refers to any node.
+ */
+static
+int
+tmpfs_unmount(struct fs *fs)
+{
+	struct tmpfs *tf = fs->fs_data;
+	struct tmpfs_node *tn;
+	int expected;
+	bool busy;
+
+	lock_acquire(tf->tf_lock);
+	busy = false;
+	for (tn = tf->tf_nodes; tn != NULL && !busy; tn = tn->tn_next) {
+		expected = (int)tn->tn_nlinks + (tn == tf->tf_root ? 1 : 0);
+
+		spinlock_acquire(&tn->tn_absvn.vn_countlock);
+		if (tn->tn_absvn.vn_refcount != expected) {
+			busy = true;
+		}
+		spinlock_release(&tn->tn_absvn.vn_countlock);
+	}
+	lock_release(tf->tf_lock);
+
+	if (busy) {
+		return EBUSY;
+	}
+
+	tmpfs_destroy(tf);
+	return 0;
+}
+
+/*
+ * Operations table.
+ */
+static const struct fs_ops tmpfs_fsops = {
+	.fsop_sync = tmpfs_sync,
+	.fsop_getvolname = tmpfs_getvolname,
+	.fsop_getroot = tmpfs_getroot,
+	.fsop_unmount = tmpfs_unmount,
+};
+
+/*
+ * Constructor for struct tmpfs.
+ */
+static
+struct tmpfs *
+tmpfs_create(unsigned maxpages)
+{
+	struct tmpfs *tf;
+
+	tf = kmalloc(sizeof(*tf));
+	if (tf == NULL) {
+		return NULL;
+	}
+
+	tf->tf_lock = lock_create("tmpfs");
+	if (tf->tf_lock == NULL) {
+		kfree(tf);
+		return NULL;
+	}
+	tf->tf_nodes = NULL;
+	tf->tf_nextino = 1;
+	tf->tf_usedpages = 0;
+	tf->tf_maxpages = maxpages;
+	tf->tf_absfs.fs_data = tf;
+	tf->tf_absfs.fs_ops = &tmpfs_fsops;
+
+	/* the root's initial reference is held by the fs itself */
+	lock_acquire(tf->tf_lock);
+	tf->tf_root = tmpfs_node_create(tf, TMPFS_TYPE_DIR);
+	lock_release(tf->tf_lock);
+	if (tf->tf_root == NULL) {
+		lock_destroy(tf->tf_lock);
+		kfree(tf);
+		return NULL;
+	}
+
+	return tf;
+}
+
+/*
+ * Create a tmpfs and attach it as DEVNAME. There is no device
+ * underneath, so it goes in with vfs_addfs rather than vfs_mount.
+ */
+int
+tmpfs_mount(const char *devname)
+{
+	struct tmpfs *tf;
+	int result;
+
+	tf = tmpfs_create(TMPFS_MAXPAGES);
+	if (tf == NULL) {
+		return ENOMEM;
+	}
+
+	result = vfs_addfs(devname, &tf->tf_absfs);
+	if (result) {
+		tmpfs_destroy(tf);
+		return result;
+	}
+
+	kprintf("vfs: Mounted %s: on tmpfs (%u pages)\n", devname,
+		TMPFS_MAXPAGES);
+	return 0;
+}
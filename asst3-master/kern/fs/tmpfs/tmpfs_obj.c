@@ -0,0 +1,423 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+
+#define TMPFS_INLINE
+#include "tmpfs.h"
+
+////////////////////////////////////////////////////////////
+// directories
+
+/*
+ * Constructor for tmpfs_dirent.
+ */
+static
+struct tmpfs_dirent *
+tmpfs_dirent_create(const char *name, struct tmpfs_node *node)
+{
+	struct tmpfs_dirent *td;
+
+	td = kmalloc(sizeof(*td));
+	if (td == NULL) {
+		return NULL;
+	}
+	td->td_name = kstrdup(name);
+	if (td->td_name == NULL) {
+		kfree(td);
+		return NULL;
+	}
+	td->td_node = node;
+	return td;
+}
+
+/*
+ * Destructor for tmpfs_dirent. Does not touch the node.
+ */
+void
+tmpfs_dirent_destroy(struct tmpfs_dirent *td)
+{
+	kfree(td->td_name);
+	kfree(td);
+}
+
+/*
+ * Find NAME in directory DIR. Returns the entry, or NULL, and if
+ * SLOT_RET isn't NULL, the slot it was found in.
+ */
+struct tmpfs_dirent *
+tmpfs_dir_find(struct tmpfs_node *dir, const char *name, unsigned *slot_ret)
+{
+	struct tmpfs_dirent *td;
+	unsigned i, num;
+
+	KASSERT(dir->tn_type == TMPFS_TYPE_DIR);
+	KASSERT(lock_do_i_hold(dir->tn_tmpfs->tf_lock));
+
+	num = tmpfs_direntarray_num(dir->tn_dents);
+	for (i=0; i<num; i++) {
+		td = tmpfs_direntarray_get(dir->tn_dents, i);
+		if (td != NULL && !strcmp(td->td_name, name)) {
+			if (slot_ret != NULL) {
+				*slot_ret = i;
+			}
+			return td;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Add an entry NAME -> NODE to DIR. The entry takes over a vnode
+ * reference the caller must already have provided, and counts as a
+ * link. Empty slots are reused so getdirentry positions stay stable.
+ */
+int
+tmpfs_dir_add(struct tmpfs_node *dir, const char *name,
+	      struct tmpfs_node *node)
+{
+	struct tmpfs_dirent *td;
+	unsigned i, num;
+	int result;
+
+	KASSERT(dir->tn_type == TMPFS_TYPE_DIR);
+	KASSERT(lock_do_i_hold(dir->tn_tmpfs->tf_lock));
+
+	td = tmpfs_dirent_create(name, node);
+	if (td == NULL) {
+		return ENOMEM;
+	}
+
+	num = tmpfs_direntarray_num(dir->tn_dents);
+	for (i=0; i<num; i++) {
+		if (tmpfs_direntarray_get(dir->tn_dents, i) == NULL) {
+			tmpfs_direntarray_set(dir->tn_dents, i, td);
+			break;
+		}
+	}
+	if (i == num) {
+		result = tmpfs_direntarray_add(dir->tn_dents, td, NULL);
+		if (result) {
+			tmpfs_dirent_destroy(td);
+			return result;
+		}
+	}
+
+	dir->tn_ndents++;
+	node->tn_nlinks++;
+	return 0;
+}
+
+/*
+ * Remove the entry in SLOT of DIR. The vnode reference the entry
+ * held passes to the caller, who must drop it after releasing the
+ * fs lock.
+ */
+void
+tmpfs_dir_drop(struct tmpfs_node *dir, unsigned slot)
+{
+	struct tmpfs_dirent *td;
+
+	KASSERT(lock_do_i_hold(dir->tn_tmpfs->tf_lock));
+
+	td = tmpfs_direntarray_get(dir->tn_dents, slot);
+	KASSERT(td != NULL);
+	KASSERT(td->td_node->tn_nlinks > 0);
+
+	td->td_node->tn_nlinks--;
+	tmpfs_direntarray_set(dir->tn_dents, slot, NULL);
+	dir->tn_ndents--;
+	tmpfs_dirent_destroy(td);
+}
+
+////////////////////////////////////////////////////////////
+// file data
+
+/*
+ * Make sure the page array of FILE has room for NPAGES pages.
+ */
+static
+int
+tmpfs_growpages(struct tmpfs_node *file, unsigned npages)
+{
+	vaddr_t *newpages;
+	unsigned newmax, i;
+
+	if (npages <= file->tn_maxpages) {
+		return 0;
+	}
+
+	newmax = file->tn_maxpages == 0 ? 4 : file->tn_maxpages;
+	while (newmax < npages) {
+		newmax *= 2;
+	}
+
+	newpages = kmalloc(newmax * sizeof(vaddr_t));
+	if (newpages == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<file->tn_maxpages; i++) {
+		newpages[i] = file->tn_pages[i];
+	}
+	for (; i<newmax; i++) {
+		newpages[i] = 0;
+	}
+
+	if (file->tn_pages != NULL) {
+		kfree(file->tn_pages);
+	}
+	file->tn_pages = newpages;
+	file->tn_maxpages = newmax;
+	return 0;
+}
+
+/*
+ * Make sure the data page at index PAGENUM of FILE (which must
+ * exist) isn't also mapped into some process by uiomovepage, by
+ * giving the file its own copy if it is, so it can be written.
+ */
+static
+int
+tmpfs_unsharepage(struct tmpfs_node *file, unsigned pagenum)
+{
+	vaddr_t oldpage, newpage;
+
+	oldpage = file->tn_pages[pagenum];
+	KASSERT(oldpage != 0);
+	if (kpage_refcount(oldpage) == 1) {
+		return 0;
+	}
+
+	newpage = alloc_kpages(1);
+	if (newpage == 0) {
+		return ENOMEM;
+	}
+	memcpy((void *)newpage, (void *)oldpage, PAGE_SIZE);
+	file->tn_pages[pagenum] = newpage;
+	free_kpages(oldpage);
+	return 0;
+}
+
+/*
+ * Get the data page at index PAGENUM of FILE for writing, allocating
+ * (and zeroing) it if it's a hole.
+ */
+static
+int
+tmpfs_getpage(struct tmpfs_node *file, unsigned pagenum, vaddr_t *ret)
+{
+	struct tmpfs *tf = file->tn_tmpfs;
+	vaddr_t page;
+	int result;
+
+	result = tmpfs_growpages(file, pagenum + 1);
+	if (result) {
+		return result;
+	}
+
+	page = file->tn_pages[pagenum];
+	if (page == 0) {
+		if (tf->tf_usedpages >= tf->tf_maxpages) {
+			return ENOSPC;
+		}
+		page = alloc_kpages(1);
+		if (page == 0) {
+			return ENOMEM;
+		}
+		bzero((void *)page, PAGE_SIZE);
+		file->tn_pages[pagenum] = page;
+		tf->tf_usedpages++;
+	}
+	else {
+		result = tmpfs_unsharepage(file, pagenum);
+		if (result) {
+			return result;
+		}
+		page = file->tn_pages[pagenum];
+	}
+
+	*ret = page;
+	return 0;
+}
+
+/*
+ * Release every data page of FILE from index FIRSTPAGE onward.
+ */
+void
+tmpfs_freepages(struct tmpfs_node *file, unsigned firstpage)
+{
+	struct tmpfs *tf = file->tn_tmpfs;
+	unsigned i;
+
+	for (i=firstpage; i<file->tn_maxpages; i++) {
+		if (file->tn_pages[i] != 0) {
+			free_kpages(file->tn_pages[i]);
+			file->tn_pages[i] = 0;
+			KASSERT(tf->tf_usedpages > 0);
+			tf->tf_usedpages--;
+		}
+	}
+}
+
+/*
+ * Largest file size we allow: no file can be bigger than the whole
+ * filesystem, which also bounds the page array.
+ */
+static
+off_t
+tmpfs_maxsize(struct tmpfs_node *file)
+{
+	return (off_t)file->tn_tmpfs->tf_maxpages * PAGE_SIZE;
+}
+
+/*
+ * Do I/O on a file. Holes read back as zeros.
+ */
+int
+tmpfs_io(struct tmpfs_node *file, struct uio *uio)
+{
+	vaddr_t page;
+	unsigned pagenum;
+	size_t pageoff, len, origresid;
+	off_t end;
+	int result;
+
+	KASSERT(file->tn_type == TMPFS_TYPE_FILE);
+	KASSERT(lock_do_i_hold(file->tn_tmpfs->tf_lock));
+
+	origresid = uio->uio_resid;
+	end = uio->uio_offset + uio->uio_resid;
+
+	if (uio->uio_rw == UIO_READ) {
+		if (end > file->tn_size) {
+			end = file->tn_size;
+		}
+	}
+	else if (end > tmpfs_maxsize(file)) {
+		if (uio->uio_offset >= tmpfs_maxsize(file)) {
+			return EFBIG;
+		}
+		end = tmpfs_maxsize(file);
+	}
+
+	result = 0;
+	while (uio->uio_offset < end) {
+		pagenum = uio->uio_offset / PAGE_SIZE;
+		pageoff = uio->uio_offset % PAGE_SIZE;
+		len = PAGE_SIZE - pageoff;
+		if ((off_t)len > end - uio->uio_offset) {
+			len = end - uio->uio_offset;
+		}
+
+		if (uio->uio_rw == UIO_READ) {
+			page = pagenum < file->tn_maxpages ?
+				file->tn_pages[pagenum] : 0;
+			if (page == 0) {
+				result = uiomovezeros(len, uio);
+			}
+			else if (pageoff == 0 && len == PAGE_SIZE) {
+				result = uiomovepage((void *)page, len, uio);
+			}
+			else {
+				result = uiomove((char *)page + pageoff,
+						 len, uio);
+			}
+		}
+		else {
+			result = tmpfs_getpage(file, pagenum, &page);
+			if (result) {
+				break;
+			}
+			result = uiomove((char *)page + pageoff, len, uio);
+			if (uio->uio_offset > file->tn_size) {
+				file->tn_size = uio->uio_offset;
+			}
+		}
+		if (result) {
+			break;
+		}
+	}
+
+	/* Running out of space partway through is a short write. */
+	if (result == ENOSPC && uio->uio_resid != origresid) {
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Set the size of a file, releasing pages past the new end and
+ * zeroing the tail of the last one so later growth reads zeros.
+ */
+int
+tmpfs_truncate_node(struct tmpfs_node *file, off_t len)
+{
+	unsigned pagenum;
+	size_t pageoff;
+	bool zerotail;
+	int result;
+
+	KASSERT(file->tn_type == TMPFS_TYPE_FILE);
+	KASSERT(lock_do_i_hold(file->tn_tmpfs->tf_lock));
+
+	if (len < 0) {
+		return EINVAL;
+	}
+	if (len > tmpfs_maxsize(file)) {
+		return EFBIG;
+	}
+
+	if (len < file->tn_size) {
+		pagenum = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+		pageoff = len % PAGE_SIZE;
+		zerotail = pageoff != 0 && pagenum - 1 < file->tn_maxpages &&
+			file->tn_pages[pagenum - 1] != 0;
+
+		/* Do the part that can fail first. */
+		if (zerotail) {
+			result = tmpfs_unsharepage(file, pagenum - 1);
+			if (result) {
+				return result;
+			}
+		}
+
+		tmpfs_freepages(file, pagenum);
+		if (zerotail) {
+			bzero((char *)file->tn_pages[pagenum - 1] + pageoff,
+			      PAGE_SIZE - pageoff);
+		}
+	}
+	file->tn_size = len;
+	return 0;
+}
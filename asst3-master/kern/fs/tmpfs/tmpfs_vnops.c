@@ -0,0 +1,1072 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <stat.h>
+#include <limits.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vfs.h>
+#include <vnode.h>
+
+#include "tmpfs.h"
+
+/*
+ * All operations run under the per-fs lock tf_lock. Since a
+ * directory entry owns a vnode reference, dropping a link can reach
+ * VOP_RECLAIM, which takes tf_lock itself; so anything that removes
+ * an entry hands back the reference and the caller drops it only
+ * after letting go of tf_lock.
+ */
+
+////////////////////////////////////////////////////////////
+// helpers
+
+/*
+ * A directory that has been rmdir'd (but is still referenced, e.g.
+ * as someone's current directory) can't have anything put in it.
+ */
+static
+bool
+tmpfs_isdead(struct tmpfs_node *dir)
+{
+	return dir != dir->tn_tmpfs->tf_root && dir->tn_parent == NULL;
+}
+
+/*
+ * Check a name about to be entered in a directory.
+ */
+static
+int
+tmpfs_checkname(const char *name)
+{
+	if (name[0] == 0 || strchr(name, '/') != NULL) {
+		return EINVAL;
+	}
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EEXIST;
+	}
+	if (strlen(name) > NAME_MAX) {
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+/*
+ * Follow PATH from START. PATH is modified temporarily but restored.
+ */
+static
+int
+tmpfs_walk(struct tmpfs_node *start, char *path, struct tmpfs_node **ret)
+{
+	struct tmpfs_node *node;
+	struct tmpfs_dirent *td;
+	char *next;
+	int result;
+
+	KASSERT(lock_do_i_hold(start->tn_tmpfs->tf_lock));
+
+	node = start;
+	while (*path != 0) {
+		if (*path == '/') {
+			path++;
+			continue;
+		}
+		if (node->tn_type != TMPFS_TYPE_DIR) {
+			return ENOTDIR;
+		}
+
+		next = strchr(path, '/');
+		if (next != NULL) {
+			*next = 0;
+		}
+		result = ENOENT;
+
+		if (strlen(path) > NAME_MAX) {
+			node = NULL;
+			result = ENAMETOOLONG;
+		}
+		else if (!strcmp(path, ".")) {
+			/* stay put */
+		}
+		else if (!strcmp(path, "..")) {
+			if (node != node->tn_tmpfs->tf_root) {
+				/* NULL if the directory has been removed */
+				node = node->tn_parent;
+			}
+		}
+		else {
+			td = tmpfs_dir_find(node, path, NULL);
+			node = td != NULL ? td->td_node : NULL;
+		}
+
+		if (next != NULL) {
+			*next = '/';
+		}
+		if (node == NULL) {
+			return result;
+		}
+
+		if (next == NULL) {
+			break;
+		}
+		path = next + 1;
+	}
+
+	*ret = node;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// basic ops
+
+/*
+ * This is called on *each* open() of a file.
+ */
+static
+int
+tmpfs_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return 0;
+}
+
+/*
+ * This is called on *each* open() of a directory.
+ * Directories may only be open for read.
+ */
+static
+int
+tmpfs_eachopendir(struct vnode *vn, int openflags)
+{
+	(void)vn;
+
+	if ((openflags & O_ACCMODE) != O_RDONLY) {
+		return EISDIR;
+	}
+	if (openflags & O_APPEND) {
+		return EISDIR;
+	}
+	return 0;
+}
+
+static
+int
+tmpfs_read(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_tmpfs;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	lock_acquire(tf->tf_lock);
+	result = tmpfs_io(tn, uio);
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+static
+int
+tmpfs_write(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_tmpfs;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	lock_acquire(tf->tf_lock);
+	result = tmpfs_io(tn, uio);
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * O_APPEND write: the end of file is found under tf_lock, so
+ * concurrent appenders each get their own piece of the file.
+ */
+static
+int
+tmpfs_append(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_tmpfs;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	lock_acquire(tf->tf_lock);
+	uio->uio_offset = tn->tn_size;
+	result = tmpfs_io(tn, uio);
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Directory entries come back one name per call. The offset is the
+ * slot number of the next entry, not a byte position.
+ */
+static
+int
+tmpfs_getdirentry(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *dir = vn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_dirent *td;
+	unsigned pos, num;
+	int result;
+
+	KASSERT(uio->uio_offset >= 0);
+	pos = uio->uio_offset;
+
+	lock_acquire(tf->tf_lock);
+
+	td = NULL;
+	num = tmpfs_direntarray_num(dir->tn_dents);
+	for (; pos < num; pos++) {
+		td = tmpfs_direntarray_get(dir->tn_dents, pos);
+		if (td != NULL) {
+			break;
+		}
+	}
+
+	if (pos >= num) {
+		/* EOF */
+		result = 0;
+	}
+	else {
+		result = uiomove(td->td_name, strlen(td->td_name), uio);
+		uio->uio_offset = pos + 1;
+	}
+
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+static
+int
+tmpfs_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+static
+int
+tmpfs_gettype(struct vnode *vn, mode_t *ret)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+
+	*ret = tn->tn_type == TMPFS_TYPE_DIR ? S_IFDIR : S_IFREG;
+	return 0;
+}
+
+static
+int
+tmpfs_stat(struct vnode *vn, struct stat *buf)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_tmpfs;
+	unsigned i;
+	int result;
+
+	bzero(buf, sizeof(*buf));
+
+	result = VOP_GETTYPE(vn, &buf->st_mode);
+	if (result) {
+		return result;
+	}
+
+	lock_acquire(tf->tf_lock);
+	if (tn->tn_type == TMPFS_TYPE_DIR) {
+		buf->st_size = tn->tn_ndents;
+		buf->st_nlink = 2;
+	}
+	else {
+		buf->st_size = tn->tn_size;
+		buf->st_nlink = tn->tn_nlinks;
+		for (i=0; i<tn->tn_maxpages; i++) {
+			if (tn->tn_pages[i] != 0) {
+				buf->st_blocks++;
+			}
+		}
+	}
+	buf->st_ino = tn->tn_ino;
+	lock_release(tf->tf_lock);
+
+	return 0;
+}
+
+static
+bool
+tmpfs_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return true;
+}
+
+/*
+ * There is nowhere to flush anything to.
+ */
+static
+int
+tmpfs_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return 0;
+}
+
+static
+int
+tmpfs_truncate(struct vnode *vn, off_t len)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_tmpfs;
+	int result;
+
+	lock_acquire(tf->tf_lock);
+	result = tmpfs_truncate_node(tn, len);
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Get the pathname of a directory, relative to the fs root, by
+ * walking up the parent pointers.
+ */
+static
+int
+tmpfs_namefile(struct vnode *vn, struct uio *uio)
+{
+	struct tmpfs_node *dir = vn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_node *node, *parent;
+	struct tmpfs_dirent *td;
+	unsigned i, num;
+	size_t pos, len;
+	char *buf;
+	int result;
+
+	buf = kmalloc(PATH_MAX);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	pos = PATH_MAX;
+
+	lock_acquire(tf->tf_lock);
+
+	result = 0;
+	for (node = dir; node != tf->tf_root; node = parent) {
+		parent = node->tn_parent;
+		if (parent == NULL) {
+			result = ENOENT;
+			break;
+		}
+
+		td = NULL;
+		num = tmpfs_direntarray_num(parent->tn_dents);
+		for (i=0; i<num; i++) {
+			td = tmpfs_direntarray_get(parent->tn_dents, i);
+			if (td != NULL && td->td_node == node) {
+				break;
+			}
+		}
+		KASSERT(i < num);
+
+		len = strlen(td->td_name);
+		if (len + 1 > pos) {
+			result = ENAMETOOLONG;
+			break;
+		}
+		if (pos < PATH_MAX) {
+			buf[--pos] = '/';
+		}
+		pos -= len;
+		memcpy(buf + pos, td->td_name, len);
+	}
+
+	lock_release(tf->tf_lock);
+
+	if (result == 0) {
+		result = uiomove(buf + pos, PATH_MAX - pos, uio);
+	}
+	kfree(buf);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// directory ops
+
+/*
+ * Create a file. If EXCL is set, insist that the filename not already
+ * exist; otherwise, if it already exists, just open it.
+ */
+static
+int
+tmpfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
+	    struct vnode **ret)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_node *tn;
+	struct tmpfs_dirent *td;
+	int result;
+
+	(void)mode;
+
+	lock_acquire(tf->tf_lock);
+
+	if (tmpfs_isdead(dir)) {
+		lock_release(tf->tf_lock);
+		return ENOENT;
+	}
+
+	td = tmpfs_dir_find(dir, name, NULL);
+	if (td != NULL) {
+		if (excl) {
+			lock_release(tf->tf_lock);
+			return EEXIST;
+		}
+		VOP_INCREF(&td->td_node->tn_absvn);
+		*ret = &td->td_node->tn_absvn;
+		lock_release(tf->tf_lock);
+		return 0;
+	}
+
+	result = tmpfs_checkname(name);
+	if (result) {
+		lock_release(tf->tf_lock);
+		return result;
+	}
+
+	tn = tmpfs_node_create(tf, TMPFS_TYPE_FILE);
+	if (tn == NULL) {
+		lock_release(tf->tf_lock);
+		return ENOMEM;
+	}
+
+	/* the new entry takes the reference from vnode_init */
+	result = tmpfs_dir_add(dir, name, tn);
+	if (result) {
+		tmpfs_node_destroy(tn);
+		lock_release(tf->tf_lock);
+		return result;
+	}
+
+	VOP_INCREF(&tn->tn_absvn);
+	*ret = &tn->tn_absvn;
+
+	lock_release(tf->tf_lock);
+	return 0;
+}
+
+/*
+ * Make a directory.
+ */
+static
+int
+tmpfs_mkdir(struct vnode *dirvn, const char *name, mode_t mode)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_node *tn;
+	int result;
+
+	(void)mode;
+
+	lock_acquire(tf->tf_lock);
+
+	if (tmpfs_isdead(dir)) {
+		lock_release(tf->tf_lock);
+		return ENOENT;
+	}
+
+	result = tmpfs_checkname(name);
+	if (result) {
+		lock_release(tf->tf_lock);
+		return result;
+	}
+	if (tmpfs_dir_find(dir, name, NULL) != NULL) {
+		lock_release(tf->tf_lock);
+		return EEXIST;
+	}
+
+	tn = tmpfs_node_create(tf, TMPFS_TYPE_DIR);
+	if (tn == NULL) {
+		lock_release(tf->tf_lock);
+		return ENOMEM;
+	}
+	tn->tn_parent = dir;
+
+	result = tmpfs_dir_add(dir, name, tn);
+	if (result) {
+		tmpfs_node_destroy(tn);
+		lock_release(tf->tf_lock);
+		return result;
+	}
+
+	lock_release(tf->tf_lock);
+	return 0;
+}
+
+/*
+ * Make a hard link to a file.
+ */
+static
+int
+tmpfs_link(struct vnode *dirvn, const char *name, struct vnode *filevn)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs_node *file = filevn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	int result;
+
+	KASSERT(file->tn_tmpfs == tf);
+
+	lock_acquire(tf->tf_lock);
+
+	if (file->tn_type == TMPFS_TYPE_DIR) {
+		lock_release(tf->tf_lock);
+		return EINVAL;
+	}
+	if (tmpfs_isdead(dir) || file->tn_nlinks == 0) {
+		lock_release(tf->tf_lock);
+		return ENOENT;
+	}
+
+	result = tmpfs_checkname(name);
+	if (result) {
+		lock_release(tf->tf_lock);
+		return result;
+	}
+	if (tmpfs_dir_find(dir, name, NULL) != NULL) {
+		lock_release(tf->tf_lock);
+		return EEXIST;
+	}
+
+	/* The caller holds a ref, so this DECREF can't reclaim. */
+	VOP_INCREF(filevn);
+	result = tmpfs_dir_add(dir, name, file);
+	if (result) {
+		VOP_DECREF(filevn);
+	}
+
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Delete a file.
+ */
+static
+int
+tmpfs_remove(struct vnode *dirvn, const char *name)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_dirent *td;
+	struct tmpfs_node *victim;
+	unsigned slot;
+
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return EISDIR;
+	}
+
+	lock_acquire(tf->tf_lock);
+
+	td = tmpfs_dir_find(dir, name, &slot);
+	if (td == NULL) {
+		lock_release(tf->tf_lock);
+		return ENOENT;
+	}
+	victim = td->td_node;
+	if (victim->tn_type == TMPFS_TYPE_DIR) {
+		lock_release(tf->tf_lock);
+		return EISDIR;
+	}
+
+	tmpfs_dir_drop(dir, slot);
+
+	lock_release(tf->tf_lock);
+
+	/* drop the reference the directory entry had */
+	VOP_DECREF(&victim->tn_absvn);
+	return 0;
+}
+
+/*
+ * Delete a directory, which must be empty.
+ */
+static
+int
+tmpfs_rmdir(struct vnode *dirvn, const char *name)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_dirent *td;
+	struct tmpfs_node *victim;
+	unsigned slot;
+
+	if (!strcmp(name, ".")) {
+		return EINVAL;
+	}
+	if (!strcmp(name, "..")) {
+		return ENOTEMPTY;
+	}
+
+	lock_acquire(tf->tf_lock);
+
+	td = tmpfs_dir_find(dir, name, &slot);
+	if (td == NULL) {
+		lock_release(tf->tf_lock);
+		return ENOENT;
+	}
+	victim = td->td_node;
+	if (victim->tn_type != TMPFS_TYPE_DIR) {
+		lock_release(tf->tf_lock);
+		return ENOTDIR;
+	}
+	if (victim->tn_ndents > 0) {
+		lock_release(tf->tf_lock);
+		return ENOTEMPTY;
+	}
+
+	tmpfs_dir_drop(dir, slot);
+	victim->tn_parent = NULL;
+
+	lock_release(tf->tf_lock);
+
+	VOP_DECREF(&victim->tn_absvn);
+	return 0;
+}
+
+/*
+ * Rename NAME1 in DIR1 to NAME2 in DIR2, replacing whatever NAME2
+ * was before.
+ */
+static
+int
+tmpfs_rename(struct vnode *dirvn1, const char *name1,
+	     struct vnode *dirvn2, const char *name2)
+{
+	struct tmpfs_node *dir1 = dirvn1->vn_data;
+	struct tmpfs_node *dir2 = dirvn2->vn_data;
+	struct tmpfs *tf = dir1->tn_tmpfs;
+	struct tmpfs_dirent *src, *dst;
+	struct tmpfs_node *node, *old, *p;
+	unsigned srcslot;
+	int result;
+
+	KASSERT(dir2->tn_tmpfs == tf);
+
+	if (!strcmp(name1, ".") || !strcmp(name1, "..") ||
+	    !strcmp(name2, ".") || !strcmp(name2, "..")) {
+		return EINVAL;
+	}
+
+	lock_acquire(tf->tf_lock);
+
+	if (tmpfs_isdead(dir2)) {
+		result = ENOENT;
+		goto out;
+	}
+
+	src = tmpfs_dir_find(dir1, name1, &srcslot);
+	if (src == NULL) {
+		result = ENOENT;
+		goto out;
+	}
+	node = src->td_node;
+
+	dst = tmpfs_dir_find(dir2, name2, NULL);
+	if (dst != NULL && dst->td_node == node) {
+		/* same file; nothing to do */
+		result = 0;
+		goto out;
+	}
+
+	/* A directory can't be moved underneath itself. */
+	if (node->tn_type == TMPFS_TYPE_DIR) {
+		for (p = dir2; p != NULL; p = p->tn_parent) {
+			if (p == node) {
+				result = EINVAL;
+				goto out;
+			}
+		}
+	}
+
+	old = NULL;
+	if (dst != NULL) {
+		old = dst->td_node;
+		if (node->tn_type == TMPFS_TYPE_DIR) {
+			if (old->tn_type != TMPFS_TYPE_DIR) {
+				result = ENOTDIR;
+				goto out;
+			}
+			if (old->tn_ndents > 0) {
+				result = ENOTEMPTY;
+				goto out;
+			}
+		}
+		else if (old->tn_type == TMPFS_TYPE_DIR) {
+			result = EISDIR;
+			goto out;
+		}
+
+		/* Point the entry at the new node; its ref on OLD is ours. */
+		old->tn_nlinks--;
+		if (old->tn_type == TMPFS_TYPE_DIR) {
+			old->tn_parent = NULL;
+		}
+		dst->td_node = node;
+		node->tn_nlinks++;
+	}
+	else {
+		result = tmpfs_checkname(name2);
+		if (result) {
+			goto out;
+		}
+		result = tmpfs_dir_add(dir2, name2, node);
+		if (result) {
+			goto out;
+		}
+	}
+
+	/* The source entry's reference now belongs to the new entry. */
+	tmpfs_dir_drop(dir1, srcslot);
+	if (node->tn_type == TMPFS_TYPE_DIR) {
+		node->tn_parent = dir2;
+	}
+
+	lock_release(tf->tf_lock);
+
+	if (old != NULL) {
+		VOP_DECREF(&old->tn_absvn);
+	}
+	return 0;
+
+ out:
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Look up a pathname, relative to DIRVN.
+ */
+static
+int
+tmpfs_lookup(struct vnode *dirvn, char *path, struct vnode **ret)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_node *tn;
+	int result;
+
+	lock_acquire(tf->tf_lock);
+	result = tmpfs_walk(dir, path, &tn);
+	if (result == 0) {
+		VOP_INCREF(&tn->tn_absvn);
+		*ret = &tn->tn_absvn;
+	}
+	lock_release(tf->tf_lock);
+	return result;
+}
+
+/*
+ * Look up everything but the last component of PATH, and copy the
+ * last component into NAMEBUF.
+ */
+static
+int
+tmpfs_lookparent(struct vnode *dirvn, char *path, struct vnode **ret,
+		 char *namebuf, size_t bufmax)
+{
+	struct tmpfs_node *dir = dirvn->vn_data;
+	struct tmpfs *tf = dir->tn_tmpfs;
+	struct tmpfs_node *tn;
+	char *name;
+	size_t len;
+	int result;
+
+	/* trailing slashes don't make a new component */
+	len = strlen(path);
+	while (len > 1 && path[len-1] == '/') {
+		path[--len] = 0;
+	}
+
+	lock_acquire(tf->tf_lock);
+
+	name = strrchr(path, '/');
+	if (name == NULL) {
+		tn = dir;
+		name = path;
+		result = 0;
+	}
+	else {
+		*name = 0;
+		result = tmpfs_walk(dir, path, &tn);
+		*name++ = '/';
+	}
+	if (result == 0 && tn->tn_type != TMPFS_TYPE_DIR) {
+		result = ENOTDIR;
+	}
+	if (result == 0 && strlen(name) + 1 > bufmax) {
+		result = ENAMETOOLONG;
+	}
+	if (result) {
+		lock_release(tf->tf_lock);
+		return result;
+	}
+
+	strcpy(namebuf, name);
+	VOP_INCREF(&tn->tn_absvn);
+	*ret = &tn->tn_absvn;
+
+	lock_release(tf->tf_lock);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// vnode lifecycle operations
+
+/*
+ * Reclaim - the last reference is going away. Since every link owns
+ * a reference, the node is unlinked too, so it can be destroyed.
+ */
+static
+int
+tmpfs_reclaim(struct vnode *vn)
+{
+	struct tmpfs_node *tn = vn->vn_data;
+	struct tmpfs *tf = tn->tn_tmpfs;
+
+	lock_acquire(tf->tf_lock);
+
+	/* vnode refcount is protected by the vnode's ->vn_countlock */
+	spinlock_acquire(&vn->vn_countlock);
+	if (vn->vn_refcount > 1) {
+		/* consume the reference VOP_DECREF passed us */
+		vn->vn_refcount--;
+
+		spinlock_release(&vn->vn_countlock);
+		lock_release(tf->tf_lock);
+		return EBUSY;
+	}
+	spinlock_release(&vn->vn_countlock);
+
+	KASSERT(tn->tn_nlinks == 0);
+	KASSERT(tn != tf->tf_root);
+	tmpfs_node_destroy(tn);
+
+	lock_release(tf->tf_lock);
+	return 0;
+}
+
+/*
+ * Vnode ops table for directories.
+ */
+static const struct vnode_ops tmpfs_dirops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = tmpfs_eachopendir,
+	.vop_reclaim = tmpfs_reclaim,
+
+	.vop_read = vopfail_uio_isdir,
+	.vop_readlink = vopfail_uio_isdir,
+	.vop_getdirentry = tmpfs_getdirentry,
+	.vop_write = vopfail_uio_isdir,
+	.vop_append = vopfail_uio_isdir,
+	.vop_ioctl = tmpfs_ioctl,
+	.vop_stat = tmpfs_stat,
+	.vop_gettype = tmpfs_gettype,
+	.vop_isseekable = tmpfs_isseekable,
+	.vop_fsync = tmpfs_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
+	.vop_mmap = vopfail_mmap_isdir,
+	.vop_truncate = vopfail_truncate_isdir,
+	.vop_namefile = tmpfs_namefile,
+
+	.vop_creat = tmpfs_creat,
+	.vop_symlink = vopfail_symlink_nosys,
+	.vop_mkdir = tmpfs_mkdir,
+	.vop_link = tmpfs_link,
+	.vop_remove = tmpfs_remove,
+	.vop_rmdir = tmpfs_rmdir,
+	.vop_rename = tmpfs_rename,
+	.vop_lookup = tmpfs_lookup,
+	.vop_lookparent = tmpfs_lookparent,
+};
+
+/*
+ * Vnode ops table for regular files.
+ */
+static const struct vnode_ops tmpfs_fileops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = tmpfs_eachopen,
+	.vop_reclaim = tmpfs_reclaim,
+
+	.vop_read = tmpfs_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = tmpfs_write,
+	.vop_append = tmpfs_append,
+	.vop_ioctl = tmpfs_ioctl,
+	.vop_stat = tmpfs_stat,
+	.vop_gettype = tmpfs_gettype,
+	.vop_isseekable = tmpfs_isseekable,
+	.vop_fsync = tmpfs_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = vopnop_poll,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = tmpfs_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+/*
+ * Constructor for tmpfs nodes. The vnode comes back with one
+ * reference, normally handed to the directory entry for it.
+ */
+struct tmpfs_node *
+tmpfs_node_create(struct tmpfs *tf, unsigned type)
+{
+	const struct vnode_ops *optable;
+	struct tmpfs_node *tn;
+	int result;
+
+	KASSERT(lock_do_i_hold(tf->tf_lock));
+
+	tn = kmalloc(sizeof(*tn));
+	if (tn == NULL) {
+		return NULL;
+	}
+
+	tn->tn_tmpfs = tf;
+	tn->tn_type = type;
+	tn->tn_nlinks = 0;
+	tn->tn_size = 0;
+	tn->tn_pages = NULL;
+	tn->tn_maxpages = 0;
+	tn->tn_parent = NULL;
+	tn->tn_dents = NULL;
+	tn->tn_ndents = 0;
+
+	if (type == TMPFS_TYPE_DIR) {
+		optable = &tmpfs_dirops;
+		tn->tn_dents = tmpfs_direntarray_create();
+		if (tn->tn_dents == NULL) {
+			kfree(tn);
+			return NULL;
+		}
+	}
+	else {
+		KASSERT(type == TMPFS_TYPE_FILE);
+		optable = &tmpfs_fileops;
+	}
+
+	result = vnode_init(&tn->tn_absvn, optable, &tf->tf_absfs, tn);
+	/* vnode_init doesn't actually fail */
+	KASSERT(result == 0);
+
+	tn->tn_ino = tf->tf_nextino++;
+
+	tn->tn_prev = NULL;
+	tn->tn_next = tf->tf_nodes;
+	if (tf->tf_nodes != NULL) {
+		tf->tf_nodes->tn_prev = tn;
+	}
+	tf->tf_nodes = tn;
+
+	return tn;
+}
+
+/*
+ * Destructor for tmpfs nodes. Releases the data pages; any directory
+ * entries left (only at unmount) are freed without touching the
+ * nodes they name.
+ */
+void
+tmpfs_node_destroy(struct tmpfs_node *tn)
+{
+	struct tmpfs *tf = tn->tn_tmpfs;
+	struct tmpfs_dirent *td;
+	unsigned i, num;
+
+	KASSERT(lock_do_i_hold(tf->tf_lock));
+
+	if (tn->tn_prev != NULL) {
+		tn->tn_prev->tn_next = tn->tn_next;
+	}
+	else {
+		KASSERT(tf->tf_nodes == tn);
+		tf->tf_nodes = tn->tn_next;
+	}
+	if (tn->tn_next != NULL) {
+		tn->tn_next->tn_prev = tn->tn_prev;
+	}
+
+	if (tn->tn_pages != NULL) {
+		tmpfs_freepages(tn, 0);
+		kfree(tn->tn_pages);
+	}
+	if (tn->tn_dents != NULL) {
+		num = tmpfs_direntarray_num(tn->tn_dents);
+		for (i=0; i<num; i++) {
+			td = tmpfs_direntarray_get(tn->tn_dents, i);
+			if (td != NULL) {
+				tmpfs_dirent_destroy(td);
+			}
+		}
+		tmpfs_direntarray_setsize(tn->tn_dents, 0);
+		tmpfs_direntarray_destroy(tn->tn_dents);
+	}
+
+	vnode_cleanup(&tn->tn_absvn);
+	kfree(tn);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BIO_H_
+#define _BIO_H_
+
+#include <uio.h> /* for uio_rw */
+
+/*
+ * Asynchronous block I/O.
+ *
+ * A struct bio describes one transfer between a kernel buffer and a
+ * run of consecutive blocks on a device. The caller fills in the
+ * first group of fields (bio_init does this) and calls bio_submit,
+ * which returns as soon as the I/O has been started. Errors, including
+ * failure to start the I/O at all, are reported only through
+ * bio_result. Completion is reported in one of two ways:
+ *
+ *   - If bio_done is NULL, the caller (or anyone else) collects the
+ *     result with bio_wait, which sleeps until the I/O is finished.
+ *   - Otherwise bio_done is called when the I/O finishes, possibly
+ *     in interrupt context (or before bio_submit even returns), so
+ *     it must not sleep. It may free the bio. Such a bio must not be
+ *     passed to bio_wait.
+ *
+ * bio_iscomplete checks, without sleeping, whether a bio of the first
+ * kind has finished.
+ *
+ * Devices that can do I/O asynchronously provide devop_strategy,
+ * which starts the transfer and arranges for the driver to call
+ * bio_complete later. For other devices bio_submit falls back to
+ * DEVOP_IO and completes the bio before returning.
+ *
+ * bio_submit also keeps, for each device, the number of I/Os in
+ * flight (queue depth) and a histogram of completion latencies;
+ * bio_printstats prints them.
+ */
+
+#define BIO_NHIST	16	/* latency buckets: <2us, <4us, ... */
+#define BIO_MAXDEVS	8	/* devices we keep stats for */
+
+struct device;	/* from <device.h> */
+
+struct bio {
+	/* Filled in by the caller */
+	struct device *bio_dev;		/* device */
+	enum uio_rw bio_rw;		/* read or write */
+	daddr_t bio_block;		/* first block */
+	void *bio_data;			/* kernel buffer */
+	size_t bio_len;			/* bytes; multiple of the block size */
+	void (*bio_done)(struct bio *);	/* completion hook, or NULL */
+	void *bio_arg;			/* for the caller's use */
+
+	/* Filled in on completion */
+	int bio_result;			/* 0 or errno */
+
+	/* Private to bio.c */
+	volatile bool bio_complete;	/* finished? */
+	uint64_t bio_start;		/* submit time, in nsecs */
+	struct bio_devstats *bio_stats;	/* device's stats */
+};
+
+void bio_bootstrap(void);
+
+void bio_init(struct bio *bio, struct device *dev, enum uio_rw rw,
+	      daddr_t block, void *data, size_t len);
+void bio_submit(struct bio *bio);
+int bio_wait(struct bio *bio);
+bool bio_iscomplete(struct bio *bio);
+
+/* Called by drivers when a devop_strategy request finishes */
+void bio_complete(struct bio *bio, int result);
+
+void bio_printstats(void);
+
+
+#endif /* _BIO_H_ */
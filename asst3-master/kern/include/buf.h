@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BUF_H_
+#define _BUF_H_
+
+/*
+ * Block buffer cache.
+ *
+ * Buffers are kept in a single system-wide pool, hashed by (device,
+ * block number) and recycled in least-recently-used order. Each
+ * buffer holds one BUFFER_SIZE block. A buffer obtained from
+ * buffer_read or buffer_get is held (reference counted) until the
+ * caller hands it back with buffer_release; held buffers are never
+ * evicted. Modified buffers are marked with buffer_markdirty and are
+ * written back lazily: by the flusher thread once they have been
+ * dirty for a few seconds or when too much of the cache is dirty,
+ * when they are evicted, or when buffer_sync or buffer_syncblock is
+ * called for them.
+ *
+ * Functions:
+ *    buffer_bootstrap   - initialize; called once at boot.
+ *    buffer_startflusher - start the flusher thread; called once at
+ *                         boot, after the timer is running.
+ *    buffer_read        - get a held buffer for BLOCK on DEV, reading
+ *                         it from disk if it isn't already cached.
+ *    buffer_get         - like buffer_read, but never reads; for use
+ *                         when the caller is about to overwrite the
+ *                         whole block. If the block wasn't cached the
+ *                         buffer comes back zero-filled, and does not
+ *                         become valid until buffer_markdirty. Others
+ *                         looking the block up wait until then, or
+ *                         until the caller releases it unfilled, in
+ *                         which case one of them takes over.
+ *    buffer_map         - return a pointer to the buffer's data.
+ *    buffer_isvalid     - check whether the buffer holds the block's
+ *                         contents, i.e. isn't a buffer_get that
+ *                         hasn't been marked dirty yet.
+ *    buffer_markdirty   - note that the buffer's data has been changed.
+ *    buffer_release     - drop the reference taken by read/get.
+ *    buffer_readahead   - start reading BLOCK on DEV into the cache in
+ *                         the background, if convenient.
+ *    buffer_drop        - discard any cached copy of BLOCK on DEV,
+ *                         without writing it; for blocks being freed.
+ *    buffer_sync        - write back all dirty buffers for DEV.
+ *    buffer_syncblock   - write back BLOCK on DEV, if it's dirty.
+ *    buffer_flushdev    - discard all (clean) buffers for DEV; for
+ *                         unmount, after buffer_sync.
+ *    buffer_setmax      - change the maximum number of buffers.
+ *    buffer_printstats  - print cache statistics.
+ */
+
+#define BUFFER_SIZE		512	/* bytes per buffer */
+#define BUFFER_DEFAULT_MAX	256	/* default max buffers (128K) */
+#define BUFFER_MIN		16	/* smallest allowed max buffers */
+
+struct buf;	/* Opaque. */
+struct device;	/* from <device.h> */
+
+void buffer_bootstrap(void);
+void buffer_startflusher(void);
+
+int buffer_read(struct device *dev, daddr_t block, struct buf **ret);
+int buffer_get(struct device *dev, daddr_t block, struct buf **ret);
+void *buffer_map(struct buf *buf);
+bool buffer_isvalid(struct buf *buf);
+void buffer_markdirty(struct buf *buf);
+void buffer_release(struct buf *buf);
+
+void buffer_readahead(struct device *dev, daddr_t block);
+void buffer_drop(struct device *dev, daddr_t block);
+int buffer_sync(struct device *dev);
+int buffer_syncblock(struct device *dev, daddr_t block);
+void buffer_flushdev(struct device *dev);
+
+int buffer_setmax(unsigned maxbufs);
+void buffer_printstats(void);
+
+
+#endif /* _BUF_H_ */
@@ -38,15 +38,27 @@
 
 
 /*
- * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * hardclock() is called on every CPU from the on-chip timer
+ * interrupt. It does the periodic scheduling work HZ times a second
+ * while the CPU is busy, and fires any expired timeouts. While the
+ * CPU is idle the periodic work is skipped and the timer is only
+ * armed for the next timeout, so idle CPUs are not woken up for
+ * nothing. hardclock_unidle() restarts the periodic tick when an
+ * idle CPU picks up a thread.
+ *
+ * hardclock() is responsible for rearming the timer (and thereby
+ * clearing the interrupt) with mainbus_settimer().
  */
 
 /* hardclocks per second */
 #define HZ  100
 
+/* nanoseconds per hardclock */
+#define HARDCLOCK_NSECS  (1000000000 / HZ)
+
 void hardclock_bootstrap(void);
 void hardclock(void);
+void hardclock_unidle(void);
 
 /*
  * timerclock() is called on one CPU once a second to allow simple
@@ -56,8 +68,41 @@ void timerclock(void);
 
 /*
  * gettime() may be used to fetch the current time of day.
+ * clock_nsecs() returns the same thing as a single 64-bit count of
+ * nanoseconds, which is more convenient for timer arithmetic.
  */
 void gettime(struct timespec *ret);
+uint64_t clock_nsecs(void);
+
+/*
+ * One-shot timeouts with nanosecond resolution.
+ *
+ * timeout() arranges for FUNC(ARG) to be called NSECS nanoseconds
+ * from now. The caller supplies the struct timeout, which must stay
+ * valid until the function has been called or untimeout() succeeds;
+ * it may be reused (including from FUNC) after that. FUNC is called
+ * from the timer interrupt, so it may not sleep; waking a wchan or
+ * doing V() is fine. The pending timeouts are kept in a heap linked
+ * through the struct timeouts themselves, so setting one can't fail
+ * however many there are.
+ *
+ * untimeout() cancels a pending timeout; it returns false if the
+ * timeout already fired or was never set.
+ */
+struct timeout {
+	uint64_t to_when;		/* expiry, in clock_nsecs() time */
+	void (*to_func)(void *);	/* function to call */
+	void *to_arg;			/* argument for it */
+	bool to_pending;		/* in the heap */
+	struct timeout *to_child;	/* heap: first child */
+	struct timeout *to_next;	/* heap: next sibling */
+	struct timeout *to_prev;	/* heap: previous sibling or parent */
+};
+
+void timeout_init(struct timeout *to);
+void timeout(struct timeout *to, void (*func)(void *), void *arg,
+	     uint64_t nsecs);
+bool untimeout(struct timeout *to);
 
 /*
  * arithmetic on times
@@ -76,8 +121,12 @@ void timespec_sub(const struct timespec *t1,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * clock_nanosleep() does the same with nanosecond resolution, using
+ * a timeout.
  */
 void clocksleep(int seconds);
+int clock_nanosleep(uint64_t nsecs);
 
 
 #endif /* _CLOCK_H_ */
@@ -59,7 +59,12 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Exited threads for reuse */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	uint64_t c_nexttick;		/* When the next hardclock is due */
+	bool c_tickless;		/* Periodic tick stopped while idle */
+	unsigned c_switches;		/* Context switches */
+	unsigned c_idles;		/* Times the cpu went idle */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
 	/*
@@ -69,6 +74,10 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+	unsigned c_wakeups;		/* Threads made runnable here */
+	unsigned c_migrations_in;	/* Threads migrated to here */
+	unsigned c_migrations_out;	/* Threads migrated away */
+	unsigned c_runqueue_max;	/* Longest run queue seen */
 
 	/*
 	 * Accessed by other cpus.
@@ -36,6 +36,8 @@
 
 
 struct uio;  /* in <uio.h> */
+struct bio;  /* in <bio.h> */
+struct pollwaiter;  /* in <poll.h> */
 
 /*
  * Filesystem-namespace-accessible device.
@@ -56,11 +58,18 @@ struct device {
  *      devop_eachopen - called on each open call to allow denying the open
  *      devop_io - for both reads and writes (the uio indicates the direction)
  *      devop_ioctl - miscellaneous control operations
+ *      devop_strategy - start an asynchronous block I/O; optional, and
+ *                     only called through bio_submit (see bio.h)
+ *      devop_poll - readiness check for poll(), as for VOP_POLL;
+ *                     optional, and devices without it never block
  */
 struct device_ops {
 	int (*devop_eachopen)(struct device *, int flags_from_open);
 	int (*devop_io)(struct device *, struct uio *);
 	int (*devop_ioctl)(struct device *, int op, userptr_t data);
+	int (*devop_strategy)(struct device *, struct bio *);
+	int (*devop_poll)(struct device *, int events, int *revents,
+			  struct pollwaiter *pw);
 };
 
 /*
@@ -69,6 +78,8 @@ struct device_ops {
 #define DEVOP_EACHOPEN(d, f)	((d)->d_ops->devop_eachopen(d, f))
 #define DEVOP_IO(d, u)		((d)->d_ops->devop_io(d, u))
 #define DEVOP_IOCTL(d, op, p)	((d)->d_ops->devop_ioctl(d, op, p))
+#define DEVOP_STRATEGY(d, b)	((d)->d_ops->devop_strategy(d, b))
+#define DEVOP_POLL(d, e, r, pw)	((d)->d_ops->devop_poll(d, e, r, pw))
 
 
 /* Create vnode for a vfs-level device. */
@@ -79,6 +90,7 @@ void dev_uncreate_vnode(struct vnode *vn);
 
 /* Initialization functions for builtin vfs-level devices. */
 void devnull_create(void);
+void devschedstat_create(void);
 
 /* Function that kicks off device probe and attach. */
 void dev_bootstrap(void);
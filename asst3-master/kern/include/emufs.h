@@ -41,10 +41,18 @@
  * Our structures
  */
 
+struct emufs_page;		/* Opaque; in emu.c */
+
+/* Most file data pages cached per emufs */
+#define EMUFS_CACHEPAGES  64
+
 struct emufs_vnode {
 	struct vnode ev_v;		/* abstract vnode structure */
 	struct emu_softc *ev_emu;	/* device */
 	uint32_t ev_handle;		/* file handle */
+	off_t ev_size;			/* cached file size... */
+	bool ev_sizevalid;		/* ...if this is set */
+	struct emufs_page *ev_pages;	/* cached file data */
 };
 
 struct emufs_fs {
@@ -52,6 +60,9 @@ struct emufs_fs {
 	struct emu_softc *ef_emu;	/* device */
 	struct emufs_vnode *ef_root;	/* root vnode */
 	struct vnodearray *ef_vnodes;	/* table of loaded vnodes */
+	struct emufs_page *ef_lruhead;	/* cached pages, most recent first */
+	struct emufs_page *ef_lrutail;
+	unsigned ef_ncached;		/* number of cached pages */
 };
 
 
@@ -40,13 +40,13 @@
 /*
  * The file table is an array of open files.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * The array starts small (FILETABLE_MINSIZE slots) and doubles as
+ * needed up to OPEN_MAX, so most processes, which only ever have the
+ * three standard descriptors and a few more, don't carry around
+ * OPEN_MAX slots or copy them on every fork. Which slots are in use
+ * is also kept in a bitmap covering all of OPEN_MAX, which is small,
+ * so finding the lowest free descriptor is a search of a few words
+ * rather than of the array.
  *
  * Because we only have single-threaded processes, the file table is
  * never shared and so it doesn't require synchronization. On fork,
@@ -56,9 +56,14 @@
  * read() using the same file handle?
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct openfile **ft_openfiles;	/* ft_size slots */
+	unsigned ft_size;		/* slots allocated */
+	unsigned ft_count;		/* slots in use */
+	struct bitmap *ft_used;		/* which fds are in use */
 };
 
+#define FILETABLE_MINSIZE  16
+
 /*
  * Filetable ops:
  *
@@ -71,7 +76,9 @@ struct filetable {
  *           is not NULL.) Call put with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
- *           previously there.
+ *           previously there. Can fail (ENOMEM) only if the table
+ *           needs to grow to reach the slot, which placing NULL never
+ *           does.
  */
 
 struct filetable *filetable_create(void);
@@ -83,8 +90,8 @@ int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
 
 
 #endif /* _FILETABLE_H_ */
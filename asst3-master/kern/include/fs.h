@@ -87,5 +87,8 @@ struct fs_ops {
 /* Initialization functions for builtin fake file systems. */
 void semfs_bootstrap(void);
 
+/* Create a memory-backed file system and attach it as DEVNAME. */
+int tmpfs_mount(const char *devname);
+
 
 #endif /* _FS_H_ */
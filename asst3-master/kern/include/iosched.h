@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _IOSCHED_H_
+#define _IOSCHED_H_
+
+#include <uio.h> /* for uio_rw */
+
+/*
+ * Disk I/O scheduling.
+ *
+ * A disk driver embeds a struct iosched in its softc and a struct
+ * iosched_req in each of its requests. It hands requests to
+ * iosched_add as they arrive and asks iosched_next which one to start
+ * whenever the disk goes idle. Both must be called with the driver's
+ * lock (the one passed to iosched_init) held.
+ *
+ * The scheduling policy is pluggable and can be changed at any time
+ * by name with iosched_set. The policies are:
+ *
+ *    fifo      - requests are served in arrival order.
+ *    elevator  - C-LOOK: serve requests in increasing sector order
+ *                from the current head position, then sweep back to
+ *                the lowest pending sector. Requests that start right
+ *                where a pending request of the same direction ends
+ *                are merged into it and dispatched along with it. A
+ *                request that has waited past its deadline
+ *                (IOSCHED_READ_EXPIRE or IOSCHED_WRITE_EXPIRE) is
+ *                served first regardless, the most overdue first,
+ *                so nothing starves.
+ *
+ * If iosched_next returns a request whose ir_merged field is not
+ * NULL, the driver should start the request on that chain as soon as
+ * each one finishes, without calling iosched_next in between.
+ */
+
+#define IOSCHED_READ_EXPIRE	500000000ULL	/* 0.5 s, in nsecs */
+#define IOSCHED_WRITE_EXPIRE	5000000000ULL	/* 5 s, in nsecs */
+#define IOSCHED_MAXMERGE	32		/* requests per merged chain */
+
+struct iosched_req {
+	/* Filled in by the driver */
+	uint32_t ir_sector;		/* first sector */
+	uint32_t ir_nsect;		/* number of sectors */
+	enum uio_rw ir_rw;		/* read or write */
+	void *ir_owner;			/* the driver's request */
+
+	/* Private to the scheduler */
+	uint64_t ir_deadline;		/* when it should have started */
+	struct iosched_req *ir_next;	/* queue, in arrival order */
+	struct iosched_req *ir_merged;	/* chain of merged requests */
+	struct iosched_req *ir_mergetail; /* last request on the chain */
+	unsigned ir_nmerged;		/* length of the chain */
+};
+
+struct iosched_ops;
+
+struct iosched {
+	const char *is_name;		/* device name */
+	const struct iosched_ops *is_ops; /* current policy */
+	struct spinlock *is_lock;	/* the driver's lock */
+	struct iosched_req *is_head;	/* pending requests... */
+	struct iosched_req *is_tail;	/* ...in arrival order */
+	uint32_t is_headpos;		/* sector after the last started */
+	unsigned is_queued;		/* number pending (incl. merged) */
+	struct iosched *is_nextsched;	/* list of all schedulers */
+
+	/* Statistics */
+	unsigned is_dispatched;
+	unsigned is_mergecount;
+	unsigned is_expired;
+	unsigned is_maxqueued;
+};
+
+void iosched_init(struct iosched *is, const char *name,
+		  struct spinlock *lock);
+void iosched_add(struct iosched *is, struct iosched_req *ir);
+struct iosched_req *iosched_next(struct iosched *is);
+
+int iosched_set(const char *devname, const char *policy);
+void iosched_printstats(void);
+
+
+#endif /* _IOSCHED_H_ */
@@ -52,6 +52,13 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Arm the current CPU's timer to interrupt (once) NSECS nanoseconds
+ * from now. Rearming also clears a pending timer interrupt. Very
+ * long intervals may be clipped to what the hardware supports.
+ */
+void mainbus_settimer(uint64_t nsecs);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
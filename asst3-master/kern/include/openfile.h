@@ -51,21 +51,34 @@
 struct openfile {
 	struct vnode *of_vnode;
 	int of_accmode;	/* from open: O_RDONLY, O_WRONLY, or O_RDWR */
+	bool of_append;	/* from open: O_APPEND */
 
-	struct lock *of_offsetlock;	/* lock for of_offset */
+	struct lock *of_offsetlock;	/* lock for of_offset and readahead */
 	off_t of_offset;
+	off_t of_ranext;		/* where a sequential read would start */
+	off_t of_rawindow;		/* current readahead window, or 0 */
 
 	struct spinlock of_reflock;	/* lock for of_refcount */
 	int of_refcount;
 };
 
+/* Readahead window bounds, in bytes */
+#define OPENFILE_RAMIN   4096
+#define OPENFILE_RAMAX   65536
+
 /* open a file (args must be kernel pointers; destroys filename) */
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* wrap a vnode we already hold a reference to (consumed on success) */
+int openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
 
+/* note a read of [start, end) and issue readahead if it looks sequential */
+void openfile_readahead(struct openfile *, off_t start, off_t end);
+
 
 #endif /* _OPENFILE_H_ */
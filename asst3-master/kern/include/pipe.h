@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+/*
+ * Pipes.
+ *
+ * A pipe is a one-page ring buffer with two vnodes on it: one for the
+ * read end and one for the write end. Each end goes away when its
+ * vnode's last reference does; reading a pipe with no write end left
+ * gives EOF, and writing one with no read end left fails with EPIPE.
+ * Neither end is seekable. Writes of PIPE_BUF bytes or fewer are
+ * atomic.
+ *
+ *    pipe_create - Make a new pipe. Returns a reference to each end.
+ *    pipe_splice - Move up to LEN bytes from FROM to TO, where exactly
+ *                  one of the two is a pipe end (the read end if it's
+ *                  FROM, the write end if it's TO). The other is read
+ *                  or written directly to or from the pipe's buffer
+ *                  at *POS, which is advanced. Moves at most one
+ *                  bufferful; like read, blocks only if nothing can
+ *                  be moved yet. Returns the amount moved in *MOVED.
+ *                  If APPEND is set, TO is written with VOP_APPEND
+ *                  (for O_APPEND) and *POS comes back as the offset
+ *                  just past what was written.
+ */
+
+struct vnode;
+
+int pipe_create(struct vnode **readret, struct vnode **writeret);
+int pipe_splice(struct vnode *from, struct vnode *to, off_t *pos,
+		bool append, size_t len, size_t *moved);
+
+#endif /* _PIPE_H_ */
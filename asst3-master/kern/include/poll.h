@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * In-kernel support for poll(): readiness notification.
+ *
+ * An object that can block readers or writers (a pipe, the console)
+ * embeds a struct pollhead. VOP_POLL, when handed a pollwaiter,
+ * registers it on the object's pollhead *before* checking whether
+ * the object is ready; whenever the object's state changes in a way
+ * that might make it ready, it calls pollhead_wakeup, which wakes
+ * every registered waiter. Registering first means a change that
+ * happens between the check and the sleep isn't lost.
+ *
+ *    pollhead_init      - Initialize an (empty) pollhead.
+ *    pollhead_cleanup   - Clean one up. Nobody may still be registered.
+ *    pollhead_wakeup    - Wake everyone registered. May be called from
+ *                         an interrupt handler.
+ *
+ *    pollwaiter_init    - Set up a waiter for one poll() call.
+ *    pollwaiter_cleanup - Unregister from everything and clean up.
+ *    pollwaiter_register - Called by VOP_POLL implementations. Does
+ *                         nothing if PW is NULL (a poll that won't
+ *                         sleep, or a rescan after the first pass).
+ *    pollwaiter_reset   - Forget any wakeups so far; call before each
+ *                         scan of the objects.
+ *    pollwaiter_sleep   - Sleep until woken or until the deadline set
+ *                         with pollwaiter_settimeout passes. Returns
+ *                         false if it timed out.
+ */
+
+#include <kern/poll.h>
+#include <spinlock.h>
+#include <clock.h>
+
+struct pollentry;	/* private to poll.c */
+
+struct pollhead {
+	struct spinlock ph_lock;
+	struct pollentry *ph_entries;
+};
+
+struct pollwaiter {
+	struct spinlock pw_lock;
+	struct wchan *pw_wchan;
+	bool pw_woken;			/* something changed */
+	bool pw_timedout;		/* deadline passed */
+	bool pw_timeoutset;		/* pw_timeout is pending or fired */
+	struct timeout pw_timeout;
+	struct pollentry *pw_entries;	/* our registrations */
+};
+
+void pollhead_init(struct pollhead *ph);
+void pollhead_cleanup(struct pollhead *ph);
+void pollhead_wakeup(struct pollhead *ph);
+
+int pollwaiter_init(struct pollwaiter *pw);
+void pollwaiter_cleanup(struct pollwaiter *pw);
+int pollwaiter_register(struct pollwaiter *pw, struct pollhead *ph);
+void pollwaiter_settimeout(struct pollwaiter *pw, uint64_t nsecs);
+void pollwaiter_reset(struct pollwaiter *pw);
+bool pollwaiter_sleep(struct pollwaiter *pw);
+
+#endif /* _POLL_H_ */
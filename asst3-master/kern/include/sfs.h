@@ -48,6 +48,12 @@
  */
 #include <kern/sfs.h>
 
+struct sfs_dirhash;	/* Opaque; in sfs_dir.c */
+
+/* Inode cache parameters */
+#define SFS_VNHASH_SIZE    127	/* buckets in the loaded-inode hash */
+#define SFS_ICACHE_MAX     64	/* idle inodes kept per volume */
+
 /*
  * In-memory inode
  */
@@ -56,6 +62,15 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	daddr_t sv_allochint;           /* last block allocated for us */
+	struct sfs_dirhash *sv_dirhash; /* name hash (dirs), or NULL */
+	struct sfs_vnode *sv_hashnext;  /* inode hash chain */
+	unsigned sv_arrayix;            /* index in sfs_vnodes, if active */
+	bool sv_idle;                   /* reclaimed, kept in the cache */
+	struct sfs_vnode *sv_idleprev;  /* idle LRU list */
+	struct sfs_vnode *sv_idlenext;
+	daddr_t sv_resvnext;            /* next reserved block */
+	uint32_t sv_resvleft;           /* reserved blocks left */
 };
 
 /*
@@ -67,8 +82,15 @@ struct sfs_fs {
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
 	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct sfs_vnode *sfs_vnhash[SFS_VNHASH_SIZE]; /* active and idle */
+	struct sfs_vnode *sfs_idlehead; /* idle inodes, LRU first */
+	struct sfs_vnode *sfs_idletail;
+	unsigned sfs_nidle;
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	uint32_t *sfs_groupfree;        /* free blocks per alloc group */
+	unsigned sfs_ngroups;           /* number of alloc groups */
+	daddr_t sfs_allocnext;          /* next-fit allocation point */
 };
 
 /*
@@ -76,5 +98,10 @@ struct sfs_fs {
  */
 int sfs_mount(const char *device);
 
+/*
+ * Print inode cache statistics (for the kernel menu)
+ */
+void sfs_icache_printstats(void);
+
 
 #endif /* _SFS_H_ */
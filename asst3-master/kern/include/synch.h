@@ -71,13 +71,24 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Locks implement priority inheritance: a thread that blocks on a
+ * lock donates its effective priority to the holder, and onward
+ * along the chain of holders that are themselves blocked, up to
+ * LOCK_PI_MAXDEPTH locks deep. lk_waitprio is an upper bound on the
+ * effective priority of the threads waiting; it is recomputed
+ * exactly each time the lock changes hands.
  */
+#define LOCK_PI_MAXDEPTH 8
+
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        int lk_waitprio;                /* Max priority of waiters */
+        struct lock *lk_nextheld;       /* Next lock held by lk_holder */
 };
 
 struct lock *lock_create(const char *name);
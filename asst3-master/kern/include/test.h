@@ -57,6 +57,7 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int pritest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -90,6 +91,7 @@ int writestress2(int, char **);
 int longstress(int, char **);
 int createstress(int, char **);
 int printfile(int, char **);
+int ioschedbench(int, char **);
 
 /* other tests */
 int kmalloctest(int, char **);
@@ -56,6 +56,17 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Thread priorities. Larger numbers run first. New threads inherit
+ * their creator's base priority; the boot thread, and so everything
+ * else unless set otherwise (e.g. with the menu's "pri" command),
+ * runs at THREAD_PRI_DEFAULT, in which case scheduling is plain
+ * round-robin.
+ */
+#define THREAD_PRI_MIN		0
+#define THREAD_PRI_DEFAULT	50
+#define THREAD_PRI_MAX		100
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -71,6 +82,7 @@ struct thread {
 	 * debugger is messed up.
 	 */
 	char *t_name;			/* Name of this thread */
+	char t_namebuf[24];		/* Storage for t_name if short */
 	const char *t_wchan_name;	/* Name of wait channel, if sleeping */
 	threadstate_t t_state;		/* State this thread is in */
 
@@ -85,6 +97,28 @@ struct thread {
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
+	/*
+	 * Priority fields. t_effpriority is t_priority raised by any
+	 * priority donated by threads waiting for locks we hold (see
+	 * synch.c). Protected by the lock priority spinlock.
+	 */
+	int t_priority;			/* Base priority */
+	int t_effpriority;		/* Effective (inherited) priority */
+	struct lock *t_waitlock;	/* Lock we are blocked on, if any */
+	struct lock *t_heldlocks;	/* Locks we hold (via lk_nextheld) */
+
+	/*
+	 * Scheduling statistics. These are only written by the cpu
+	 * the thread is on and are read without locking, so they may
+	 * be slightly stale when reported.
+	 */
+	unsigned t_volswitches;		/* Switches due to sleep or exit */
+	unsigned t_involswitches;	/* Switches due to yield/preemption */
+	unsigned t_migrations;		/* Times moved to another cpu */
+	unsigned t_runticks;		/* Hardclocks taken while running */
+	struct thread *t_allnext;	/* All-threads list, for reporting */
+	struct thread *t_allprev;
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -145,6 +179,21 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Format per-cpu and per-thread scheduling statistics into BUF, as
+ * text. Output that doesn't fit is truncated. Returns the length of
+ * the text.
+ */
+#define THREAD_STATS_BUFSIZE 8192	/* suggested size for BUF */
+size_t thread_formatstats(char *buf, size_t maxlen);
+
+/*
+ * Set the base priority of the current thread. The effective priority
+ * is recomputed, so this never drops below priority that has been
+ * donated to us by lock waiters.
+ */
+void thread_setpriority(int priority);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
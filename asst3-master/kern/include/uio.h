@@ -123,6 +123,30 @@ int uiomove(void *kbuffer, size_t len, struct uio *uio);
  */
 int uiomovezeros(size_t len, struct uio *uio);
 
+/*
+ * Like uiomove, but moves no data; just advances the uio as if LEN
+ * bytes had been transferred. For when the data was moved some other
+ * way, e.g. directly by a device.
+ */
+void uioskip(size_t len, struct uio *uio);
+
+/*
+ * For a write uio: copy the next LEN bytes of data into KBUFFER
+ * without advancing the uio, so the caller can uioskip past them
+ * only once they have really been written somewhere.
+ */
+int uiopeek(void *kbuffer, size_t len, struct uio *uio);
+
+/*
+ * Like uiomove for one page of data that came from alloc_kpages(1).
+ * When the uio is a read into a page-aligned, page-sized piece of
+ * user memory, the page is mapped there copy-on-write instead of
+ * being copied; otherwise this is just uiomove. Either way the caller
+ * keeps its own reference to the page, but must not write to it
+ * again without first checking kpage_refcount.
+ */
+int uiomovepage(void *kpage, size_t len, struct uio *uio);
+
 /*
  * Initialize a uio suitable for I/O from a kernel buffer.
  *
@@ -144,5 +168,12 @@ void uio_kinit(struct iovec *, struct uio *,
 void uio_uinit(struct iovec *, struct uio *,
 	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * Likewise, for several user buffers at once (readv/writev). The
+ * iovecs must already be filled in; uio_resid is their total length.
+ */
+void uio_uinitv(struct iovec *, unsigned iovcnt, struct uio *,
+		off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
@@ -81,6 +81,28 @@ int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
 
+/*
+ * Name cache (vfsncache.c). Remembers single-component lookups,
+ * including ones that failed with ENOENT.
+ *
+ *    vfs_ncache_lookup     - Look up NAME in DIR. Returns 0 and a
+ *                            reference on a hit, ENOENT for a cached
+ *                            nonexistent name, EAGAIN on a miss.
+ *    vfs_ncache_enter      - Record a lookup result (VN NULL if the
+ *                            name doesn't exist).
+ *    vfs_ncache_invalidate - Forget NAME in DIR. Must be called by
+ *                            anything that creates or destroys a name.
+ *    vfs_ncache_purgefs    - Forget everything on FS (before unmount).
+ */
+
+void vfs_ncache_bootstrap(void);
+int vfs_ncache_lookup(struct vnode *dir, const char *name,
+		      struct vnode **ret);
+void vfs_ncache_enter(struct vnode *dir, const char *name, struct vnode *vn);
+void vfs_ncache_invalidate(struct vnode *dir, const char *name);
+void vfs_ncache_purgefs(struct fs *fs);
+void vfs_ncache_printstats(void);
+
 /*
  * VFS layer high-level operations on pathnames
  * Because lookup may destroy pathnames, these all may too.
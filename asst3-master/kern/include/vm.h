@@ -71,6 +71,13 @@ int vm_fault(int faulttype, vaddr_t faultaddress);
 vaddr_t alloc_kpages(unsigned npages);
 void free_kpages(vaddr_t addr);
 
+/* Share single pages from alloc_kpages(1); free_kpages drops a ref */
+void kpage_incref(vaddr_t addr);
+unsigned kpage_refcount(vaddr_t addr);
+
+/* Map kernel page KPAGE copy-on-write at user address UADDR */
+int vm_sharepage(vaddr_t kpage, vaddr_t uaddr);
+
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
 
@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct pollwaiter;
 
 
 /*
@@ -103,6 +104,14 @@ struct vnode {
  *                      amount written, and updating uio_offset to match.
  *                      Not allowed on directories or symlinks.
  *
+ *    vop_append      - Write data from uio at the end of the file, for
+ *                      O_APPEND. The incoming uio_offset is ignored; the
+ *                      filesystem picks the offset from the file size
+ *                      under the same lock its writes use, so concurrent
+ *                      appends never overlap. On return uio_offset is
+ *                      just past the data written.
+ *                      Not allowed on directories or symlinks.
+ *
  *    vop_ioctl       - Perform ioctl operation OP on file using data
  *                      DATA. The interpretation of the data is specific
  *                      to each ioctl.
@@ -120,6 +129,28 @@ struct vnode {
  *    vop_fsync       - Force any dirty buffers associated with this file
  *                      to stable storage.
  *
+ *    vop_readahead   - Hint that the LEN bytes at offset POS will be read
+ *                      soon. The filesystem may start reading them into
+ *                      its cache in the background, or do nothing.
+ *
+ *    vop_copyrange   - Copy up to LEN bytes at offset SRCPOS of file
+ *                      SRC into this file at offset POS, without the
+ *                      data leaving the filesystem, and hand back the
+ *                      amount copied in *COPIED (less than LEN only at
+ *                      EOF of SRC or on error). Return EXDEV if this
+ *                      filesystem can't do it for SRC; the caller then
+ *                      copies through VOP_READ and VOP_WRITE instead.
+ *                      SRC and this file may be the same file only if
+ *                      the ranges don't overlap.
+ *
+ *    vop_poll        - Check which of the poll() EVENTS (see kern/poll.h)
+ *                      the object is ready for, and return them in
+ *                      *REVENTS, along with POLLERR/POLLHUP as
+ *                      applicable. If PW isn't NULL, first register it
+ *                      with pollwaiter_register (see poll.h) so a later
+ *                      change in readiness wakes it. Objects that never
+ *                      block are always ready.
+ *
  *    vop_mmap        - Map file into memory. If you implement this
  *                      feature, you're responsible for choosing the
  *                      arguments for this operation.
@@ -188,11 +219,18 @@ struct vnode_ops {
 	int (*vop_readlink)(struct vnode *link, struct uio *uio);
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
+	int (*vop_append)(struct vnode *file, struct uio *uio);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
 	int (*vop_fsync)(struct vnode *object);
+	int (*vop_readahead)(struct vnode *file, off_t pos, off_t len);
+	int (*vop_copyrange)(struct vnode *file, off_t pos,
+			     struct vnode *src, off_t srcpos,
+			     size_t len, size_t *copied);
+	int (*vop_poll)(struct vnode *object, int events, int *revents,
+			struct pollwaiter *pw);
 	int (*vop_mmap)(struct vnode *file /* add stuff */);
 	int (*vop_truncate)(struct vnode *file, off_t len);
 	int (*vop_namefile)(struct vnode *file, struct uio *uio);
@@ -232,11 +270,15 @@ struct vnode_ops {
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
 #define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
+#define VOP_APPEND(vn, uio)             (__VOP(vn, append)(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
 #define VOP_FSYNC(vn)                   (__VOP(vn, fsync)(vn))
+#define VOP_READAHEAD(vn, pos, len)     (__VOP(vn, readahead)(vn, pos, len))
+#define VOP_COPYRANGE(vn,pos,sv,sp,l,r) (__VOP(vn,copyrange)(vn,pos,sv,sp,l,r))
+#define VOP_POLL(vn, ev, rev, pw)       (__VOP(vn, poll)(vn, ev, rev, pw))
 #define VOP_MMAP(vn /*add stuff */)     (__VOP(vn, mmap)(vn /*add stuff */))
 #define VOP_TRUNCATE(vn, pos)           (__VOP(vn, truncate)(vn, pos))
 #define VOP_NAMEFILE(vn, uio)           (__VOP(vn, namefile)(vn, uio))
@@ -290,6 +332,12 @@ int vopfail_mmap_isdir(struct vnode *vn /* add stuff */);
 int vopfail_mmap_perm(struct vnode *vn /* add stuff */);
 int vopfail_mmap_nosys(struct vnode *vn /* add stuff */);
 int vopfail_truncate_isdir(struct vnode *vn, off_t pos);
+int vopnop_readahead(struct vnode *vn, off_t pos, off_t len);
+int vopfail_copyrange_xdev(struct vnode *vn, off_t pos,
+			   struct vnode *src, off_t srcpos,
+			   size_t len, size_t *copied);
+int vopnop_poll(struct vnode *vn, int events, int *revents,
+		struct pollwaiter *pw);
 int vopfail_creat_notdir(struct vnode *vn, const char *name, bool excl,
 			 mode_t mode, struct vnode **result);
 int vopfail_symlink_notdir(struct vnode *vn, const char *contents,
@@ -56,6 +56,13 @@ void wchan_destroy(struct wchan *wc);
  */
 bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Return the highest effective priority of the threads sleeping on
+ * the channel, or THREAD_PRI_MIN if there are none. The associated
+ * spinlock should be locked.
+ */
+int wchan_maxpriority(struct wchan *wc, struct spinlock *lk);
+
 /*
  * Go to sleep on a wait channel. The current thread is suspended
  * until awakened by someone else, at which point this function
@@ -70,8 +77,9 @@ void wchan_sleep(struct wchan *wc, struct spinlock *lk);
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
  *
- * The current implementation is FIFO but this is not promised by the
- * interface.
+ * The current implementation wakes threads in order of effective
+ * priority at the time they went to sleep, FIFO among equals, but
+ * this is not promised by the interface.
  */
 void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
@@ -120,6 +120,37 @@ bitmap_alloc(struct bitmap *b, unsigned *index)
         return ENOSPC;
 }
 
+/*
+ * Like bitmap_alloc, but only consider bits from START up to (not
+ * including) END. Whole words of set bits are skipped.
+ */
+int
+bitmap_alloc_range(struct bitmap *b, unsigned start, unsigned end,
+                   unsigned *index)
+{
+        unsigned bit;
+        WORD_TYPE mask;
+
+        if (end > b->nbits) {
+                end = b->nbits;
+        }
+        for (bit = start; bit < end; bit++) {
+                if (bit % BITS_PER_WORD == 0 &&
+                    b->v[bit / BITS_PER_WORD] == WORD_ALLBITS) {
+                        /* (the loop increment takes the last step) */
+                        bit += BITS_PER_WORD - 1;
+                        continue;
+                }
+                mask = ((WORD_TYPE)1) << (bit % BITS_PER_WORD);
+                if ((b->v[bit / BITS_PER_WORD] & mask) == 0) {
+                        b->v[bit / BITS_PER_WORD] |= mask;
+                        *index = bit;
+                        return 0;
+                }
+        }
+        return ENOSPC;
+}
+
 static
 inline
 void
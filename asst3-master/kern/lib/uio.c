@@ -33,6 +33,7 @@
 #include <proc.h>
 #include <current.h>
 #include <copyinout.h>
+#include <vm.h>
 
 /*
  * See uio.h for a description.
@@ -144,6 +145,126 @@ uiomovezeros(size_t n, struct uio *uio)
 	return 0;
 }
 
+void
+uioskip(size_t n, struct uio *uio)
+{
+	struct iovec *iov;
+	size_t size;
+
+	KASSERT(n <= uio->uio_resid);
+
+	while (n > 0) {
+		iov = uio->uio_iov;
+		size = iov->iov_len;
+
+		if (size == 0) {
+			KASSERT(uio->uio_iovcnt > 1);
+			uio->uio_iov++;
+			uio->uio_iovcnt--;
+			continue;
+		}
+		if (size > n) {
+			size = n;
+		}
+
+		if (uio->uio_segflg == UIO_SYSSPACE) {
+			iov->iov_kbase = ((char *)iov->iov_kbase+size);
+		}
+		else {
+			iov->iov_ubase += size;
+		}
+		iov->iov_len -= size;
+		uio->uio_resid -= size;
+		uio->uio_offset += size;
+		n -= size;
+	}
+}
+
+int
+uiopeek(void *ptr, size_t n, struct uio *uio)
+{
+	struct iovec *iov;
+	unsigned iovcnt;
+	size_t size, skip;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_WRITE);
+	KASSERT(n <= uio->uio_resid);
+	if (uio->uio_segflg==UIO_SYSSPACE) {
+		KASSERT(uio->uio_space == NULL);
+	}
+	else {
+		KASSERT(uio->uio_space == proc_getas());
+	}
+
+	/* Same walk as uiomove, but on our own copies of the cursors */
+	iov = uio->uio_iov;
+	iovcnt = uio->uio_iovcnt;
+	skip = 0;
+	while (n > 0) {
+		size = iov->iov_len - skip;
+		if (size == 0) {
+			KASSERT(iovcnt > 1);
+			iov++;
+			iovcnt--;
+			skip = 0;
+			continue;
+		}
+		if (size > n) {
+			size = n;
+		}
+
+		if (uio->uio_segflg == UIO_SYSSPACE) {
+			memmove(ptr, (char *)iov->iov_kbase + skip, size);
+		}
+		else {
+			result = copyin(iov->iov_ubase + skip, ptr, size);
+			if (result) {
+				return result;
+			}
+		}
+
+		skip += size;
+		ptr = ((char *)ptr + size);
+		n -= size;
+	}
+	return 0;
+}
+
+int
+uiomovepage(void *ptr, size_t n, struct uio *uio)
+{
+	struct iovec *iov;
+	vaddr_t kpage = (vaddr_t)ptr;
+	vaddr_t uaddr;
+
+	if (n != PAGE_SIZE || uio->uio_rw != UIO_READ ||
+	    uio->uio_segflg == UIO_SYSSPACE || uio->uio_resid < PAGE_SIZE ||
+	    (kpage & PAGE_FRAME) != kpage) {
+		return uiomove(ptr, n, uio);
+	}
+
+	/* skip empty iovecs so we look at the one the data would go to */
+	while (uio->uio_iov->iov_len == 0 && uio->uio_iovcnt > 1) {
+		uio->uio_iov++;
+		uio->uio_iovcnt--;
+	}
+	iov = uio->uio_iov;
+	uaddr = (vaddr_t)iov->iov_ubase;
+
+	if (iov->iov_len < PAGE_SIZE || (uaddr & PAGE_FRAME) != uaddr) {
+		return uiomove(ptr, n, uio);
+	}
+
+	KASSERT(uio->uio_space == proc_getas());
+	if (vm_sharepage(kpage, uaddr) != 0) {
+		/* not somewhere we can map it; copy the slow way */
+		return uiomove(ptr, n, uio);
+	}
+	uioskip(PAGE_SIZE, uio);
+	return 0;
+}
+
 /*
  * Convenience function to initialize an iovec and uio for kernel I/O.
  */
@@ -184,3 +305,30 @@ uio_uinit(struct iovec *iov, struct uio *u,
 	u->uio_rw = rw;
 	u->uio_space = proc_getas();
 }
+
+/*
+ * Set up a uio for a userspace transfer over an array of iovecs that
+ * already point to user memory. The caller is responsible for making
+ * sure the lengths don't add up to more than a size_t can hold.
+ */
+
+void
+uio_uinitv(struct iovec *iov, unsigned iovcnt, struct uio *u,
+	   off_t offset, enum uio_rw rw)
+{
+	unsigned i;
+
+	DEBUGASSERT(iov != NULL || iovcnt == 0);
+	DEBUGASSERT(u != NULL);
+
+	u->uio_iov = iov;
+	u->uio_iovcnt = iovcnt;
+	u->uio_offset = offset;
+	u->uio_resid = 0;
+	for (i=0; i<iovcnt; i++) {
+		u->uio_resid += iov[i].iov_len;
+	}
+	u->uio_segflg = UIO_USERSPACE;
+	u->uio_rw = rw;
+	u->uio_space = proc_getas();
+}
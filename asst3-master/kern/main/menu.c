@@ -39,13 +39,19 @@
 #include <mainbus.h>
 #include <synch.h>
 #include <thread.h>
+#include <current.h>
 #include <proc.h>
 #include <vfs.h>
+#include <fs.h>
+#include <iosched.h>
+#include <bio.h>
+#include <buf.h>
 #include <sfs.h>
 #include <pid.h>
 #include <syscall.h>
 #include <test.h>
 #include "opt-sfs.h"
+#include "opt-tmpfs.h"
 #include "opt-net.h"
 
 /*
@@ -245,6 +251,35 @@ cmd_sync(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Command for setting the priority that programs run from the menu
+ * (which inherit the menu thread's priority) start with.
+ */
+static
+int
+cmd_pri(int nargs, char **args)
+{
+	int pri;
+
+	if (nargs == 2) {
+		pri = atoi(args[1]);
+		if (pri < THREAD_PRI_MIN || pri > THREAD_PRI_MAX) {
+			kprintf("pri: priority must be %d to %d\n",
+				THREAD_PRI_MIN, THREAD_PRI_MAX);
+			return EINVAL;
+		}
+		thread_setpriority(pri);
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: pri [priority]\n");
+		return EINVAL;
+	}
+
+	kprintf("Programs will run at priority %d\n",
+		curthread->t_priority);
+	return 0;
+}
+
 /*
  * Command for dropping to the debugger.
  */
@@ -377,6 +412,9 @@ static const struct {
 #if OPT_SFS
 	{ "sfs", sfs_mount },
 #endif
+#if OPT_TMPFS
+	{ "tmpfs", tmpfs_mount },
+#endif
 };
 
 static
@@ -471,6 +509,111 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_schedstats(int nargs, char **args)
+{
+	char *buf;
+
+	(void)nargs;
+	(void)args;
+
+	buf = kmalloc(THREAD_STATS_BUFSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	thread_formatstats(buf, THREAD_STATS_BUFSIZE);
+	kprintf("%s", buf);
+	kfree(buf);
+
+	return 0;
+}
+
+static
+int
+cmd_bufstats(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 2) {
+		result = buffer_setmax(atoi(args[1]));
+		if (result) {
+			kprintf("bc: minimum is %u buffers\n", BUFFER_MIN);
+			return result;
+		}
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: bc [maxbuffers]\n");
+		return EINVAL;
+	}
+
+	buffer_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_biostats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	bio_printstats();
+
+	return 0;
+}
+
+static
+int
+cmd_ncachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	vfs_ncache_printstats();
+
+	return 0;
+}
+
+#if OPT_SFS
+static
+int
+cmd_icachestats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	sfs_icache_printstats();
+
+	return 0;
+}
+#endif
+
+static
+int
+cmd_iosched(int nargs, char **args)
+{
+	int result;
+
+	if (nargs == 3) {
+		result = iosched_set(args[1], args[2]);
+		if (result) {
+			kprintf("iosched: %s: %s\n", args[1],
+				strerror(result));
+			return result;
+		}
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: iosched [disk fifo|elevator]\n");
+		return EINVAL;
+	}
+
+	iosched_printstats();
+
+	return 0;
+}
+
 static
 int
 cmd_kheapgeneration(int nargs, char **args)
@@ -539,6 +682,7 @@ static const char *opsmenu[] = {
 	"[cd]      Change directory          ",
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
+	"[pri]     Priority for programs     ",
 	"[debug]   Drop to debugger          ",
 	"[panic]   Intentional panic         ",
 	"[deadlock] Intentional deadlock     ",
@@ -576,6 +720,7 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[pit] Priority inheritance test     ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -584,6 +729,7 @@ static const char *testmenu[] = {
 	"[fs4] FS write stress 2             ",
 	"[fs5] FS long stress                ",
 	"[fs6] FS create stress              ",
+	"[iosb] I/O scheduler benchmark      ",
 	NULL
 };
 
@@ -606,6 +752,14 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[ss] Scheduler stats                ",
+	"[bc] Buffer cache stats/size        ",
+	"[bio] Block I/O stats               ",
+	"[ncache] Name cache stats           ",
+	"[iosched] Disk scheduler policy     ",
+#if OPT_SFS
+	"[icache] SFS inode cache stats      ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -646,6 +800,7 @@ static struct {
 	{ "cd",		cmd_chdir },
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
+	{ "pri",	cmd_pri },
 	{ "debug",	cmd_debug },
 	{ "panic",	cmd_panic },
 	{ "deadlock",	cmd_deadlock },
@@ -657,6 +812,14 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "ss",         cmd_schedstats },
+	{ "bc",         cmd_bufstats },
+	{ "bio",        cmd_biostats },
+	{ "ncache",     cmd_ncachestats },
+	{ "iosched",    cmd_iosched },
+#if OPT_SFS
+	{ "icache",     cmd_icachestats },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -679,6 +842,7 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "pit",	pritest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -715,6 +879,7 @@ static struct {
 	{ "fs4",	writestress2 },
 	{ "fs5",	longstress },
 	{ "fs6",	createstress },
+	{ "iosb",	ioschedbench },
 
 	{ NULL, NULL }
 };
@@ -35,9 +35,12 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/limits.h>
+#include <kern/poll.h>
+#include <limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
 #include <lib.h>
+#include <stat.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
@@ -46,6 +49,8 @@
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
+#include <pipe.h>
+#include <poll.h>
 #include <filetable.h>
 #include <syscall.h>
 
@@ -105,20 +110,49 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Whether writes to FILE should go through VOP_APPEND: it was opened
+ * with O_APPEND and is a regular file. Other seekable objects (raw
+ * disks) have no end of file to append at, and O_APPEND writes to
+ * them just go at the seek position as always.
+ */
+static
+bool
+openfile_appends(struct openfile *file)
+{
+	mode_t type;
+
+	if (!file->of_append || VOP_GETTYPE(file->of_vnode, &type)) {
+		return false;
+	}
+	return (type & S_IFMT) == S_IFREG;
+}
+
+/*
+ * Common logic for all the read and write calls.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on USERUIO, which
+ * the caller has pointed at the user's buffer(s). Ordinarily the
+ * transfer happens at, and advances, the file's seek position, which
+ * means holding of_offsetlock for the duration. If POSITIONAL is set
+ * (pread and pwrite) the caller has put the offset in the uio, and
+ * the seek position is neither used nor changed; so the lock isn't
+ * needed and concurrent positional I/O on one file doesn't serialize
+ * here.
+ *
+ * Writes to a regular file opened with O_APPEND use VOP_APPEND,
+ * which picks the end of file under the filesystem's own lock. They
+ * don't need of_offsetlock while writing either; the seek position
+ * is just moved to the end afterwards.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
+sys_readwrite(int fd, struct uio *useruio, bool positional,
 	      int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
-	bool locked;
+	bool locked, append;
 	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -127,35 +161,66 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		return result;
 	}
 
-	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
-	if (locked) {
+	if (file->of_accmode == badaccmode) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
+	locked = false;
+	append = false;
+	if (positional) {
+		/* An offset only makes sense on something seekable. */
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return ESPIPE;
+		}
+		if (useruio->uio_offset < 0) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return EINVAL;
+		}
+	}
+	else if (useruio->uio_rw == UIO_WRITE && openfile_appends(file)) {
+		append = true;
+		useruio->uio_offset = 0;
+	}
+	else if (VOP_ISSEEKABLE(file->of_vnode)) {
+		/* Only lock the seek position if we're really using it. */
+		locked = true;
 		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+		useruio->uio_offset = file->of_offset;
 	}
 	else {
-		pos = 0;
-	}
-
-	if (file->of_accmode == badaccmode) {
-		result = EBADF;
-		goto fail;
+		useruio->uio_offset = 0;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
+	pos = useruio->uio_offset;
+	size = useruio->uio_resid;
 
 	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	if (append) {
+		result = VOP_APPEND(file->of_vnode, useruio);
+	}
+	else {
+		result = (useruio->uio_rw == UIO_READ) ?
+			VOP_READ(file->of_vnode, useruio) :
+			VOP_WRITE(file->of_vnode, useruio);
+	}
 	if (result) {
 		goto fail;
 	}
 
+	if (append) {
+		lock_acquire(file->of_offsetlock);
+		file->of_offset = useruio->uio_offset;
+		lock_release(file->of_offsetlock);
+	}
+
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = useruio->uio_offset;
+		if (useruio->uio_rw == UIO_READ) {
+			openfile_readahead(file, pos, useruio->uio_offset);
+		}
 		lock_release(file->of_offsetlock);
 	}
 
@@ -165,7 +230,7 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
-	*retval = size - useruio.uio_resid;
+	*retval = size - useruio->uio_resid;
 
 	return 0;
 
@@ -177,13 +242,73 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for readv and writev: copy in the user's iovec array
+ * and build a uio covering all of it.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt, enum uio_rw rw,
+	       int badaccmode, ssize_t *retval)
+{
+	/* Small arrays go on the stack; IOV_MAX of them would not. */
+	struct iovec smalliov[8];
+	struct iovec *iov;
+	struct uio useruio;
+	size_t total;
+	int i, result;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= (int)(sizeof(smalliov) / sizeof(smalliov[0]))) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(*iov));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(*iov));
+	if (result) {
+		goto out;
+	}
+
+	/* The total must fit in the (signed) return value. */
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (total + iov[i].iov_len < total ||
+		    (ssize_t)(total + iov[i].iov_len) < 0) {
+			result = EINVAL;
+			goto out;
+		}
+		total += iov[i].iov_len;
+	}
+
+	uio_uinitv(iov, iovcnt, &useruio, 0, rw);
+	result = sys_readwrite(fd, &useruio, false, badaccmode, retval);
+
+ out:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_READ);
+	return sys_readwrite(fd, &useruio, false, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +317,480 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, false, O_RDONLY, retval);
+}
+
+/*
+ * pread() - read at an explicit offset; use sys_readwrite
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_READ);
+	return sys_readwrite(fd, &useruio, true, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - write at an explicit offset; use sys_readwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, true, O_RDONLY, retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pipe() - make a pipe and put its two ends in the file table.
+ */
+int
+sys_pipe(userptr_t fdsptr, int *retval)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile, *junk;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		VOP_DECREF(readvn);
+		VOP_DECREF(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		VOP_DECREF(writevn);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		filetable_placeat(ft, NULL, fds[0], &junk);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		filetable_placeat(ft, NULL, fds[1], &junk);
+		filetable_placeat(ft, NULL, fds[0], &junk);
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	*retval = 0;
+	return 0;
+}
+
+/*
+ * splice() - move data between a pipe and another file without
+ * copying it through userspace. The work is in pipe_splice; here we
+ * just check the access modes and supply the seek position of
+ * whichever side has one.
+ */
+int
+sys_splice(int fromfd, int tofd, size_t len, int *retval)
+{
+	struct filetable *ft;
+	struct openfile *from, *to, *seekfile;
+	off_t pos;
+	size_t moved;
+	bool append;
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = filetable_get(ft, fromfd, &from);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, tofd, &to);
+	if (result) {
+		filetable_put(ft, fromfd, from);
+		return result;
+	}
+
+	if (from->of_accmode == O_WRONLY || to->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+
+	/* Pipes aren't seekable, so at most one side is. */
+	if (VOP_ISSEEKABLE(from->of_vnode)) {
+		seekfile = from;
+	}
+	else if (VOP_ISSEEKABLE(to->of_vnode)) {
+		seekfile = to;
+	}
+	else {
+		seekfile = NULL;
+	}
+
+	/*
+	 * As in sys_readwrite, O_APPEND writes go through VOP_APPEND
+	 * and don't hold the seek position while they run.
+	 */
+	append = (seekfile == to && openfile_appends(to));
+
+	if (seekfile != NULL && !append) {
+		lock_acquire(seekfile->of_offsetlock);
+		pos = seekfile->of_offset;
+	}
+	else {
+		pos = 0;
+	}
+
+	result = pipe_splice(from->of_vnode, to->of_vnode, &pos, append,
+			     len, &moved);
+
+	if (append) {
+		if (result == 0) {
+			lock_acquire(to->of_offsetlock);
+			to->of_offset = pos;
+			lock_release(to->of_offsetlock);
+		}
+	}
+	else if (seekfile != NULL) {
+		if (result == 0) {
+			seekfile->of_offset = pos;
+		}
+		lock_release(seekfile->of_offsetlock);
+	}
+
+	if (result == 0) {
+		*retval = moved;
+	}
+
+ out:
+	filetable_put(ft, tofd, to);
+	filetable_put(ft, fromfd, from);
+	return result;
+}
+
+/* copy_file_range() works this much at a time, to bound lock holds */
+#define COPYRANGE_CHUNK		(32*1024)
+/* ...and copies through a buffer this big when it has to */
+#define COPYRANGE_BUFSIZE	4096
+
+/*
+ * The slow way for copy_file_range: read into a kernel buffer and
+ * write it back out. Same interface as VOP_COPYRANGE.
+ */
+static
+int
+copyrange_slow(struct vnode *to, off_t topos, struct vnode *from,
+	       off_t frompos, size_t len, char *buf, size_t *copied)
+{
+	struct iovec iov;
+	struct uio ku;
+	size_t amt, got, done;
+	int result;
+
+	result = 0;
+	done = 0;
+	while (done < len) {
+		amt = len - done;
+		if (amt > COPYRANGE_BUFSIZE) {
+			amt = COPYRANGE_BUFSIZE;
+		}
+
+		uio_kinit(&iov, &ku, buf, amt, frompos + done, UIO_READ);
+		result = VOP_READ(from, &ku);
+		got = amt - ku.uio_resid;
+		if (result || got == 0) {
+			break;
+		}
+
+		uio_kinit(&iov, &ku, buf, got, topos + done, UIO_WRITE);
+		result = VOP_WRITE(to, &ku);
+		done += got - ku.uio_resid;
+		if (result || ku.uio_resid > 0 || got < amt) {
+			break;
+		}
+	}
+
+	*copied = done;
+	return result;
+}
+
+/*
+ * copy_file_range() - copy LEN bytes from one file to another inside
+ * the kernel, starting at (and advancing) the seek position of each.
+ * The filesystem gets first go with VOP_COPYRANGE, which for two SFS
+ * files on one volume copies straight between buffer cache blocks;
+ * if it can't (EXDEV) we read and write through a kernel buffer.
+ * Returns the amount copied, which is short only at EOF of the
+ * source or if something failed after some data was copied.
+ */
+int
+sys_copy_file_range(int fromfd, int tofd, size_t len, int *retval)
+{
+	struct filetable *ft;
+	struct openfile *from, *to;
+	struct lock *lock1, *lock2;
+	off_t frompos, topos;
+	size_t amt, moved, done;
+	char *buf;
+	int result;
+
+	/*
+	 * The amount copied must fit in the (signed) return value;
+	 * asking for more just gets a short copy, as at EOF.
+	 */
+	if ((ssize_t)len < 0) {
+		len = (size_t)-1 >> 1;
+	}
+
+	ft = curproc->p_filetable;
+
+	result = filetable_get(ft, fromfd, &from);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, tofd, &to);
+	if (result) {
+		filetable_put(ft, fromfd, from);
+		return result;
+	}
+
+	if (from->of_accmode == O_WRONLY || to->of_accmode == O_RDONLY ||
+	    to->of_append) {
+		result = EBADF;
+		goto out;
+	}
+	if (!VOP_ISSEEKABLE(from->of_vnode) || !VOP_ISSEEKABLE(to->of_vnode)) {
+		/* that's what splice is for */
+		result = ESPIPE;
+		goto out;
+	}
+	if (from == to) {
+		/* one seek position can't be in two places */
+		result = EINVAL;
+		goto out;
+	}
+
+	/* Lock the seek positions in a fixed order. */
+	if (from->of_offsetlock < to->of_offsetlock) {
+		lock1 = from->of_offsetlock;
+		lock2 = to->of_offsetlock;
+	}
+	else {
+		lock1 = to->of_offsetlock;
+		lock2 = from->of_offsetlock;
+	}
+	lock_acquire(lock1);
+	lock_acquire(lock2);
+
+	frompos = from->of_offset;
+	topos = to->of_offset;
+
+	if (from->of_vnode == to->of_vnode &&
+	    frompos < topos + (off_t)len && topos < frompos + (off_t)len) {
+		result = EINVAL;
+		goto unlock;
+	}
+
+	buf = NULL;
+	done = 0;
+	while (done < len) {
+		amt = len - done;
+		if (amt > COPYRANGE_CHUNK) {
+			amt = COPYRANGE_CHUNK;
+		}
+
+		result = VOP_COPYRANGE(to->of_vnode, topos + done,
+				       from->of_vnode, frompos + done,
+				       amt, &moved);
+		if (result == EXDEV) {
+			if (buf == NULL) {
+				buf = kmalloc(COPYRANGE_BUFSIZE);
+				if (buf == NULL) {
+					result = ENOMEM;
+					break;
+				}
+			}
+			result = copyrange_slow(to->of_vnode, topos + done,
+						from->of_vnode, frompos + done,
+						amt, buf, &moved);
+		}
+		done += moved;
+		if (result || moved < amt) {
+			break;
+		}
+	}
+	kfree(buf);
+
+	from->of_offset = frompos + done;
+	to->of_offset = topos + done;
+
+	/* A partial copy counts as success, like a short write. */
+	if (done > 0) {
+		result = 0;
+	}
+	if (result == 0) {
+		*retval = done;
+	}
+
+ unlock:
+	lock_release(lock2);
+	lock_release(lock1);
+ out:
+	filetable_put(ft, tofd, to);
+	filetable_put(ft, fromfd, from);
+	return result;
+}
+
+/*
+ * Check every fd in KFDS once, filling in revents, and return how
+ * many have something to report. If PW isn't NULL, register it with
+ * each object so we get woken if that changes.
+ */
+static
+int
+poll_scan(struct pollfd *kfds, unsigned nfds, struct pollwaiter *pw,
+	  unsigned *nready)
+{
+	struct openfile *file;
+	int revents;
+	unsigned i;
+	int result;
+
+	*nready = 0;
+	for (i=0; i<nfds; i++) {
+		kfds[i].revents = 0;
+		if (kfds[i].fd < 0) {
+			continue;
+		}
+		result = filetable_get(curproc->p_filetable, kfds[i].fd,
+				       &file);
+		if (result) {
+			kfds[i].revents = POLLNVAL;
+			(*nready)++;
+			continue;
+		}
+		result = VOP_POLL(file->of_vnode, kfds[i].events, &revents,
+				  pw);
+		filetable_put(curproc->p_filetable, kfds[i].fd, file);
+		if (result) {
+			return result;
+		}
+		kfds[i].revents = revents;
+		if (revents != 0) {
+			(*nready)++;
+		}
+	}
+	return 0;
+}
+
+/*
+ * poll() - wait for any of several files to be ready.
+ *
+ * The first scan registers with every object; after that we sleep
+ * until one of them reports a change (or the timeout passes) and
+ * scan again without re-registering. TIMEOUTMS is in milliseconds;
+ * 0 means don't wait and negative means wait forever.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeoutms, int *retval)
+{
+	struct pollfd *kfds;
+	struct pollwaiter pw, *regpw;
+	unsigned nready;
+	int result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+
+	kfds = kmalloc((nfds ? nfds : 1) * sizeof(*kfds));
+	if (kfds == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(ufds, kfds, nfds * sizeof(*kfds));
+	if (result) {
+		kfree(kfds);
+		return result;
+	}
+
+	result = pollwaiter_init(&pw);
+	if (result) {
+		kfree(kfds);
+		return result;
+	}
+	if (timeoutms > 0) {
+		pollwaiter_settimeout(&pw, timeoutms * (uint64_t)1000000);
+	}
+
+	regpw = (timeoutms != 0) ? &pw : NULL;
+	while (1) {
+		pollwaiter_reset(&pw);
+		result = poll_scan(kfds, nfds, regpw, &nready);
+		if (result || nready > 0 || timeoutms == 0) {
+			break;
+		}
+		if (!pollwaiter_sleep(&pw)) {
+			/* timed out; one last look */
+			result = poll_scan(kfds, nfds, NULL, &nready);
+			break;
+		}
+		regpw = NULL;
+	}
+
+	pollwaiter_cleanup(&pw);
+	if (result == 0) {
+		result = copyout(kfds, ufds, nfds * sizeof(*kfds));
+	}
+	kfree(kfds);
+	if (result) {
+		return result;
+	}
+	*retval = nready;
+	return 0;
 }
 
 /*
@@ -282,6 +880,10 @@ sys_lseek(int fd, off_t offset, int whence, off_t *retval)
 	/* Success -- update the file structure with the new position. */
 	file->of_offset = *retval;
 
+	/* A seek breaks any sequential run; restart readahead from here. */
+	file->of_ranext = *retval;
+	file->of_rawindow = 0;
+
 	lock_release(file->of_offsetlock);
 	filetable_put(curproc->p_filetable, fd, file);
 
@@ -321,7 +923,11 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	filetable_put(ft, oldfd, oldfdfile);
 
 	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
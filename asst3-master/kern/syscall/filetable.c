@@ -34,49 +34,126 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <bitmap.h>
 #include <openfile.h>
 #include <filetable.h>
 
 
 /*
- * Construct a filetable.
+ * Make sure the table has at least NEEDED slots, doubling it as
+ * needed. The new slots are empty.
+ */
+static
+int
+filetable_grow(struct filetable *ft, unsigned needed)
+{
+	struct openfile **newarray;
+	unsigned newsize, i;
+
+	KASSERT(needed <= OPEN_MAX);
+
+	if (needed <= ft->ft_size) {
+		return 0;
+	}
+
+	newsize = ft->ft_size;
+	while (newsize < needed) {
+		newsize *= 2;
+	}
+	if (newsize > OPEN_MAX) {
+		newsize = OPEN_MAX;
+	}
+
+	newarray = kmalloc(newsize * sizeof(newarray[0]));
+	if (newarray == NULL) {
+		return ENOMEM;
+	}
+	for (i = 0; i < ft->ft_size; i++) {
+		newarray[i] = ft->ft_openfiles[i];
+	}
+	for (; i < newsize; i++) {
+		newarray[i] = NULL;
+	}
+
+	kfree(ft->ft_openfiles);
+	ft->ft_openfiles = newarray;
+	ft->ft_size = newsize;
+	return 0;
+}
+
+/*
+ * Construct a filetable with room for SIZE descriptors before it has
+ * to grow.
  */
+static
 struct filetable *
-filetable_create(void)
+filetable_create_sized(unsigned size)
 {
 	struct filetable *ft;
-	int fd;
+	unsigned fd;
+
+	KASSERT(size > 0 && size <= OPEN_MAX);
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
 
+	ft->ft_openfiles = kmalloc(size * sizeof(ft->ft_openfiles[0]));
+	if (ft->ft_openfiles == NULL) {
+		kfree(ft);
+		return NULL;
+	}
+
+	ft->ft_used = bitmap_create(OPEN_MAX);
+	if (ft->ft_used == NULL) {
+		kfree(ft->ft_openfiles);
+		kfree(ft);
+		return NULL;
+	}
+
 	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < size; fd++) {
 		ft->ft_openfiles[fd] = NULL;
 	}
+	ft->ft_size = size;
+	ft->ft_count = 0;
 
 	return ft;
 }
 
+/*
+ * Construct a filetable.
+ */
+struct filetable *
+filetable_create(void)
+{
+	return filetable_create_sized(FILETABLE_MINSIZE);
+}
+
 /*
  * Destroy a filetable.
  */
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned fd;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < ft->ft_size && ft->ft_count > 0; fd++) {
 		if (ft->ft_openfiles[fd] != NULL) {
 			openfile_decref(ft->ft_openfiles[fd]);
 			ft->ft_openfiles[fd] = NULL;
+			bitmap_unmark(ft->ft_used, fd);
+			ft->ft_count--;
 		}
 	}
+	KASSERT(ft->ft_count == 0);
+
+	bitmap_destroy(ft->ft_used);
+	kfree(ft->ft_openfiles);
 	kfree(ft);
 }
 
@@ -94,13 +171,17 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * The copy is the same size as the original, and we stop scanning
+ * once we've seen every open file, so the work depends on how many
+ * descriptors are open rather than on OPEN_MAX.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned fd;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -108,18 +189,21 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return 0;
 	}
 
-	dest = filetable_create();
+	dest = filetable_create_sized(src->ft_size);
 	if (dest == NULL) {
 		return ENOMEM;
 	}
 
 	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; dest->ft_count < src->ft_count; fd++) {
+		KASSERT(fd < src->ft_size);
 		file = src->ft_openfiles[fd];
 		if (file != NULL) {
 			openfile_incref(file);
+			dest->ft_openfiles[fd] = file;
+			bitmap_mark(dest->ft_used, fd);
+			dest->ft_count++;
 		}
-		dest->ft_openfiles[fd] = file;
 	}
 
 	*dest_ret = dest;
@@ -128,11 +212,13 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 
 /*
  * Check if a file handle is in range.
+ *
+ * This is the range the table can grow to, not its current size;
+ * slots past the end just aren't open.
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
 	(void)ft;
 
 	return (fd >= 0 && fd < OPEN_MAX);
@@ -151,7 +237,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (!filetable_okfd(ft, fd) || (unsigned)fd >= ft->ft_size) {
 		return EBADF;
 	}
 
@@ -184,6 +270,7 @@ filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
+	KASSERT((unsigned)fd < ft->ft_size);
 	KASSERT(ft->ft_openfiles[fd] == file);
 }
 
@@ -200,17 +287,28 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned fd;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
-		}
+	KASSERT(file != NULL);
+
+	/* bitmap_alloc finds (and marks) the lowest clear bit */
+	result = bitmap_alloc(ft->ft_used, &fd);
+	if (result) {
+		return EMFILE;
+	}
+
+	result = filetable_grow(ft, fd + 1);
+	if (result) {
+		bitmap_unmark(ft->ft_used, fd);
+		return result;
 	}
 
-	return EMFILE;
+	KASSERT(ft->ft_openfiles[fd] == NULL);
+	ft->ft_openfiles[fd] = file;
+	ft->ft_count++;
+	*fd_ret = fd;
+	return 0;
 }
 
 /*
@@ -221,17 +319,45 @@ filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the table has to grow to reach FD and there's no
+ * memory, in which case nothing changes. Placing NULL doesn't fail.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
+	struct openfile *oldfile;
+	int result;
+
 	KASSERT(filetable_okfd(ft, fd));
 
-	*oldfile_ret = ft->ft_openfiles[fd];
+	if ((unsigned)fd >= ft->ft_size) {
+		if (newfile == NULL) {
+			/* nothing there, and nothing to put there */
+			*oldfile_ret = NULL;
+			return 0;
+		}
+		result = filetable_grow(ft, fd + 1);
+		if (result) {
+			return result;
+		}
+	}
+
+	oldfile = ft->ft_openfiles[fd];
 	ft->ft_openfiles[fd] = newfile;
+
+	if (oldfile == NULL && newfile != NULL) {
+		bitmap_mark(ft->ft_used, fd);
+		ft->ft_count++;
+	}
+	else if (oldfile != NULL && newfile == NULL) {
+		bitmap_unmark(ft->ft_used, fd);
+		ft->ft_count--;
+	}
+
+	*oldfile_ret = oldfile;
+	return 0;
 }
@@ -37,6 +37,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
+#include <vnode.h>
 #include <openfile.h>
 
 /*
@@ -44,7 +45,7 @@
  */
 static
 struct openfile *
-openfile_create(struct vnode *vn, int accmode)
+openfile_create(struct vnode *vn, int accmode, bool append)
 {
 	struct openfile *file;
 
@@ -68,7 +69,10 @@ openfile_create(struct vnode *vn, int accmode)
 
 	file->of_vnode = vn;
 	file->of_accmode = accmode;
+	file->of_append = append;
 	file->of_offset = 0;
+	file->of_ranext = 0;
+	file->of_rawindow = 0;
 	file->of_refcount = 1;
 
 	return file;
@@ -106,7 +110,8 @@ openfile_open(char *filename, int openflags, mode_t mode,
 		return result;
 	}
 
-	file = openfile_create(vn, openflags & O_ACCMODE);
+	file = openfile_create(vn, openflags & O_ACCMODE,
+			       (openflags & O_APPEND) != 0);
 	if (file == NULL) {
 		vfs_close(vn);
 		return ENOMEM;
@@ -116,6 +121,24 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Wrap an already-referenced vnode (e.g. a pipe end) in an openfile.
+ * On success the openfile owns the reference.
+ */
+int
+openfile_fromvnode(struct vnode *vn, int accmode, struct openfile **ret)
+{
+	struct openfile *file;
+
+	file = openfile_create(vn, accmode, false);
+	if (file == NULL) {
+		return ENOMEM;
+	}
+
+	*ret = file;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
@@ -147,3 +170,36 @@ openfile_decref(struct openfile *file)
 		spinlock_release(&file->of_reflock);
 	}
 }
+
+/*
+ * Readahead. Called with of_offsetlock held after a read that covered
+ * [start, end). If the read picked up where the last one left off,
+ * the file is being read sequentially: open (or double) the window
+ * and hint the filesystem to start fetching that much past END. Any
+ * other read (or an lseek) closes the window again.
+ *
+ * The hint is only a hint; errors from it are ignored, since the
+ * real read will report them if they matter.
+ */
+void
+openfile_readahead(struct openfile *file, off_t start, off_t end)
+{
+	KASSERT(lock_do_i_hold(file->of_offsetlock));
+
+	if (start == file->of_ranext && end > start) {
+		if (file->of_rawindow == 0) {
+			file->of_rawindow = OPENFILE_RAMIN;
+		}
+		else if (file->of_rawindow < OPENFILE_RAMAX) {
+			file->of_rawindow *= 2;
+		}
+	}
+	else {
+		file->of_rawindow = 0;
+	}
+	file->of_ranext = end;
+
+	if (file->of_rawindow > 0) {
+		(void)VOP_READAHEAD(file->of_vnode, end, file->of_rawindow);
+	}
+}
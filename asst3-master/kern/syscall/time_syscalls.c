@@ -28,10 +28,18 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
 #include <copyinout.h>
 #include <syscall.h>
 
+/*
+ * Longest nanosleep we actually do. Anything longer is clamped to
+ * this, so the nanosecond count (and the clock plus it) can't
+ * overflow; a century is as good as forever here.
+ */
+#define NANOSLEEP_MAX_SECS	(100ULL * 365 * 24 * 60 * 60)
+
 /*
  * Example system call: get the time of day.
  */
@@ -56,3 +64,43 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the requested time. We can't be interrupted, so the
+ * remaining time, if asked for, is always zero.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec ts;
+	uint64_t nsecs;
+	int result;
+
+	result = copyin(user_req, &ts, sizeof(ts));
+	if (result) {
+		return result;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+	if ((uint64_t)ts.tv_sec >= NANOSLEEP_MAX_SECS) {
+		ts.tv_sec = NANOSLEEP_MAX_SECS;
+		ts.tv_nsec = 0;
+	}
+	nsecs = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	result = clock_nanosleep(nsecs);
+	if (result) {
+		return result;
+	}
+
+	if (user_rem != NULL) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		result = copyout(&ts, user_rem, sizeof(ts));
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ioschedbench - compare disk I/O scheduling policies.
+ *
+ * Runs the same set of scattered single-sector reads against a raw
+ * disk under each policy, from enough threads at once that the
+ * scheduler has a queue to work with, and reports how long each
+ * took. Each thread generates its sectors from a fixed seed, so
+ * every policy sees the same requests.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <stat.h>
+#include <lib.h>
+#include <clock.h>
+#include <uio.h>
+#include <thread.h>
+#include <synch.h>
+#include <vfs.h>
+#include <vnode.h>
+#include <iosched.h>
+#include <test.h>
+
+#define IOSB_NTHREADS	16
+#define IOSB_NREADS	32
+#define IOSB_SECTSIZE	512
+
+static const char *const iosb_policies[] = { "fifo", "elevator" };
+#define IOSB_NPOLICIES (sizeof(iosb_policies) / sizeof(iosb_policies[0]))
+
+static struct semaphore *iosb_sem;
+static char iosb_rawname[32];
+static uint32_t iosb_nsects;
+static volatile unsigned iosb_errors;
+
+static
+void
+iosb_thread(void *unused, unsigned long num)
+{
+	char buf[IOSB_SECTSIZE];
+	char path[sizeof(iosb_rawname)];
+	struct vnode *vn;
+	struct iovec iov;
+	struct uio ku;
+	uint32_t seed, sector;
+	unsigned i;
+	int result;
+
+	(void)unused;
+
+	/* vfs_open destroys its argument */
+	strcpy(path, iosb_rawname);
+	result = vfs_open(path, O_RDONLY, 0, &vn);
+	if (result) {
+		kprintf("ioschedbench: %s: %s\n", iosb_rawname,
+			strerror(result));
+		iosb_errors++;
+		V(iosb_sem);
+		return;
+	}
+
+	seed = num * 2654435761U + 1;
+	for (i=0; i<IOSB_NREADS; i++) {
+		seed = seed * 1103515245U + 12345U;
+		sector = (seed >> 8) % iosb_nsects;
+
+		uio_kinit(&iov, &ku, buf, sizeof(buf),
+			  (off_t)sector * IOSB_SECTSIZE, UIO_READ);
+		result = VOP_READ(vn, &ku);
+		if (result) {
+			kprintf("ioschedbench: sector %u: %s\n", sector,
+				strerror(result));
+			iosb_errors++;
+			break;
+		}
+	}
+
+	vfs_close(vn);
+	V(iosb_sem);
+}
+
+static
+int
+iosb_getsize(void)
+{
+	char path[sizeof(iosb_rawname)];
+	struct vnode *vn;
+	struct stat st;
+	int result;
+
+	strcpy(path, iosb_rawname);
+	result = vfs_open(path, O_RDONLY, 0, &vn);
+	if (result) {
+		return result;
+	}
+	result = VOP_STAT(vn, &st);
+	vfs_close(vn);
+	if (result) {
+		return result;
+	}
+	iosb_nsects = st.st_size / IOSB_SECTSIZE;
+	return iosb_nsects == 0 ? EINVAL : 0;
+}
+
+int
+ioschedbench(int nargs, char **args)
+{
+	const char *disk = "lhd0";
+	struct timespec start, end, diff;
+	unsigned p, i;
+	int result;
+
+	if (nargs == 2) {
+		disk = args[1];
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: iosb [disk]\n");
+		return EINVAL;
+	}
+	snprintf(iosb_rawname, sizeof(iosb_rawname), "%sraw:", disk);
+
+	result = iosb_getsize();
+	if (result) {
+		kprintf("ioschedbench: %s: %s\n", iosb_rawname,
+			strerror(result));
+		return result;
+	}
+
+	iosb_sem = sem_create("iosb", 0);
+	if (iosb_sem == NULL) {
+		return ENOMEM;
+	}
+
+	kprintf("ioschedbench: %u threads x %u random reads on %s "
+		"(%u sectors)\n", IOSB_NTHREADS, IOSB_NREADS, disk,
+		iosb_nsects);
+
+	for (p=0; p<IOSB_NPOLICIES; p++) {
+		result = iosched_set(disk, iosb_policies[p]);
+		if (result) {
+			kprintf("ioschedbench: %s: cannot set policy %s: %s\n",
+				disk, iosb_policies[p], strerror(result));
+			break;
+		}
+
+		iosb_errors = 0;
+		gettime(&start);
+		for (i=0; i<IOSB_NTHREADS; i++) {
+			result = thread_fork("iosb", NULL, iosb_thread,
+					     NULL, i);
+			if (result) {
+				panic("ioschedbench: thread_fork failed: %s\n",
+				      strerror(result));
+			}
+		}
+		for (i=0; i<IOSB_NTHREADS; i++) {
+			P(iosb_sem);
+		}
+		gettime(&end);
+		timespec_sub(&end, &start, &diff);
+
+		kprintf("%-10s %llu.%09lu seconds%s\n", iosb_policies[p],
+			(unsigned long long)diff.tv_sec,
+			(unsigned long)diff.tv_nsec,
+			iosb_errors ? " (with errors)" : "");
+	}
+
+	/* Back to the default */
+	iosched_set(disk, "elevator");
+	iosched_printstats();
+
+	sem_destroy(iosb_sem);
+	iosb_sem = NULL;
+	return result;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pritest - priority inheritance through locks.
+ *
+ * A low-priority thread takes lock A. A medium-priority thread takes
+ * lock B and then blocks on A; a high-priority thread then blocks on
+ * B. The low thread should be running at the high priority (donated
+ * through the medium thread), and each holder should drop back to
+ * its own priority as it releases the lock that was donated through.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define PIT_LOW		10
+#define PIT_MID		30
+#define PIT_HIGH	90
+
+#define PIT_POLLS	100
+#define PIT_POLLNSECS	10000000ULL	/* 10 ms */
+
+static struct lock *pit_locka, *pit_lockb;
+static struct semaphore *pit_ready, *pit_golow, *pit_done;
+static struct thread *volatile pit_lowthread, *volatile pit_midthread;
+
+/* Effective priorities observed by the threads themselves */
+static volatile int pit_lowheld, pit_lowreleased;
+static volatile int pit_midheld, pit_midreleased;
+
+static
+void
+pit_low(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
+
+	thread_setpriority(PIT_LOW);
+	pit_lowthread = curthread;
+	lock_acquire(pit_locka);
+	V(pit_ready);
+
+	P(pit_golow);
+	pit_lowheld = curthread->t_effpriority;
+	lock_release(pit_locka);
+	pit_lowreleased = curthread->t_effpriority;
+	V(pit_done);
+}
+
+static
+void
+pit_mid(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
+
+	thread_setpriority(PIT_MID);
+	pit_midthread = curthread;
+	lock_acquire(pit_lockb);
+	V(pit_ready);
+
+	lock_acquire(pit_locka);
+	lock_release(pit_locka);
+	pit_midheld = curthread->t_effpriority;
+	lock_release(pit_lockb);
+	pit_midreleased = curthread->t_effpriority;
+	V(pit_done);
+}
+
+static
+void
+pit_high(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
+
+	thread_setpriority(PIT_HIGH);
+	lock_acquire(pit_lockb);
+	lock_release(pit_lockb);
+	V(pit_done);
+}
+
+/*
+ * Wait (a while) for T's effective priority to become PRI, since the
+ * thread we're waiting on to donate it runs asynchronously.
+ */
+static
+void
+pit_waitpri(struct thread *t, int pri)
+{
+	unsigned i;
+
+	for (i=0; i<PIT_POLLS && t->t_effpriority != pri; i++) {
+		(void)clock_nanosleep(PIT_POLLNSECS);
+	}
+}
+
+static
+void
+pit_check(const char *what, int got, int expected, unsigned *errors)
+{
+	kprintf("pritest: %-32s %3d (expected %d)\n", what, got, expected);
+	if (got != expected) {
+		(*errors)++;
+	}
+}
+
+int
+pritest(int nargs, char **args)
+{
+	unsigned errors = 0;
+	int lowdirect, lowchained, midchained;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	pit_locka = lock_create("pit A");
+	pit_lockb = lock_create("pit B");
+	pit_ready = sem_create("pit ready", 0);
+	pit_golow = sem_create("pit go", 0);
+	pit_done = sem_create("pit done", 0);
+	if (pit_locka == NULL || pit_lockb == NULL || pit_ready == NULL ||
+	    pit_golow == NULL || pit_done == NULL) {
+		panic("pritest: out of memory\n");
+	}
+
+	kprintf("Starting priority inheritance test...\n");
+
+	result = thread_fork("pit low", NULL, pit_low, NULL, 0);
+	if (result) {
+		panic("pritest: thread_fork failed: %s\n", strerror(result));
+	}
+	P(pit_ready);
+
+	/* Medium thread blocks on A: the low thread gets its priority */
+	result = thread_fork("pit mid", NULL, pit_mid, NULL, 0);
+	if (result) {
+		panic("pritest: thread_fork failed: %s\n", strerror(result));
+	}
+	P(pit_ready);
+	pit_waitpri(pit_lowthread, PIT_MID);
+	lowdirect = pit_lowthread->t_effpriority;
+
+	/* High thread blocks on B: both holders get its priority */
+	result = thread_fork("pit high", NULL, pit_high, NULL, 0);
+	if (result) {
+		panic("pritest: thread_fork failed: %s\n", strerror(result));
+	}
+	pit_waitpri(pit_lowthread, PIT_HIGH);
+	lowchained = pit_lowthread->t_effpriority;
+	midchained = pit_midthread->t_effpriority;
+
+	/* Let it all unwind */
+	V(pit_golow);
+	P(pit_done);
+	P(pit_done);
+	P(pit_done);
+
+	pit_check("low holder, mid waiting:", lowdirect, PIT_MID, &errors);
+	pit_check("mid holder, high waiting:", midchained, PIT_HIGH, &errors);
+	pit_check("low holder, transitively:", lowchained, PIT_HIGH, &errors);
+	pit_check("low before releasing A:", pit_lowheld, PIT_HIGH, &errors);
+	pit_check("low after releasing A:", pit_lowreleased, PIT_LOW,
+		  &errors);
+	pit_check("mid before releasing B:", pit_midheld, PIT_HIGH, &errors);
+	pit_check("mid after releasing B:", pit_midreleased, PIT_MID,
+		  &errors);
+
+	lock_destroy(pit_locka);
+	lock_destroy(pit_lockb);
+	sem_destroy(pit_ready);
+	sem_destroy(pit_golow);
+	sem_destroy(pit_done);
+	pit_lowthread = pit_midthread = NULL;
+
+	if (errors) {
+		kprintf("Priority inheritance test FAILED\n");
+		return EINVAL;
+	}
+	kprintf("Priority inheritance test done.\n");
+	return 0;
+}
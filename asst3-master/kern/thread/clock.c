@@ -28,19 +28,27 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <synch.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Besides the periodic hardclock and the once-a-second lbolt, we
+ * support one-shot timeouts with nanosecond resolution. These are
+ * kept in a binary min-heap ordered by expiry time. Every CPU's timer
+ * interrupt checks the top of the heap, and every CPU arms its timer
+ * for whichever comes first, its next periodic tick or the earliest
+ * timeout. Idle CPUs don't tick at all.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -53,12 +61,27 @@
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
+/*
+ * Longest an idle CPU sleeps without a timeout pending. This only
+ * bounds how stale things can get if a wakeup is lost somewhere; idle
+ * CPUs are normally woken by interrupts or IPI_UNIDLE.
+ */
+#define IDLE_MAX_NSECS		1000000000ULL
+
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
  */
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * Pending timeouts, in a pairing heap: timeout_root expires first,
+ * and each node's children are on a list through to_next, the first
+ * child's to_prev pointing back at the parent.
+ */
+static struct spinlock timeout_lock;
+static struct timeout *timeout_root;
+
 /*
  * Setup.
  */
@@ -70,6 +93,246 @@ hardclock_bootstrap(void)
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+	spinlock_init(&timeout_lock);
+	timeout_root = NULL;
+}
+
+/*
+ * Current time as a single nanosecond count.
+ */
+uint64_t
+clock_nsecs(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////
+// timeout heap
+
+/*
+ * Combine two heaps (either may be empty) and return the new root.
+ */
+static
+struct timeout *
+timeout_meld(struct timeout *a, struct timeout *b)
+{
+	struct timeout *t;
+
+	if (a == NULL) {
+		return b;
+	}
+	if (b == NULL) {
+		return a;
+	}
+	if (b->to_when < a->to_when) {
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	/* B becomes A's first child. */
+	b->to_prev = a;
+	b->to_next = a->to_child;
+	if (a->to_child != NULL) {
+		a->to_child->to_prev = b;
+	}
+	a->to_child = b;
+	return a;
+}
+
+/*
+ * Combine a list of sibling heaps into one: meld them in pairs left
+ * to right, then meld the pairs together right to left. (This is
+ * what keeps the heap balanced enough.)
+ */
+static
+struct timeout *
+timeout_mergepairs(struct timeout *first)
+{
+	struct timeout *a, *b, *next, *pairs, *ret;
+
+	pairs = NULL;
+	while (first != NULL) {
+		a = first;
+		b = a->to_next;
+		next = b != NULL ? b->to_next : NULL;
+		a->to_next = a->to_prev = NULL;
+		if (b != NULL) {
+			b->to_next = b->to_prev = NULL;
+		}
+		a = timeout_meld(a, b);
+		/* Push onto PAIRS, which comes out in reverse order */
+		a->to_next = pairs;
+		pairs = a;
+		first = next;
+	}
+
+	ret = NULL;
+	while (pairs != NULL) {
+		next = pairs->to_next;
+		pairs->to_next = NULL;
+		ret = timeout_meld(ret, pairs);
+		pairs = next;
+	}
+	return ret;
+}
+
+/*
+ * Take TO out of the heap.
+ */
+static
+void
+timeout_heapremove(struct timeout *to)
+{
+	struct timeout *sub;
+
+	KASSERT(to->to_pending);
+	to->to_pending = false;
+
+	if (to == timeout_root) {
+		timeout_root = timeout_mergepairs(to->to_child);
+	}
+	else {
+		/* Unlink from the parent's child list */
+		if (to->to_prev->to_child == to) {
+			to->to_prev->to_child = to->to_next;
+		}
+		else {
+			to->to_prev->to_next = to->to_next;
+		}
+		if (to->to_next != NULL) {
+			to->to_next->to_prev = to->to_prev;
+		}
+		sub = timeout_mergepairs(to->to_child);
+		timeout_root = timeout_meld(timeout_root, sub);
+	}
+	to->to_child = to->to_next = to->to_prev = NULL;
+}
+
+void
+timeout_init(struct timeout *to)
+{
+	to->to_when = 0;
+	to->to_func = NULL;
+	to->to_arg = NULL;
+	to->to_pending = false;
+	to->to_child = to->to_next = to->to_prev = NULL;
+}
+
+void
+timeout(struct timeout *to, void (*func)(void *), void *arg, uint64_t nsecs)
+{
+	uint64_t now;
+	bool first;
+	int spl;
+
+	KASSERT(!to->to_pending);
+
+	now = clock_nsecs();
+
+	spinlock_acquire(&timeout_lock);
+	to->to_when = now + nsecs;
+	to->to_func = func;
+	to->to_arg = arg;
+	to->to_pending = true;
+	to->to_child = to->to_next = to->to_prev = NULL;
+	timeout_root = timeout_meld(timeout_root, to);
+	first = (timeout_root == to);
+	spinlock_release(&timeout_lock);
+
+	/*
+	 * If this is now the earliest timeout and it's due before our
+	 * next tick, pull our timer in so it fires on time. (We're
+	 * running, so we aren't tickless; other CPUs will pick up the
+	 * change next time they rearm.)
+	 */
+	if (first && nsecs < HARDCLOCK_NSECS) {
+		spl = splhigh();
+		mainbus_settimer(nsecs);
+		splx(spl);
+	}
+}
+
+bool
+untimeout(struct timeout *to)
+{
+	bool ret;
+
+	spinlock_acquire(&timeout_lock);
+	ret = to->to_pending;
+	if (ret) {
+		timeout_heapremove(to);
+	}
+	spinlock_release(&timeout_lock);
+	return ret;
+}
+
+/*
+ * Call the functions of all timeouts that have expired as of NOW.
+ * Returns the expiry time of the earliest remaining timeout, or 0 if
+ * there are none.
+ */
+static
+uint64_t
+timeout_run(uint64_t now)
+{
+	struct timeout *to;
+	void (*func)(void *);
+	void *arg;
+	uint64_t next;
+
+	spinlock_acquire(&timeout_lock);
+	while (timeout_root != NULL && timeout_root->to_when <= now) {
+		to = timeout_root;
+		func = to->to_func;
+		arg = to->to_arg;
+		timeout_heapremove(to);
+
+		/* The function may well set another timeout. */
+		spinlock_release(&timeout_lock);
+		func(arg);
+		spinlock_acquire(&timeout_lock);
+	}
+	next = timeout_root != NULL ? timeout_root->to_when : 0;
+	spinlock_release(&timeout_lock);
+
+	return next;
+}
+
+/*
+ * Expiry time of the earliest pending timeout, or 0 if there are none.
+ */
+static
+uint64_t
+timeout_next(void)
+{
+	uint64_t next;
+
+	spinlock_acquire(&timeout_lock);
+	next = timeout_root != NULL ? timeout_root->to_when : 0;
+	spinlock_release(&timeout_lock);
+
+	return next;
+}
+
+////////////////////////////////////////////////////////////
+// clock interrupts
+
+/*
+ * Arm this CPU's timer for the earlier of LIMIT and the next timeout
+ * NEXT (if nonzero).
+ */
+static
+void
+hardclock_arm(uint64_t now, uint64_t limit, uint64_t next)
+{
+	if (next != 0 && next < limit) {
+		limit = next;
+	}
+	mainbus_settimer(limit > now ? limit - now : 0);
 }
 
 /*
@@ -86,17 +349,43 @@ timerclock(void)
 }
 
 /*
- * This is called HZ times a second (on each processor) by the timer
- * code.
+ * This is called on each processor from the timer interrupt: HZ
+ * times a second while the processor is busy, whenever a timeout is
+ * due, and occasionally while idle.
  */
 void
 hardclock(void)
 {
+	uint64_t now, next;
+
+	now = clock_nsecs();
+	next = timeout_run(now);
+
+	if (curcpu->c_isidle) {
+		/*
+		 * Nothing to schedule; stop ticking until there's
+		 * something to do. hardclock_unidle() starts us up
+		 * again.
+		 */
+		curcpu->c_tickless = true;
+		hardclock_arm(now, now + IDLE_MAX_NSECS, next);
+		return;
+	}
+
+	if (now < curcpu->c_nexttick) {
+		/* Woken early for a timeout; not time to tick yet. */
+		hardclock_arm(now, curcpu->c_nexttick, next);
+		return;
+	}
+	curcpu->c_nexttick = now + HARDCLOCK_NSECS;
+	hardclock_arm(now, curcpu->c_nexttick, next);
+
 	/*
 	 * Collect statistics here as desired.
 	 */
 
 	curcpu->c_hardclocks++;
+	curthread->t_runticks++;
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -106,6 +395,28 @@ hardclock(void)
 	thread_yield();
 }
 
+/*
+ * Restart the periodic tick on a CPU that stopped it while idle.
+ * Called from thread_switch, with interrupts off, when the CPU finds
+ * a thread to run.
+ */
+void
+hardclock_unidle(void)
+{
+	uint64_t now;
+
+	KASSERT(curcpu->c_tickless);
+	curcpu->c_tickless = false;
+
+	/* Don't push back a timer already set for an earlier timeout. */
+	now = clock_nsecs();
+	curcpu->c_nexttick = now + HARDCLOCK_NSECS;
+	hardclock_arm(now, curcpu->c_nexttick, timeout_next());
+}
+
+////////////////////////////////////////////////////////////
+// sleeping
+
 /*
  * Suspend execution for n seconds.
  */
@@ -119,3 +430,39 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+static
+void
+clock_nanosleep_wakeup(void *vsem)
+{
+	struct semaphore *sem = vsem;
+
+	V(sem);
+}
+
+/*
+ * Suspend execution for NSECS nanoseconds.
+ */
+int
+clock_nanosleep(uint64_t nsecs)
+{
+	struct semaphore *sem;
+	struct timeout to;
+
+	if (nsecs == 0) {
+		thread_yield();
+		return 0;
+	}
+
+	sem = sem_create("nanosleep", 0);
+	if (sem == NULL) {
+		return ENOMEM;
+	}
+
+	timeout_init(&to);
+	timeout(&to, clock_nanosleep_wakeup, sem, nsecs);
+	P(sem);
+
+	sem_destroy(sem);
+	return 0;
+}
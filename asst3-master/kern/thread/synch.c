@@ -138,6 +138,79 @@ V(struct semaphore *sem)
 //
 // Lock.
 
+/*
+ * Protects the priority-inheritance state: t_effpriority, t_waitlock
+ * and t_heldlocks in every thread, and lk_holder, lk_waitprio and
+ * lk_nextheld in every lock (lk_holder is also protected by lk_lock;
+ * writers take both). Ordered after every lk_lock, and before the
+ * run queue locks.
+ */
+static struct spinlock lock_prilock = SPINLOCK_INITIALIZER;
+
+/*
+ * Recompute T's effective priority from its base priority and the
+ * waiters on the locks it holds.
+ */
+static
+void
+lock_recompute(struct thread *t)
+{
+	struct lock *l;
+	int pri;
+
+	KASSERT(spinlock_do_i_hold(&lock_prilock));
+
+	pri = t->t_priority;
+	for (l = t->t_heldlocks; l != NULL; l = l->lk_nextheld) {
+		if (l->lk_waitprio > pri) {
+			pri = l->lk_waitprio;
+		}
+	}
+	t->t_effpriority = pri;
+}
+
+/*
+ * A thread of priority PRI is about to wait for LOCK. Push PRI to the
+ * holder, and if the holder is itself waiting for a lock, onward to
+ * that lock's holder, and so on, at most LOCK_PI_MAXDEPTH steps.
+ */
+static
+void
+lock_donate(struct lock *lock, int pri)
+{
+	struct thread *holder;
+	unsigned depth;
+
+	KASSERT(spinlock_do_i_hold(&lock_prilock));
+
+	for (depth = 0; lock != NULL && depth < LOCK_PI_MAXDEPTH; depth++) {
+		if (lock->lk_waitprio < pri) {
+			lock->lk_waitprio = pri;
+		}
+		holder = lock->lk_holder;
+		if (holder == NULL || holder->t_effpriority >= pri) {
+			break;
+		}
+		holder->t_effpriority = pri;
+		lock = holder->t_waitlock;
+	}
+}
+
+/*
+ * This lives here rather than in thread.c because the effective
+ * priority depends on the locks held, which is synch.c state.
+ */
+void
+thread_setpriority(int priority)
+{
+	KASSERT(priority >= THREAD_PRI_MIN && priority <= THREAD_PRI_MAX);
+
+	spinlock_acquire(&lock_prilock);
+	curthread->t_priority = priority;
+	lock_recompute(curthread);
+	spinlock_release(&lock_prilock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -164,6 +237,8 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_waitprio = THREAD_PRI_MIN;
+	lock->lk_nextheld = NULL;
 
 	return lock;
 }
@@ -194,10 +269,30 @@ lock_acquire(struct lock *lock)
 
 	KASSERT(lock->lk_holder != curthread);
 	while (lock->lk_holder != NULL) {
+		/*
+		 * Donate our priority along the waits-for chain. This
+		 * is the same chain HANGMAN_WAIT just checked for
+		 * cycles, so with the deadlock detector enabled a
+		 * cycle panics there first; without it, the depth
+		 * bound keeps us from going round forever.
+		 */
+		spinlock_acquire(&lock_prilock);
+		curthread->t_waitlock = lock;
+		lock_donate(lock, curthread->t_effpriority);
+		spinlock_release(&lock_prilock);
+
 		/* As in the semaphore. */
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
+
+	spinlock_acquire(&lock_prilock);
+	curthread->t_waitlock = NULL;
 	lock->lk_holder = curthread;
+	lock->lk_nextheld = curthread->t_heldlocks;
+	curthread->t_heldlocks = lock;
+	lock->lk_waitprio = wchan_maxpriority(lock->lk_wchan, &lock->lk_lock);
+	lock_recompute(curthread);
+	spinlock_release(&lock_prilock);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -208,12 +303,26 @@ lock_acquire(struct lock *lock)
 void
 lock_release(struct lock *lock)
 {
+	struct lock **lp;
+
 	DEBUGASSERT(lock != NULL);
 
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
+
+	/* Give back whatever priority the waiters lent us. */
+	spinlock_acquire(&lock_prilock);
+	for (lp = &curthread->t_heldlocks; *lp != lock;
+	     lp = &(*lp)->lk_nextheld) {
+		KASSERT(*lp != NULL);
+	}
+	*lp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
 	lock->lk_holder = NULL;
+	lock_recompute(curthread);
+	spinlock_release(&lock_prilock);
+
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
 	/* Call this (atomically) when the lock is released */
@@ -53,11 +53,15 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <clock.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Max number of dead threads (with stacks) kept per cpu for reuse. */
+#define THREAD_CACHE_MAX 16
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -72,6 +76,10 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* List of all threads, for statistics reporting. */
+static struct thread *allthreads;
+static struct spinlock allthreads_lock = SPINLOCK_INITIALIZER;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -112,46 +120,166 @@ thread_checkstack(struct thread *thread)
 }
 
 /*
- * Create a thread. This is used both to create a first thread
- * for each CPU and to create subsequent forked threads.
+ * Set a thread's name. Short names go in the inline buffer to save
+ * a kmalloc; long ones are copied. Frees any previous long name.
  */
 static
-struct thread *
-thread_create(const char *name)
+int
+thread_setname(struct thread *thread, const char *name)
 {
-	struct thread *thread;
+	char *newname;
 
-	DEBUGASSERT(name != NULL);
+	if (strlen(name) < sizeof(thread->t_namebuf)) {
+		strcpy(thread->t_namebuf, name);
+		newname = thread->t_namebuf;
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			return ENOMEM;
+		}
+	}
+	if (thread->t_name != NULL && thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
+	thread->t_name = newname;
+	return 0;
+}
 
-	thread = kmalloc(sizeof(*thread));
-	if (thread == NULL) {
-		return NULL;
+/*
+ * Add a thread to, or take it off, the all-threads list.
+ */
+static
+void
+thread_list(struct thread *thread)
+{
+	spinlock_acquire(&allthreads_lock);
+	thread->t_allprev = NULL;
+	thread->t_allnext = allthreads;
+	if (allthreads != NULL) {
+		allthreads->t_allprev = thread;
 	}
+	allthreads = thread;
+	spinlock_release(&allthreads_lock);
+}
 
-	thread->t_name = kstrdup(name);
-	if (thread->t_name == NULL) {
-		kfree(thread);
-		return NULL;
+static
+void
+thread_unlist(struct thread *thread)
+{
+	spinlock_acquire(&allthreads_lock);
+	if (thread->t_allprev != NULL) {
+		thread->t_allprev->t_allnext = thread->t_allnext;
+	}
+	else {
+		KASSERT(allthreads == thread);
+		allthreads = thread->t_allnext;
+	}
+	if (thread->t_allnext != NULL) {
+		thread->t_allnext->t_allprev = thread->t_allprev;
 	}
+	spinlock_release(&allthreads_lock);
+}
+
+/*
+ * Initialize the fields of a thread that start out the same for
+ * every new thread, whether it was freshly allocated or recycled
+ * from the thread cache. (Not t_name, t_stack, or t_listnode.)
+ */
+static
+void
+thread_reset(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
 
+	/* Priority fields */
+	thread->t_priority = THREAD_PRI_DEFAULT;
+	thread->t_effpriority = THREAD_PRI_DEFAULT;
+	thread->t_waitlock = NULL;
+	thread->t_heldlocks = NULL;
+
+	/* Statistics fields */
+	thread->t_volswitches = 0;
+	thread->t_involswitches = 0;
+	thread->t_migrations = 0;
+	thread->t_runticks = 0;
+	thread_list(thread);
+
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
 	/* If you add to struct thread, be sure to initialize here */
+}
+
+/*
+ * Create a thread. This is used both to create a first thread
+ * for each CPU and to create subsequent forked threads.
+ */
+static
+struct thread *
+thread_create(const char *name)
+{
+	struct thread *thread;
+
+	DEBUGASSERT(name != NULL);
+
+	thread = kmalloc(sizeof(*thread));
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	thread->t_name = NULL;
+	if (thread_setname(thread, name)) {
+		kfree(thread);
+		return NULL;
+	}
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_stack = NULL;
+	thread_reset(thread);
+
+	return thread;
+}
+
+/*
+ * Get a thread with a stack already attached from this cpu's thread
+ * cache, if there is one. Interrupts are off while we look at the
+ * cache so we can't be switched to another cpu in the middle.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	/* The stack guard was set once when the stack was allocated. */
+	thread_checkstack(thread);
 
+	if (thread_setname(thread, name)) {
+		spl = splhigh();
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+		splx(spl);
+		return NULL;
+	}
+	thread_reset(thread);
 	return thread;
 }
 
@@ -180,12 +308,21 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
+	c->c_nexttick = 0;
+	c->c_tickless = false;
+	c->c_switches = 0;
+	c->c_idles = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	c->c_wakeups = 0;
+	c->c_migrations_in = 0;
+	c->c_migrations_out = 0;
+	c->c_runqueue_max = 0;
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
@@ -277,22 +414,49 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_heldlocks == NULL);
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
 	}
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
+	thread_unlist(thread);
 
 	/* sheer paranoia */
 	thread->t_wchan_name = "DESTROYED";
 
-	kfree(thread->t_name);
+	if (thread->t_name != thread->t_namebuf) {
+		kfree(thread->t_name);
+	}
 	kfree(thread);
 }
 
+/*
+ * Put a dead thread in this cpu's thread cache for thread_fork to
+ * reuse, stack and all. Like thread_destroy, this can't be called in
+ * the thread's own context.
+ */
+static
+void
+thread_recycle(struct thread *thread)
+{
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state != S_RUN);
+	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_heldlocks == NULL);
+	KASSERT(thread->t_stack != NULL);
+
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread_unlist(thread);
+	thread->t_wchan_name = "CACHED";
+	threadlist_addhead(&curcpu->c_threadcache, thread);
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Up to THREAD_CACHE_MAX
+ * of them are kept in the per-cpu thread cache instead, so the next
+ * thread_fork doesn't have to allocate.
  *
  * The list of zombies is per-cpu.
  */
@@ -305,7 +469,13 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (z->t_stack != NULL &&
+		    curcpu->c_threadcache.tl_count < THREAD_CACHE_MAX) {
+			thread_recycle(z);
+		}
+		else {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -445,6 +615,30 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Put T on the list TL in order of effective priority, after any
+ * threads of the same priority. When everyone has the default
+ * priority this is the same as threadlist_addtail.
+ *
+ * Priority donated to a thread after it was queued is not acted on
+ * until it is next queued; this keeps the lock priority spinlock
+ * from needing to nest inside the list's lock.
+ */
+static
+void
+thread_enqueue(struct threadlist *tl, struct thread *t)
+{
+	struct thread *other;
+
+	THREADLIST_FORALL_REV(other, *tl) {
+		if (other->t_effpriority >= t->t_effpriority) {
+			threadlist_insertafter(tl, other, t);
+			return;
+		}
+	}
+	threadlist_addhead(tl, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -469,7 +663,11 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(&targetcpu->c_runqueue, target);
+	targetcpu->c_wakeups++;
+	if (targetcpu->c_runqueue.tl_count > targetcpu->c_runqueue_max) {
+		targetcpu->c_runqueue_max = targetcpu->c_runqueue.tl_count;
+	}
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -503,18 +701,21 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -522,6 +723,8 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_priority = curthread->t_priority;
+	newthread->t_effpriority = curthread->t_priority;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -602,9 +805,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
+		cur->t_involswitches++;
 		thread_make_runnable(cur, true /*have lock*/);
 		break;
 	    case S_SLEEP:
+		cur->t_volswitches++;
 		cur->t_wchan_name = wc->wc_name;
 		/*
 		 * Add the thread to the list in the wait channel, and
@@ -614,10 +819,11 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 * caller of wchan_sleep locked it until the thread is
 		 * on the list.
 		 */
-		threadlist_addtail(&wc->wc_threads, cur);
+		thread_enqueue(&wc->wc_threads, cur);
 		spinlock_release(lk);
 		break;
 	    case S_ZOMBIE:
+		cur->t_volswitches++;
 		cur->t_wchan_name = "ZOMBIE";
 		threadlist_addtail(&curcpu->c_zombies, cur);
 		break;
@@ -643,6 +849,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 
 	/* The current cpu is now idle. */
 	curcpu->c_isidle = true;
+	if (threadlist_isempty(&curcpu->c_runqueue)) {
+		curcpu->c_idles++;
+	}
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
@@ -653,6 +862,15 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	if (next != cur) {
+		curcpu->c_switches++;
+	}
+
+	/* If the periodic tick was stopped while idle, restart it. */
+	if (curcpu->c_tickless) {
+		hardclock_unidle();
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -818,6 +1036,74 @@ thread_yield(void)
 
 ////////////////////////////////////////////////////////////
 
+/*
+ * Statistics.
+ */
+
+static const char *const thread_statenames[] = {
+	[S_RUN] = "run",
+	[S_READY] = "ready",
+	[S_SLEEP] = "sleep",
+	[S_ZOMBIE] = "zombie",
+};
+
+/*
+ * Append to the stats buffer, keeping track of the length. snprintf
+ * returns what it would have printed, so clamp to what actually fit.
+ */
+#define STATPRINTF(...) \
+	do { \
+		if (pos < maxlen) { \
+			pos += snprintf(buf + pos, maxlen - pos, __VA_ARGS__); \
+			if (pos >= maxlen) { \
+				pos = maxlen - 1; \
+			} \
+		} \
+	} while (0)
+
+size_t
+thread_formatstats(char *buf, size_t maxlen)
+{
+	struct cpu *c;
+	struct thread *t;
+	unsigned i, qlen;
+	size_t pos = 0;
+
+	KASSERT(maxlen > 0);
+	buf[0] = 0;
+
+	STATPRINTF("cpu  runq  maxq   switches      idles    wakeups"
+		   "   migr-in  migr-out  hardclocks\n");
+	for (i=0; i<cpuarray_num(&allcpus); i++) {
+		c = cpuarray_get(&allcpus, i);
+		spinlock_acquire(&c->c_runqueue_lock);
+		qlen = c->c_runqueue.tl_count;
+		spinlock_release(&c->c_runqueue_lock);
+		STATPRINTF("%3u %5u %5u %10u %10u %10u %9u %9u %11u\n",
+			   c->c_number, qlen, c->c_runqueue_max,
+			   c->c_switches, c->c_idles, c->c_wakeups,
+			   c->c_migrations_in, c->c_migrations_out,
+			   c->c_hardclocks);
+	}
+
+	STATPRINTF("\nthread               state  cpu pri     vol   invol"
+		   "  migr     ticks\n");
+	spinlock_acquire(&allthreads_lock);
+	for (t = allthreads; t != NULL; t = t->t_allnext) {
+		STATPRINTF("%-20s %-6s %3d %3d %7u %7u %5u %9u\n",
+			   t->t_name, thread_statenames[t->t_state],
+			   t->t_cpu != NULL ? (int)t->t_cpu->c_number : -1,
+			   t->t_effpriority, t->t_volswitches,
+			   t->t_involswitches, t->t_migrations,
+			   t->t_runticks);
+	}
+	spinlock_release(&allthreads_lock);
+
+	return pos;
+}
+
+////////////////////////////////////////////////////////////
+
 /*
  * Scheduler.
  *
@@ -923,7 +1209,10 @@ thread_consider_migration(void)
 			}
 
 			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
+			t->t_migrations++;
+			thread_enqueue(&c->c_runqueue, t);
+			c->c_migrations_in++;
+			curcpu->c_migrations_out++;
 			DEBUG(DB_THREADS,
 			      "Migrated thread %s: cpu %u -> %u",
 			      t->t_name, curcpu->c_number, c->c_number);
@@ -947,7 +1236,7 @@ thread_consider_migration(void)
 	if (!threadlist_isempty(&victims)) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_enqueue(&curcpu->c_runqueue, t);
 		}
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
@@ -1081,6 +1370,27 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Return the highest effective priority of any thread sleeping on
+ * the channel.
+ */
+int
+wchan_maxpriority(struct wchan *wc, struct spinlock *lk)
+{
+	struct thread *t;
+	int ret;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	ret = THREAD_PRI_MIN;
+	THREADLIST_FORALL(t, wc->wc_threads) {
+		if (t->t_effpriority > ret) {
+			ret = t->t_effpriority;
+		}
+	}
+	return ret;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
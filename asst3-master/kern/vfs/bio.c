@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous block I/O. See bio.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <uio.h>
+#include <device.h>
+#include <bio.h>
+
+/*
+ * Per-device accounting.
+ */
+struct bio_devstats {
+	struct device *bs_dev;
+	unsigned bs_inflight;		/* current queue depth */
+	unsigned bs_maxinflight;	/* deepest it's been */
+	unsigned bs_reads;
+	unsigned bs_writes;
+	unsigned bs_errors;
+	uint64_t bs_bytes;
+	uint64_t bs_nsecs;		/* total latency */
+	unsigned bs_hist[BIO_NHIST];	/* latency histogram */
+};
+
+/*
+ * bio_lock protects the stats and the bio_complete flags; bio_wchan
+ * is where bio_wait sleeps. One wchan for everything is crude, but
+ * waiters just recheck their own bio when woken.
+ */
+static struct spinlock bio_lock = SPINLOCK_INITIALIZER;
+static struct wchan *bio_wchan;
+static struct bio_devstats bio_devstats[BIO_MAXDEVS];
+static unsigned bio_numdevs;
+
+/*
+ * Find (or create) the stats for DEV. Returns NULL if we've run out
+ * of slots, in which case the device simply isn't counted.
+ */
+static
+struct bio_devstats *
+bio_getstats(struct device *dev)
+{
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&bio_lock));
+
+	for (i=0; i<bio_numdevs; i++) {
+		if (bio_devstats[i].bs_dev == dev) {
+			return &bio_devstats[i];
+		}
+	}
+	if (bio_numdevs == BIO_MAXDEVS) {
+		return NULL;
+	}
+	bio_devstats[bio_numdevs].bs_dev = dev;
+	return &bio_devstats[bio_numdevs++];
+}
+
+/*
+ * Histogram bucket for a latency: bucket N counts latencies from
+ * 2^N up to 2^(N+1) microseconds, except that bucket 0 also takes
+ * everything under 1us and the last bucket takes everything over.
+ */
+static
+unsigned
+bio_bucket(uint64_t nsecs)
+{
+	uint64_t usecs = nsecs / 1000;
+	unsigned b = 0;
+
+	while (usecs >= 2 && b < BIO_NHIST - 1) {
+		usecs >>= 1;
+		b++;
+	}
+	return b;
+}
+
+void
+bio_init(struct bio *bio, struct device *dev, enum uio_rw rw,
+	 daddr_t block, void *data, size_t len)
+{
+	bio->bio_dev = dev;
+	bio->bio_rw = rw;
+	bio->bio_block = block;
+	bio->bio_data = data;
+	bio->bio_len = len;
+	bio->bio_done = NULL;
+	bio->bio_arg = NULL;
+	bio->bio_result = 0;
+	bio->bio_complete = false;
+	bio->bio_start = 0;
+	bio->bio_stats = NULL;
+}
+
+/*
+ * Start an I/O.
+ */
+void
+bio_submit(struct bio *bio)
+{
+	struct device *dev = bio->bio_dev;
+	struct bio_devstats *bs;
+	struct iovec iov;
+	struct uio ku;
+	int result;
+
+	KASSERT(bio->bio_len > 0);
+	KASSERT(bio->bio_len % dev->d_blocksize == 0);
+
+	bio->bio_result = 0;
+	bio->bio_complete = false;
+	bio->bio_start = clock_nsecs();
+
+	spinlock_acquire(&bio_lock);
+	bs = bio_getstats(dev);
+	if (bs != NULL) {
+		bs->bs_inflight++;
+		if (bs->bs_inflight > bs->bs_maxinflight) {
+			bs->bs_maxinflight = bs->bs_inflight;
+		}
+	}
+	bio->bio_stats = bs;
+	spinlock_release(&bio_lock);
+
+	if (dev->d_ops->devop_strategy != NULL) {
+		result = DEVOP_STRATEGY(dev, bio);
+		if (result) {
+			/* Never started */
+			bio_complete(bio, result);
+		}
+		return;
+	}
+
+	/* No async support; do it the old way. */
+	uio_kinit(&iov, &ku, bio->bio_data, bio->bio_len,
+		  ((off_t)bio->bio_block) * dev->d_blocksize, bio->bio_rw);
+	result = DEVOP_IO(dev, &ku);
+	bio_complete(bio, result);
+}
+
+/*
+ * Called by the driver (or bio_submit) when an I/O is finished.
+ */
+void
+bio_complete(struct bio *bio, int result)
+{
+	struct bio_devstats *bs;
+	uint64_t nsecs;
+
+	nsecs = clock_nsecs() - bio->bio_start;
+
+	spinlock_acquire(&bio_lock);
+	bs = bio->bio_stats;
+	if (bs != NULL) {
+		KASSERT(bs->bs_inflight > 0);
+		bs->bs_inflight--;
+		if (bio->bio_rw == UIO_READ) {
+			bs->bs_reads++;
+		}
+		else {
+			bs->bs_writes++;
+		}
+		if (result) {
+			bs->bs_errors++;
+		}
+		else {
+			bs->bs_bytes += bio->bio_len;
+		}
+		bs->bs_nsecs += nsecs;
+		bs->bs_hist[bio_bucket(nsecs)]++;
+	}
+	bio->bio_result = result;
+
+	if (bio->bio_done == NULL) {
+		bio->bio_complete = true;
+		wchan_wakeall(bio_wchan, &bio_lock);
+		spinlock_release(&bio_lock);
+	}
+	else {
+		/* The hook may free the bio, so this must come last. */
+		spinlock_release(&bio_lock);
+		bio->bio_done(bio);
+	}
+}
+
+/*
+ * Wait for an I/O to finish and return its result.
+ */
+int
+bio_wait(struct bio *bio)
+{
+	KASSERT(bio->bio_done == NULL);
+
+	spinlock_acquire(&bio_lock);
+	while (!bio->bio_complete) {
+		wchan_sleep(bio_wchan, &bio_lock);
+	}
+	spinlock_release(&bio_lock);
+
+	return bio->bio_result;
+}
+
+/*
+ * Check whether an I/O has finished, without waiting.
+ */
+bool
+bio_iscomplete(struct bio *bio)
+{
+	bool ret;
+
+	KASSERT(bio->bio_done == NULL);
+
+	spinlock_acquire(&bio_lock);
+	ret = bio->bio_complete;
+	spinlock_release(&bio_lock);
+
+	return ret;
+}
+
+void
+bio_printstats(void)
+{
+	struct bio_devstats bs;
+	unsigned i, j, n;
+
+	spinlock_acquire(&bio_lock);
+	n = bio_numdevs;
+	spinlock_release(&bio_lock);
+
+	for (i=0; i<n; i++) {
+		/* Copy it, so we don't kprintf with a spinlock held */
+		spinlock_acquire(&bio_lock);
+		bs = bio_devstats[i];
+		spinlock_release(&bio_lock);
+
+		kprintf("Device %u: %u reads, %u writes, %u errors, "
+			"%llu bytes\n", bs.bs_dev->d_devnumber,
+			bs.bs_reads, bs.bs_writes, bs.bs_errors,
+			bs.bs_bytes);
+		kprintf("    queue depth %u (max %u), average latency "
+			"%llu us\n", bs.bs_inflight, bs.bs_maxinflight,
+			bs.bs_reads + bs.bs_writes == 0 ? 0ULL :
+			bs.bs_nsecs / 1000 / (bs.bs_reads + bs.bs_writes));
+		for (j=0; j<BIO_NHIST; j++) {
+			if (bs.bs_hist[j] == 0) {
+				continue;
+			}
+			if (j == BIO_NHIST - 1) {
+				kprintf("    >= %7u us: %u\n",
+					1U << j, bs.bs_hist[j]);
+			}
+			else {
+				kprintf("    < %8u us: %u\n",
+					2U << j, bs.bs_hist[j]);
+			}
+		}
+	}
+	if (n == 0) {
+		kprintf("No block I/O yet\n");
+	}
+}
+
+/*
+ * Setup function.
+ */
+void
+bio_bootstrap(void)
+{
+	bio_wchan = wchan_create("bio");
+	if (bio_wchan == NULL) {
+		panic("bio: Could not create wchan\n");
+	}
+}
@@ -0,0 +1,1032 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Block buffer cache.
+ *
+ * All buffers live on one LRU list (least recently used at the head)
+ * and on one hash chain keyed by (device, block). Everything is
+ * protected by buffer_lock, except the contents of the buffers
+ * themselves, which belong to whoever holds a reference. Disk I/O is
+ * done without buffer_lock held; while it is in progress the buffer
+ * is marked busy and anyone else who wants it waits on buffer_cv.
+ *
+ * Readahead is the exception: nobody waits for it when it's started,
+ * so the buffer stays busy, with the bio in b_bio, until some thread
+ * that needs the buffer (or wants to evict it) collects the result.
+ *
+ * Dirty buffers are written back by the flusher thread, which wakes
+ * up once every BUFFER_FLUSH_INTERVAL and writes out anything that
+ * has been dirty for longer than BUFFER_FLUSH_AGE. It is also kicked
+ * when more than BUFFER_DIRTY_HIGH percent of the cache is dirty, in
+ * which case it writes back least recently used buffers until no
+ * more than BUFFER_DIRTY_LOW percent are. Since the flusher's timer
+ * fires in interrupt context, it sleeps on a wchan rather than on
+ * buffer_cv.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <clock.h>
+#include <thread.h>
+#include <current.h>
+#include <uio.h>
+#include <device.h>
+#include <bio.h>
+#include <buf.h>
+
+#define BUFFER_HASHSIZE	127
+
+/* Flusher parameters. */
+#define BUFFER_FLUSH_INTERVAL	1000000000ULL	/* 1 s between passes */
+#define BUFFER_FLUSH_AGE	5000000000ULL	/* write back after 5 s */
+#define BUFFER_DIRTY_HIGH	50		/* percent: start flushing */
+#define BUFFER_DIRTY_LOW	25		/* percent: stop flushing */
+
+struct buf {
+	struct device *b_dev;		/* device, or NULL if unused */
+	daddr_t b_block;		/* block number on b_dev */
+	void *b_data;			/* BUFFER_SIZE bytes of data */
+	unsigned b_refcount;		/* number of holders */
+	bool b_valid;			/* b_data holds the block's contents */
+	bool b_dirty;			/* b_data is newer than the disk */
+	uint64_t b_dirtytime;		/* when b_dirty was last set */
+	unsigned b_flushpass;		/* last flusher pass to write it */
+	bool b_busy;			/* I/O in progress */
+	struct thread *b_filler;	/* buffer_get caller filling it in */
+	struct bio *b_bio;		/* readahead in flight, or NULL */
+	bool b_biowait;			/* someone is collecting b_bio */
+	struct buf *b_hashnext;		/* hash chain */
+	struct buf *b_lruprev;		/* LRU list */
+	struct buf *b_lrunext;
+};
+
+static struct lock *buffer_lock;
+static struct cv *buffer_cv;
+
+static struct buf *buffer_hash[BUFFER_HASHSIZE];
+static struct buf *buffer_lruhead;
+static struct buf *buffer_lrutail;
+
+static unsigned buffer_num;		/* buffers allocated */
+static unsigned buffer_max;		/* target max buffers */
+static unsigned buffer_ndirty;		/* dirty buffers */
+
+/* Flusher wakeups. */
+static struct spinlock buffer_flushspin;
+static struct wchan *buffer_flushwchan;
+static bool buffer_flushwanted;		/* protected by buffer_flushspin */
+static struct timeout buffer_flushtimeout;
+static unsigned buffer_flushpassno;	/* protected by buffer_lock */
+
+/* Statistics. */
+static unsigned buffer_hits;
+static unsigned buffer_misses;
+static unsigned buffer_reads;
+static unsigned buffer_writes;
+static unsigned buffer_evictions;
+static unsigned buffer_readaheads;
+static unsigned buffer_flushes;
+
+////////////////////////////////////////////////////////////
+//
+// Lists
+
+static
+unsigned
+buffer_hashfunc(struct device *dev, daddr_t block)
+{
+	return (block + dev->d_devnumber * 31U) % BUFFER_HASHSIZE;
+}
+
+static
+struct buf *
+buffer_find(struct device *dev, daddr_t block)
+{
+	struct buf *b;
+
+	for (b = buffer_hash[buffer_hashfunc(dev, block)];
+	     b != NULL;
+	     b = b->b_hashnext) {
+		if (b->b_dev == dev && b->b_block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+buffer_hash_insert(struct buf *b)
+{
+	unsigned slot;
+
+	slot = buffer_hashfunc(b->b_dev, b->b_block);
+	b->b_hashnext = buffer_hash[slot];
+	buffer_hash[slot] = b;
+}
+
+static
+void
+buffer_hash_remove(struct buf *b)
+{
+	struct buf **bp;
+
+	bp = &buffer_hash[buffer_hashfunc(b->b_dev, b->b_block)];
+	while (*bp != b) {
+		KASSERT(*bp != NULL);
+		bp = &(*bp)->b_hashnext;
+	}
+	*bp = b->b_hashnext;
+	b->b_hashnext = NULL;
+}
+
+static
+void
+buffer_lru_remove(struct buf *b)
+{
+	if (b->b_lruprev != NULL) {
+		b->b_lruprev->b_lrunext = b->b_lrunext;
+	}
+	else {
+		buffer_lruhead = b->b_lrunext;
+	}
+	if (b->b_lrunext != NULL) {
+		b->b_lrunext->b_lruprev = b->b_lruprev;
+	}
+	else {
+		buffer_lrutail = b->b_lruprev;
+	}
+	b->b_lruprev = b->b_lrunext = NULL;
+}
+
+static
+void
+buffer_lru_append(struct buf *b)
+{
+	b->b_lruprev = buffer_lrutail;
+	b->b_lrunext = NULL;
+	if (buffer_lrutail != NULL) {
+		buffer_lrutail->b_lrunext = b;
+	}
+	else {
+		buffer_lruhead = b;
+	}
+	buffer_lrutail = b;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Creation and destruction
+
+static
+struct buf *
+buffer_create(void)
+{
+	struct buf *b;
+
+	b = kmalloc(sizeof(*b));
+	if (b == NULL) {
+		return NULL;
+	}
+	b->b_data = kmalloc(BUFFER_SIZE);
+	if (b->b_data == NULL) {
+		kfree(b);
+		return NULL;
+	}
+	b->b_dev = NULL;
+	b->b_block = 0;
+	b->b_refcount = 0;
+	b->b_valid = false;
+	b->b_dirty = false;
+	b->b_dirtytime = 0;
+	b->b_flushpass = 0;
+	b->b_busy = false;
+	b->b_filler = NULL;
+	b->b_bio = NULL;
+	b->b_biowait = false;
+	b->b_hashnext = NULL;
+	b->b_lruprev = b->b_lrunext = NULL;
+	buffer_num++;
+	return b;
+}
+
+/*
+ * Take an unreferenced, clean buffer out of the cache and free it.
+ */
+static
+void
+buffer_destroy(struct buf *b)
+{
+	KASSERT(b->b_refcount == 0);
+	KASSERT(!b->b_dirty);
+	KASSERT(!b->b_busy);
+
+	buffer_hash_remove(b);
+	buffer_lru_remove(b);
+	kfree(b->b_data);
+	kfree(b);
+	KASSERT(buffer_num > 0);
+	buffer_num--;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Disk I/O
+
+/*
+ * Read or write a buffer, retrying I/O errors. Other I/O, including
+ * to the same device, can proceed while we wait. Called without
+ * buffer_lock held, with the buffer marked busy.
+ */
+static
+int
+buffer_devio(struct buf *b, enum uio_rw rw)
+{
+	struct bio bio;
+	int result;
+	int tries = 0;
+
+	KASSERT(b->b_busy);
+
+	DEBUG(DB_VFS, "buffer: %s %u\n",
+	      rw == UIO_READ ? "read" : "write", b->b_block);
+
+ retry:
+	bio_init(&bio, b->b_dev, rw, b->b_block, b->b_data, BUFFER_SIZE);
+	bio_submit(&bio);
+	result = bio_wait(&bio);
+	if (result == EINVAL) {
+		/*
+		 * This means the sector we requested was out of range,
+		 * or the seek address we gave wasn't sector-aligned,
+		 * or a couple of other things that are the caller's
+		 * fault.
+		 */
+		panic("buffer: block %u: I/O failed with EINVAL\n",
+		      b->b_block);
+	}
+	if (result == EIO) {
+		if (tries == 0) {
+			tries++;
+			kprintf("buffer: block %u I/O error, retrying\n",
+				b->b_block);
+			goto retry;
+		}
+		else if (tries < 10) {
+			tries++;
+			goto retry;
+		}
+		else {
+			kprintf("buffer: block %u I/O error, giving up "
+				"after %d retries\n", b->b_block, tries);
+		}
+	}
+	return result;
+}
+
+/*
+ * Write a dirty buffer back to disk. The caller holds buffer_lock and
+ * a reference to the buffer; buffer_lock is dropped during the I/O.
+ */
+static
+int
+buffer_writeout(struct buf *b)
+{
+	int result;
+
+	KASSERT(lock_do_i_hold(buffer_lock));
+	KASSERT(b->b_refcount > 0);
+	KASSERT(b->b_dirty);
+	KASSERT(!b->b_busy);
+
+	/*
+	 * Clear the dirty flag before starting, so that if the buffer
+	 * is changed again while the write is in flight it stays dirty.
+	 */
+	b->b_busy = true;
+	b->b_dirty = false;
+	buffer_ndirty--;
+	buffer_writes++;
+
+	lock_release(buffer_lock);
+	result = buffer_devio(b, UIO_WRITE);
+	lock_acquire(buffer_lock);
+
+	b->b_busy = false;
+	if (result && !b->b_dirty) {
+		b->b_dirty = true;
+		b->b_dirtytime = clock_nsecs();
+		buffer_ndirty++;
+	}
+	cv_broadcast(buffer_cv, buffer_lock);
+	return result;
+}
+
+/*
+ * Finish off a readahead whose I/O is complete: note the result and
+ * make the buffer available.
+ */
+static
+void
+buffer_finishra(struct buf *b)
+{
+	struct bio *bio = b->b_bio;
+
+	KASSERT(lock_do_i_hold(buffer_lock));
+	KASSERT(bio != NULL);
+	KASSERT(b->b_busy);
+
+	b->b_valid = (bio->bio_result == 0);
+	b->b_bio = NULL;
+	b->b_biowait = false;
+	b->b_busy = false;
+	kfree(bio);
+	cv_broadcast(buffer_cv, buffer_lock);
+}
+
+/*
+ * Collect a readahead if it has finished, without waiting.
+ */
+static
+void
+buffer_reapra(struct buf *b)
+{
+	if (b->b_bio != NULL && !b->b_biowait && bio_iscomplete(b->b_bio)) {
+		buffer_finishra(b);
+	}
+}
+
+/*
+ * Wait until a buffer isn't busy. The caller holds buffer_lock and a
+ * reference to the buffer. If it's busy with a readahead that nobody
+ * is collecting yet, collect it ourselves.
+ */
+static
+void
+buffer_waitbusy(struct buf *b)
+{
+	struct bio *bio;
+
+	KASSERT(lock_do_i_hold(buffer_lock));
+	KASSERT(b->b_refcount > 0);
+
+	while (b->b_busy) {
+		if (b->b_bio != NULL && !b->b_biowait) {
+			bio = b->b_bio;
+			b->b_biowait = true;
+			lock_release(buffer_lock);
+			bio_wait(bio);
+			lock_acquire(buffer_lock);
+			buffer_finishra(b);
+		}
+		else {
+			cv_wait(buffer_cv, buffer_lock);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Flusher wakeups
+
+/*
+ * Wake the flusher. May be called from interrupt context.
+ */
+static
+void
+buffer_flushkick(void)
+{
+	spinlock_acquire(&buffer_flushspin);
+	buffer_flushwanted = true;
+	wchan_wakeone(buffer_flushwchan, &buffer_flushspin);
+	spinlock_release(&buffer_flushspin);
+}
+
+/*
+ * Timeout function for the flusher's periodic pass.
+ */
+static
+void
+buffer_flushtick(void *unused)
+{
+	(void)unused;
+	buffer_flushkick();
+}
+
+////////////////////////////////////////////////////////////
+//
+// Lookup
+
+/*
+ * Find a buffer we can reuse: the least recently used one that
+ * nobody holds. If it's dirty, write it back first; since that drops
+ * buffer_lock, return EAGAIN so the caller starts over. If CANWRITE
+ * is false, only consider clean buffers. Returns ENOSPC if there's
+ * no suitable buffer.
+ */
+static
+int
+buffer_evict(struct buf **ret, bool canwrite)
+{
+	struct buf *b;
+	int result;
+
+	for (b = buffer_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_refcount == 0) {
+			buffer_reapra(b);
+			if (!b->b_busy && (canwrite || !b->b_dirty)) {
+				break;
+			}
+		}
+	}
+	if (b == NULL) {
+		return ENOSPC;
+	}
+
+	if (b->b_dirty) {
+		b->b_refcount++;
+		result = buffer_writeout(b);
+		b->b_refcount--;
+		return result ? result : EAGAIN;
+	}
+
+	buffer_evictions++;
+	buffer_hash_remove(b);
+	buffer_lru_remove(b);
+	b->b_dev = NULL;
+	b->b_valid = false;
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Common code for buffer_read and buffer_get.
+ */
+static
+int
+buffer_lookup(struct device *dev, daddr_t block, bool doread,
+	      struct buf **ret)
+{
+	struct buf *b;
+	int result;
+
+	KASSERT(dev->d_blocksize == BUFFER_SIZE);
+
+	lock_acquire(buffer_lock);
+
+ again:
+	b = buffer_find(dev, block);
+	if (b != NULL) {
+		buffer_hits++;
+		b->b_refcount++;
+
+		/*
+		 * If someone else got it with buffer_get and hasn't
+		 * filled it in yet, wait for them to finish (or give
+		 * up, in which case we take over) rather than reading
+		 * or zeroing it under them.
+		 */
+		KASSERT(b->b_filler != curthread);
+		buffer_waitbusy(b);
+		while (b->b_filler != NULL) {
+			cv_wait(buffer_cv, buffer_lock);
+			buffer_waitbusy(b);
+		}
+	}
+	else {
+		buffer_misses++;
+		if (buffer_num < buffer_max) {
+			b = buffer_create();
+			result = b == NULL ? ENOMEM : 0;
+		}
+		else {
+			result = buffer_evict(&b, true);
+		}
+		if (result == ENOMEM || result == ENOSPC) {
+			/*
+			 * Everything is held (or we're out of memory
+			 * for a new buffer, in which case try to reuse
+			 * one). Go over the limit rather than waiting;
+			 * the excess is trimmed in buffer_release.
+			 */
+			b = buffer_create();
+			if (b == NULL) {
+				result = buffer_evict(&b, true);
+			}
+			else {
+				result = 0;
+			}
+		}
+		if (result == EAGAIN) {
+			/* The block may have shown up meanwhile. */
+			buffer_misses--;
+			goto again;
+		}
+		if (result) {
+			lock_release(buffer_lock);
+			return result;
+		}
+
+		b->b_dev = dev;
+		b->b_block = block;
+		b->b_refcount = 1;
+		buffer_hash_insert(b);
+	}
+
+	/* Move to the most-recently-used end */
+	if (b->b_lruprev != NULL || b->b_lrunext != NULL ||
+	    buffer_lruhead == b) {
+		buffer_lru_remove(b);
+	}
+	buffer_lru_append(b);
+
+	if (doread && !b->b_valid) {
+		b->b_busy = true;
+		buffer_reads++;
+		lock_release(buffer_lock);
+		result = buffer_devio(b, UIO_READ);
+		lock_acquire(buffer_lock);
+		b->b_busy = false;
+		cv_broadcast(buffer_cv, buffer_lock);
+		if (result) {
+			b->b_refcount--;
+			lock_release(buffer_lock);
+			return result;
+		}
+		b->b_valid = true;
+	}
+	else if (!b->b_valid) {
+		/* buffer_get on an uncached block; don't hand out garbage */
+		bzero(b->b_data, BUFFER_SIZE);
+		b->b_filler = curthread;
+	}
+
+	lock_release(buffer_lock);
+	*ret = b;
+	return 0;
+}
+
+int
+buffer_read(struct device *dev, daddr_t block, struct buf **ret)
+{
+	return buffer_lookup(dev, block, true, ret);
+}
+
+int
+buffer_get(struct device *dev, daddr_t block, struct buf **ret)
+{
+	return buffer_lookup(dev, block, false, ret);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Operations on held buffers
+
+void *
+buffer_map(struct buf *b)
+{
+	KASSERT(b->b_refcount > 0);
+	return b->b_data;
+}
+
+bool
+buffer_isvalid(struct buf *b)
+{
+	bool ret;
+
+	lock_acquire(buffer_lock);
+	KASSERT(b->b_refcount > 0);
+	ret = b->b_valid;
+	lock_release(buffer_lock);
+	return ret;
+}
+
+/*
+ * Note that the buffer has been changed. This also makes it valid,
+ * which is what completes a buffer_get.
+ *
+ * The buffer's age for flushing purposes counts from the first
+ * change since it was last written, so a buffer that's being
+ * appended to continually still goes out every BUFFER_FLUSH_AGE.
+ */
+void
+buffer_markdirty(struct buf *b)
+{
+	bool kick = false;
+
+	lock_acquire(buffer_lock);
+	KASSERT(b->b_refcount > 0);
+	if (!b->b_dirty) {
+		b->b_dirty = true;
+		b->b_dirtytime = clock_nsecs();
+		buffer_ndirty++;
+		kick = buffer_ndirty * 100 > buffer_max * BUFFER_DIRTY_HIGH;
+	}
+	b->b_valid = true;
+	if (b->b_filler != NULL) {
+		/* Others may be waiting in buffer_lookup for this */
+		b->b_filler = NULL;
+		cv_broadcast(buffer_cv, buffer_lock);
+	}
+	lock_release(buffer_lock);
+
+	if (kick) {
+		buffer_flushkick();
+	}
+}
+
+void
+buffer_release(struct buf *b)
+{
+	lock_acquire(buffer_lock);
+	KASSERT(b->b_refcount > 0);
+	b->b_refcount--;
+	if (b->b_filler == curthread) {
+		/* An unfinished buffer_get; let a waiter take it over */
+		KASSERT(!b->b_valid);
+		b->b_filler = NULL;
+		cv_broadcast(buffer_cv, buffer_lock);
+	}
+	if (b->b_refcount == 0 && buffer_num > buffer_max &&
+	    !b->b_dirty && !b->b_busy) {
+		/* Trim back down after going over the limit */
+		buffer_destroy(b);
+	}
+	lock_release(buffer_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Per-device and global operations
+
+/*
+ * Start reading BLOCK into the cache in the background, if it isn't
+ * there already. This is only a hint: if there's no buffer to spare
+ * without writing something back, or no memory, nothing happens.
+ */
+void
+buffer_readahead(struct device *dev, daddr_t block)
+{
+	struct buf *b;
+	struct bio *bio;
+	int result;
+
+	KASSERT(dev->d_blocksize == BUFFER_SIZE);
+
+	bio = kmalloc(sizeof(*bio));
+	if (bio == NULL) {
+		return;
+	}
+
+	lock_acquire(buffer_lock);
+	if (buffer_find(dev, block) != NULL) {
+		/* Cached, or on its way */
+		lock_release(buffer_lock);
+		kfree(bio);
+		return;
+	}
+	if (buffer_num < buffer_max) {
+		b = buffer_create();
+		result = b == NULL ? ENOMEM : 0;
+	}
+	else {
+		result = buffer_evict(&b, false);
+	}
+	if (result) {
+		lock_release(buffer_lock);
+		kfree(bio);
+		return;
+	}
+
+	b->b_dev = dev;
+	b->b_block = block;
+	b->b_refcount = 0;
+	b->b_busy = true;
+	b->b_bio = bio;
+	buffer_hash_insert(b);
+	buffer_lru_append(b);
+	buffer_readaheads++;
+
+	bio_init(bio, dev, UIO_READ, block, b->b_data, BUFFER_SIZE);
+	lock_release(buffer_lock);
+
+	/* Anyone who finds the buffer meanwhile will wait for this */
+	bio_submit(bio);
+}
+
+/*
+ * Forget about a block that's being freed. Any pending write is
+ * thrown away; there's no point writing garbage to a free block.
+ */
+void
+buffer_drop(struct device *dev, daddr_t block)
+{
+	struct buf *b;
+
+	lock_acquire(buffer_lock);
+	b = buffer_find(dev, block);
+	if (b != NULL) {
+		b->b_refcount++;
+		buffer_waitbusy(b);
+		b->b_refcount--;
+		if (b->b_dirty) {
+			b->b_dirty = false;
+			buffer_ndirty--;
+		}
+		b->b_valid = false;
+		if (b->b_refcount == 0) {
+			buffer_destroy(b);
+		}
+	}
+	lock_release(buffer_lock);
+}
+
+/*
+ * Write back every dirty buffer belonging to DEV. Since writing drops
+ * buffer_lock, and the list may change meanwhile, rescan from the
+ * top after each write.
+ */
+int
+buffer_sync(struct device *dev)
+{
+	struct buf *b;
+	int result;
+
+	lock_acquire(buffer_lock);
+ again:
+	for (b = buffer_lruhead; b != NULL; b = b->b_lrunext) {
+		if (b->b_dev != dev || !b->b_dirty) {
+			continue;
+		}
+		b->b_refcount++;
+		if (b->b_busy) {
+			buffer_waitbusy(b);
+			b->b_refcount--;
+			goto again;
+		}
+		result = buffer_writeout(b);
+		b->b_refcount--;
+		if (result) {
+			lock_release(buffer_lock);
+			return result;
+		}
+		goto again;
+	}
+	lock_release(buffer_lock);
+	return 0;
+}
+
+/*
+ * Write back BLOCK on DEV if it's cached and dirty. This is for
+ * fsync, which needs particular blocks on disk now rather than
+ * whenever the flusher gets to them.
+ */
+int
+buffer_syncblock(struct device *dev, daddr_t block)
+{
+	struct buf *b;
+	int result = 0;
+
+	lock_acquire(buffer_lock);
+	b = buffer_find(dev, block);
+	if (b != NULL && (b->b_dirty || b->b_busy)) {
+		b->b_refcount++;
+		/* If a write is already in flight, wait and check again */
+		buffer_waitbusy(b);
+		if (b->b_dirty) {
+			result = buffer_writeout(b);
+		}
+		b->b_refcount--;
+	}
+	lock_release(buffer_lock);
+	return result;
+}
+
+/*
+ * Discard all buffers for DEV. Everything must already be synced and
+ * released; but there may still be readaheads in flight.
+ */
+void
+buffer_flushdev(struct device *dev)
+{
+	struct buf *b, *next;
+
+	lock_acquire(buffer_lock);
+ again:
+	for (b = buffer_lruhead; b != NULL; b = next) {
+		next = b->b_lrunext;
+		if (b->b_dev != dev) {
+			continue;
+		}
+		if (b->b_busy) {
+			b->b_refcount++;
+			buffer_waitbusy(b);
+			b->b_refcount--;
+			goto again;
+		}
+		buffer_destroy(b);
+	}
+	lock_release(buffer_lock);
+}
+
+/*
+ * Set the maximum number of buffers. If shrinking, free unused clean
+ * buffers now; anything else gets trimmed as it's released.
+ */
+int
+buffer_setmax(unsigned maxbufs)
+{
+	struct buf *b, *next;
+
+	if (maxbufs < BUFFER_MIN) {
+		return EINVAL;
+	}
+
+	lock_acquire(buffer_lock);
+	buffer_max = maxbufs;
+	for (b = buffer_lruhead; b != NULL && buffer_num > buffer_max;
+	     b = next) {
+		next = b->b_lrunext;
+		if (b->b_refcount == 0 && !b->b_dirty && !b->b_busy) {
+			buffer_destroy(b);
+		}
+	}
+	lock_release(buffer_lock);
+	return 0;
+}
+
+void
+buffer_printstats(void)
+{
+	unsigned lookups;
+
+	lock_acquire(buffer_lock);
+	lookups = buffer_hits + buffer_misses;
+	kprintf("Buffer cache: %u/%u buffers (%u bytes each), %u dirty\n",
+		buffer_num, buffer_max, BUFFER_SIZE, buffer_ndirty);
+	kprintf("    %u lookups, %u hits, %u misses (%u%% hit rate)\n",
+		lookups, buffer_hits, buffer_misses,
+		lookups ? buffer_hits * 100 / lookups : 0);
+	kprintf("    %u reads, %u readaheads, %u writes, %u evictions\n",
+		buffer_reads, buffer_readaheads, buffer_writes,
+		buffer_evictions);
+	kprintf("    %u writes by the flusher\n", buffer_flushes);
+	lock_release(buffer_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Flusher
+
+/*
+ * One flusher pass: write back every unheld buffer that's older than
+ * BUFFER_FLUSH_AGE, and if too much of the cache is dirty, write back
+ * unheld buffers in LRU order until enough isn't. Each buffer is
+ * tried at most once per pass, so write errors are left for the next
+ * pass (the buffer stays dirty).
+ */
+static
+void
+buffer_flushpass(void)
+{
+	struct buf *b;
+	uint64_t now;
+	bool toomany;
+	int result;
+
+	lock_acquire(buffer_lock);
+	now = clock_nsecs();
+	buffer_flushpassno++;
+	toomany = buffer_ndirty * 100 > buffer_max * BUFFER_DIRTY_HIGH;
+ again:
+	if (toomany && buffer_ndirty * 100 <= buffer_max * BUFFER_DIRTY_LOW) {
+		toomany = false;
+	}
+	for (b = buffer_lruhead; b != NULL; b = b->b_lrunext) {
+		if (!b->b_dirty || b->b_busy || b->b_refcount > 0 ||
+		    b->b_flushpass == buffer_flushpassno) {
+			continue;
+		}
+		/* (dirtied since the pass began is not old either) */
+		if (!toomany && (b->b_dirtytime > now ||
+				 now - b->b_dirtytime < BUFFER_FLUSH_AGE)) {
+			continue;
+		}
+		b->b_flushpass = buffer_flushpassno;
+		b->b_refcount++;
+		result = buffer_writeout(b);
+		b->b_refcount--;
+		if (result == 0) {
+			buffer_flushes++;
+		}
+		/* buffer_writeout dropped the lock; start over */
+		goto again;
+	}
+	lock_release(buffer_lock);
+}
+
+/*
+ * Flusher thread.
+ */
+static
+void
+buffer_flusher(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
+
+	while (1) {
+		/*
+		 * Rearm the periodic timer. If the pass was triggered
+		 * by buffer_markdirty, the timer may still be pending;
+		 * restart it so passes stay one interval apart.
+		 */
+		untimeout(&buffer_flushtimeout);
+		timeout(&buffer_flushtimeout, buffer_flushtick, NULL,
+			BUFFER_FLUSH_INTERVAL);
+
+		spinlock_acquire(&buffer_flushspin);
+		while (!buffer_flushwanted) {
+			wchan_sleep(buffer_flushwchan, &buffer_flushspin);
+		}
+		buffer_flushwanted = false;
+		spinlock_release(&buffer_flushspin);
+
+		buffer_flushpass();
+	}
+}
+
+/*
+ * Start the flusher. This is separate from buffer_bootstrap because
+ * it needs the timer, which isn't available until after the devices
+ * have been probed.
+ */
+void
+buffer_startflusher(void)
+{
+	int result;
+
+	result = thread_fork("bufflush", NULL, buffer_flusher, NULL, 0);
+	if (result) {
+		panic("buffer: Could not start flusher: %s\n",
+		      strerror(result));
+	}
+}
+
+/*
+ * Setup function.
+ */
+void
+buffer_bootstrap(void)
+{
+	buffer_lock = lock_create("buffer cache");
+	if (buffer_lock == NULL) {
+		panic("buffer: Could not create lock\n");
+	}
+	buffer_cv = cv_create("buffer cache");
+	if (buffer_cv == NULL) {
+		panic("buffer: Could not create cv\n");
+	}
+	buffer_lruhead = buffer_lrutail = NULL;
+	buffer_num = 0;
+	buffer_max = BUFFER_DEFAULT_MAX;
+	buffer_ndirty = 0;
+
+	spinlock_init(&buffer_flushspin);
+	buffer_flushwchan = wchan_create("bufflush");
+	if (buffer_flushwchan == NULL) {
+		panic("buffer: Could not create wchan\n");
+	}
+	buffer_flushwanted = false;
+	timeout_init(&buffer_flushtimeout);
+}
@@ -150,6 +150,22 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return DEVOP_IOCTL(d, op, data);
 }
 
+/*
+ * Called for poll(). Devices that can block provide devop_poll; the
+ * rest are always ready.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, int *revents, struct pollwaiter *pw)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vopnop_poll(v, events, revents, pw);
+	}
+	return DEVOP_POLL(d, events, revents, pw);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -331,11 +347,15 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = dev_write,
+	.vop_append = vopfail_uio_inval,
 	.vop_ioctl = dev_ioctl,
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
 	.vop_fsync = null_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = dev_poll,
 	.vop_mmap = dev_mmap,
 	.vop_truncate = dev_truncate,
 	.vop_namefile = dev_namefile,
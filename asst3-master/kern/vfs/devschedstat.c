@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Implementation of the scheduler statistics device, "schedstat:".
+ * Reading it yields a text snapshot of the per-cpu and per-thread
+ * scheduling counters, the same as the "ss" menu command prints.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <uio.h>
+#include <thread.h>
+#include <vfs.h>
+#include <device.h>
+
+/* For open(): allow reading only */
+static
+int
+schedstatopen(struct device *dev, int openflags)
+{
+	(void)dev;
+
+	if (openflags != O_RDONLY) {
+		return EIO;
+	}
+
+	return 0;
+}
+
+/*
+ * For d_io(). Each read takes a fresh snapshot and returns the part
+ * of it at the requested offset, so reading the device sequentially
+ * works as long as nothing changes much in between.
+ */
+static
+int
+schedstatio(struct device *dev, struct uio *uio)
+{
+	char *buf;
+	size_t len;
+	int result;
+
+	(void)dev;
+
+	if (uio->uio_rw != UIO_READ) {
+		return EIO;
+	}
+
+	buf = kmalloc(THREAD_STATS_BUFSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	len = thread_formatstats(buf, THREAD_STATS_BUFSIZE);
+
+	if (uio->uio_offset >= (off_t)len) {
+		/* EOF */
+		kfree(buf);
+		return 0;
+	}
+	result = uiomove(buf + uio->uio_offset, len - uio->uio_offset, uio);
+	kfree(buf);
+	return result;
+}
+
+/* For ioctl() */
+static
+int
+schedstatioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EIOCTL;
+}
+
+static const struct device_ops schedstat_devops = {
+	.devop_eachopen = schedstatopen,
+	.devop_io = schedstatio,
+	.devop_ioctl = schedstatioctl,
+};
+
+/*
+ * Function to create and attach schedstat:
+ */
+void
+devschedstat_create(void)
+{
+	int result;
+	struct device *dev;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev==NULL) {
+		panic("Could not add schedstat device: out of memory\n");
+	}
+
+	dev->d_ops = &schedstat_devops;
+
+	/*
+	 * Make it seekable, so reads go at the file offset and a
+	 * sequential reader reaches EOF. One byte more than the
+	 * largest snapshot, so reading at the end of a full one gets
+	 * EOF rather than EINVAL from dev_tryseek.
+	 */
+	dev->d_blocks = THREAD_STATS_BUFSIZE + 1;
+	dev->d_blocksize = 1;
+
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+
+	dev->d_data = NULL;
+
+	result = vfs_adddev("schedstat", dev, 0);
+	if (result) {
+		panic("Could not add schedstat device: %s\n",
+		      strerror(result));
+	}
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Disk I/O scheduling. See iosched.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <iosched.h>
+
+struct iosched_ops {
+	const char *iso_name;
+	/* Pick (but don't unlink) the next request; queue is nonempty */
+	struct iosched_req *(*iso_choose)(struct iosched *is);
+	/* Whether to merge adjacent requests */
+	bool iso_merge;
+};
+
+/* All the schedulers in the system, for iosched_set and stats. */
+static struct spinlock iosched_listlock = SPINLOCK_INITIALIZER;
+static struct iosched *iosched_list;
+
+////////////////////////////////////////////////////////////
+//
+// Policies
+
+/*
+ * FIFO: first come, first served.
+ */
+static
+struct iosched_req *
+fifo_choose(struct iosched *is)
+{
+	return is->is_head;
+}
+
+/*
+ * Elevator: C-LOOK, with a deadline check first.
+ */
+static
+struct iosched_req *
+elevator_choose(struct iosched *is)
+{
+	struct iosched_req *ir, *best, *lowest, *expired;
+	uint64_t now;
+
+	/*
+	 * Reads and writes expire after different times, so the
+	 * oldest request isn't necessarily the most overdue one; look
+	 * at all of them. Meanwhile find the closest request at or
+	 * beyond the head position, and the lowest one overall in
+	 * case there isn't one.
+	 */
+	now = clock_nsecs();
+	best = lowest = expired = NULL;
+	for (ir = is->is_head; ir != NULL; ir = ir->ir_next) {
+		if (ir->ir_deadline <= now &&
+		    (expired == NULL ||
+		     ir->ir_deadline < expired->ir_deadline)) {
+			expired = ir;
+		}
+		if (ir->ir_sector >= is->is_headpos &&
+		    (best == NULL || ir->ir_sector < best->ir_sector)) {
+			best = ir;
+		}
+		if (lowest == NULL || ir->ir_sector < lowest->ir_sector) {
+			lowest = ir;
+		}
+	}
+	if (expired != NULL) {
+		is->is_expired++;
+		return expired;
+	}
+	return best != NULL ? best : lowest;
+}
+
+static const struct iosched_ops iosched_policies[] = {
+	{ "fifo",	fifo_choose,		false },
+	{ "elevator",	elevator_choose,	true },
+};
+#define NPOLICIES (sizeof(iosched_policies) / sizeof(iosched_policies[0]))
+
+/* The default */
+#define IOSCHED_DEFAULT (&iosched_policies[1])
+
+////////////////////////////////////////////////////////////
+//
+// Queue operations
+
+/*
+ * Set up a scheduler and make it known by NAME.
+ */
+void
+iosched_init(struct iosched *is, const char *name, struct spinlock *lock)
+{
+	is->is_name = name;
+	is->is_ops = IOSCHED_DEFAULT;
+	is->is_lock = lock;
+	is->is_head = is->is_tail = NULL;
+	is->is_headpos = 0;
+	is->is_queued = 0;
+	is->is_dispatched = 0;
+	is->is_mergecount = 0;
+	is->is_expired = 0;
+	is->is_maxqueued = 0;
+
+	spinlock_acquire(&iosched_listlock);
+	is->is_nextsched = iosched_list;
+	iosched_list = is;
+	spinlock_release(&iosched_listlock);
+}
+
+/*
+ * Queue a request, merging it onto the end of a pending one if the
+ * policy allows and the sectors line up.
+ */
+void
+iosched_add(struct iosched *is, struct iosched_req *ir)
+{
+	struct iosched_req *q, *tail;
+
+	KASSERT(spinlock_do_i_hold(is->is_lock));
+	KASSERT(ir->ir_nsect > 0);
+
+	ir->ir_deadline = clock_nsecs() + (ir->ir_rw == UIO_READ ?
+		IOSCHED_READ_EXPIRE : IOSCHED_WRITE_EXPIRE);
+	ir->ir_next = NULL;
+	ir->ir_merged = NULL;
+	ir->ir_mergetail = ir;
+	ir->ir_nmerged = 1;
+
+	is->is_queued++;
+	if (is->is_queued > is->is_maxqueued) {
+		is->is_maxqueued = is->is_queued;
+	}
+
+	if (is->is_ops->iso_merge) {
+		for (q = is->is_head; q != NULL; q = q->ir_next) {
+			tail = q->ir_mergetail;
+			if (q->ir_rw == ir->ir_rw &&
+			    q->ir_nmerged < IOSCHED_MAXMERGE &&
+			    tail->ir_sector + tail->ir_nsect == ir->ir_sector) {
+				tail->ir_merged = ir;
+				q->ir_mergetail = ir;
+				q->ir_nmerged++;
+				is->is_mergecount++;
+				return;
+			}
+		}
+	}
+
+	if (is->is_tail == NULL) {
+		is->is_head = ir;
+	}
+	else {
+		is->is_tail->ir_next = ir;
+	}
+	is->is_tail = ir;
+}
+
+/*
+ * Choose the next request to start and take it off the queue.
+ * Returns NULL if there's nothing to do.
+ */
+struct iosched_req *
+iosched_next(struct iosched *is)
+{
+	struct iosched_req *ir, **irp, *prev;
+
+	KASSERT(spinlock_do_i_hold(is->is_lock));
+
+	if (is->is_head == NULL) {
+		return NULL;
+	}
+
+	ir = is->is_ops->iso_choose(is);
+	KASSERT(ir != NULL);
+
+	/* Unlink it */
+	prev = NULL;
+	irp = &is->is_head;
+	while (*irp != ir) {
+		KASSERT(*irp != NULL);
+		prev = *irp;
+		irp = &(*irp)->ir_next;
+	}
+	*irp = ir->ir_next;
+	if (is->is_tail == ir) {
+		is->is_tail = prev;
+	}
+	ir->ir_next = NULL;
+
+	is->is_headpos = ir->ir_mergetail->ir_sector +
+		ir->ir_mergetail->ir_nsect;
+	KASSERT(is->is_queued >= ir->ir_nmerged);
+	is->is_queued -= ir->ir_nmerged;
+	is->is_dispatched += ir->ir_nmerged;
+	return ir;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Control
+
+/*
+ * Change the policy for device DEVNAME.
+ */
+int
+iosched_set(const char *devname, const char *policy)
+{
+	const struct iosched_ops *ops = NULL;
+	struct iosched *is;
+	unsigned i;
+
+	for (i=0; i<NPOLICIES; i++) {
+		if (!strcmp(iosched_policies[i].iso_name, policy)) {
+			ops = &iosched_policies[i];
+		}
+	}
+	if (ops == NULL) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&iosched_listlock);
+	for (is = iosched_list; is != NULL; is = is->is_nextsched) {
+		if (!strcmp(is->is_name, devname)) {
+			break;
+		}
+	}
+	if (is == NULL) {
+		spinlock_release(&iosched_listlock);
+		return ENODEV;
+	}
+	spinlock_acquire(is->is_lock);
+	is->is_ops = ops;
+	spinlock_release(is->is_lock);
+	spinlock_release(&iosched_listlock);
+
+	return 0;
+}
+
+void
+iosched_printstats(void)
+{
+	struct iosched *is;
+	const char *policy;
+	unsigned queued, maxqueued, dispatched, merged, expired;
+
+	/* Schedulers are never removed, so we can walk the list unlocked */
+	spinlock_acquire(&iosched_listlock);
+	is = iosched_list;
+	spinlock_release(&iosched_listlock);
+
+	for (; is != NULL; is = is->is_nextsched) {
+		spinlock_acquire(is->is_lock);
+		policy = is->is_ops->iso_name;
+		queued = is->is_queued;
+		maxqueued = is->is_maxqueued;
+		dispatched = is->is_dispatched;
+		merged = is->is_mergecount;
+		expired = is->is_expired;
+		spinlock_release(is->is_lock);
+
+		kprintf("%s: %s, %u queued (max %u), %u dispatched, "
+			"%u merged, %u past deadline\n", is->is_name, policy,
+			queued, maxqueued, dispatched, merged, expired);
+	}
+}
@@ -0,0 +1,739 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pipes. See pipe.h.
+ *
+ * The buffer is one page used as a ring. Readers are serialized
+ * among themselves by pi_readlock and writers by pi_writelock; that
+ * way only the holder of pi_readlock ever removes data and only the
+ * holder of pi_writelock ever adds it, so each can copy to or from
+ * its part of the ring (which may fault and sleep) without holding
+ * the spinlock. The spinlock only covers the ring indexes and the
+ * end flags, and is what the wait channels sleep on.
+ *
+ * Holding pi_writelock across a whole write also keeps writes from
+ * interleaving; on top of that, a write of PIPE_BUF bytes or fewer
+ * waits until there is room for all of it, so readers see it arrive
+ * in one piece.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/poll.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+#define PIPE_SIZE  PAGE_SIZE
+
+struct pipe {
+	struct vnode pi_readvn;		/* read end */
+	struct vnode pi_writevn;	/* write end */
+	char *pi_buf;			/* PIPE_SIZE bytes */
+	struct lock *pi_readlock;	/* serializes readers */
+	struct lock *pi_writelock;	/* serializes writers */
+
+	struct spinlock pi_lock;	/* protects the rest */
+	struct wchan *pi_readwchan;	/* readers waiting for data */
+	struct wchan *pi_writewchan;	/* writers waiting for space */
+	unsigned pi_head;		/* index of first byte of data */
+	unsigned pi_count;		/* bytes of data */
+	bool pi_reader;			/* read end still exists */
+	bool pi_writer;			/* write end still exists */
+
+	struct pollhead pi_pollhead;	/* threads in poll() on either end */
+};
+
+static const struct vnode_ops pipe_readops;
+static const struct vnode_ops pipe_writeops;
+
+////////////////////////////////////////////////////////////
+//
+// Ring buffer
+
+/*
+ * Wait until there is data in the pipe or there are no writers left.
+ * Returns the amount of data (0 means EOF) and where it starts.
+ * Call with pi_readlock held.
+ */
+static
+size_t
+pipe_waitdata(struct pipe *p, unsigned *start)
+{
+	size_t avail;
+
+	KASSERT(lock_do_i_hold(p->pi_readlock));
+
+	spinlock_acquire(&p->pi_lock);
+	while (p->pi_count == 0 && p->pi_writer) {
+		wchan_sleep(p->pi_readwchan, &p->pi_lock);
+	}
+	*start = p->pi_head;
+	avail = p->pi_count;
+	spinlock_release(&p->pi_lock);
+
+	return avail;
+}
+
+/*
+ * Wait until there are at least NEED bytes free in the pipe, or there
+ * are no readers left (EPIPE). Returns the amount of free space and
+ * where it starts. Call with pi_writelock held.
+ */
+static
+int
+pipe_waitspace(struct pipe *p, size_t need, unsigned *start, size_t *space)
+{
+	KASSERT(lock_do_i_hold(p->pi_writelock));
+	KASSERT(need <= PIPE_SIZE);
+
+	spinlock_acquire(&p->pi_lock);
+	while (p->pi_reader && PIPE_SIZE - p->pi_count < need) {
+		wchan_sleep(p->pi_writewchan, &p->pi_lock);
+	}
+	if (!p->pi_reader) {
+		spinlock_release(&p->pi_lock);
+		return EPIPE;
+	}
+	*start = (p->pi_head + p->pi_count) % PIPE_SIZE;
+	*space = PIPE_SIZE - p->pi_count;
+	spinlock_release(&p->pi_lock);
+
+	return 0;
+}
+
+/*
+ * Remove LEN bytes from the front of the pipe, and wake up writers.
+ */
+static
+void
+pipe_consumed(struct pipe *p, size_t len)
+{
+	if (len == 0) {
+		return;
+	}
+
+	spinlock_acquire(&p->pi_lock);
+	KASSERT(len <= p->pi_count);
+	p->pi_count -= len;
+	if (p->pi_count == 0) {
+		/* rewind, so later transfers don't wrap needlessly */
+		p->pi_head = 0;
+	}
+	else {
+		p->pi_head = (p->pi_head + len) % PIPE_SIZE;
+	}
+	wchan_wakeall(p->pi_writewchan, &p->pi_lock);
+	spinlock_release(&p->pi_lock);
+
+	pollhead_wakeup(&p->pi_pollhead);
+}
+
+/*
+ * Add LEN bytes (already copied in) to the back of the pipe, and wake
+ * up readers.
+ */
+static
+void
+pipe_produced(struct pipe *p, size_t len)
+{
+	if (len == 0) {
+		return;
+	}
+
+	spinlock_acquire(&p->pi_lock);
+	KASSERT(p->pi_count + len <= PIPE_SIZE);
+	p->pi_count += len;
+	wchan_wakeall(p->pi_readwchan, &p->pi_lock);
+	spinlock_release(&p->pi_lock);
+
+	pollhead_wakeup(&p->pi_pollhead);
+}
+
+/*
+ * uiomove LEN bytes of the ring starting at START, wrapping around
+ * the end of the buffer if needed.
+ */
+static
+int
+pipe_uiomove(struct pipe *p, unsigned start, size_t len, struct uio *uio)
+{
+	size_t first;
+	int result;
+
+	first = PIPE_SIZE - start;
+	if (first > len) {
+		first = len;
+	}
+	result = uiomove(p->pi_buf + start, first, uio);
+	if (result == 0 && len > first) {
+		result = uiomove(p->pi_buf, len - first, uio);
+	}
+	return result;
+}
+
+/*
+ * Set up a kernel uio covering LEN bytes of the ring starting at
+ * START, for handing directly to another vnode's VOP_READ or
+ * VOP_WRITE. IOV must have room for two entries.
+ */
+static
+void
+pipe_kuio(struct pipe *p, unsigned start, size_t len, struct iovec *iov,
+	  struct uio *u, off_t pos, enum uio_rw rw)
+{
+	size_t first;
+
+	first = PIPE_SIZE - start;
+	if (first > len) {
+		first = len;
+	}
+	iov[0].iov_kbase = p->pi_buf + start;
+	iov[0].iov_len = first;
+	iov[1].iov_kbase = p->pi_buf;
+	iov[1].iov_len = len - first;
+
+	u->uio_iov = iov;
+	u->uio_iovcnt = (len > first) ? 2 : 1;
+	u->uio_offset = pos;
+	u->uio_resid = len;
+	u->uio_segflg = UIO_SYSSPACE;
+	u->uio_rw = rw;
+	u->uio_space = NULL;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Constructor/destructor
+
+static
+void
+pipe_destroy(struct pipe *p)
+{
+	KASSERT(!p->pi_reader && !p->pi_writer);
+
+	pollhead_cleanup(&p->pi_pollhead);
+	wchan_destroy(p->pi_writewchan);
+	wchan_destroy(p->pi_readwchan);
+	spinlock_cleanup(&p->pi_lock);
+	lock_destroy(p->pi_writelock);
+	lock_destroy(p->pi_readlock);
+	free_kpages((vaddr_t)p->pi_buf);
+	kfree(p);
+}
+
+int
+pipe_create(struct vnode **readret, struct vnode **writeret)
+{
+	struct pipe *p;
+
+	/* PIPE_BUF-sized writes must fit, or they'd never be atomic */
+	KASSERT(PIPE_BUF <= PIPE_SIZE);
+
+	p = kmalloc(sizeof(*p));
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	p->pi_buf = (char *)alloc_kpages(1);
+	if (p->pi_buf == NULL) {
+		goto fail_p;
+	}
+	p->pi_readlock = lock_create("pipe-read");
+	if (p->pi_readlock == NULL) {
+		goto fail_buf;
+	}
+	p->pi_writelock = lock_create("pipe-write");
+	if (p->pi_writelock == NULL) {
+		goto fail_readlock;
+	}
+	p->pi_readwchan = wchan_create("pipe-read");
+	if (p->pi_readwchan == NULL) {
+		goto fail_writelock;
+	}
+	p->pi_writewchan = wchan_create("pipe-write");
+	if (p->pi_writewchan == NULL) {
+		goto fail_readwchan;
+	}
+
+	pollhead_init(&p->pi_pollhead);
+	spinlock_init(&p->pi_lock);
+	p->pi_head = 0;
+	p->pi_count = 0;
+	p->pi_reader = true;
+	p->pi_writer = true;
+
+	/* Like devices, pipes aren't on any filesystem. */
+	vnode_init(&p->pi_readvn, &pipe_readops, NULL, p);
+	vnode_init(&p->pi_writevn, &pipe_writeops, NULL, p);
+
+	*readret = &p->pi_readvn;
+	*writeret = &p->pi_writevn;
+	return 0;
+
+ fail_readwchan:
+	wchan_destroy(p->pi_readwchan);
+ fail_writelock:
+	lock_destroy(p->pi_writelock);
+ fail_readlock:
+	lock_destroy(p->pi_readlock);
+ fail_buf:
+	free_kpages((vaddr_t)p->pi_buf);
+ fail_p:
+	kfree(p);
+	return ENOMEM;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Vnode operations
+
+/*
+ * Called when the last reference to one end goes away. Wake up
+ * anyone blocked on the other end so they notice, and free the pipe
+ * once both ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *p = v->vn_data;
+	bool gone;
+
+	/*
+	 * Pipe ends are only reachable through open files, so nobody
+	 * can have picked up a new reference while we got here.
+	 */
+	spinlock_acquire(&p->pi_lock);
+	if (v == &p->pi_readvn) {
+		p->pi_reader = false;
+		wchan_wakeall(p->pi_writewchan, &p->pi_lock);
+	}
+	else {
+		KASSERT(v == &p->pi_writevn);
+		p->pi_writer = false;
+		wchan_wakeall(p->pi_readwchan, &p->pi_lock);
+	}
+	gone = !p->pi_reader && !p->pi_writer;
+	if (!gone) {
+		/*
+		 * Under the spinlock, as once we let go the other end
+		 * may be reclaimed and the pipe freed.
+		 */
+		pollhead_wakeup(&p->pi_pollhead);
+	}
+	spinlock_release(&p->pi_lock);
+
+	vnode_cleanup(v);
+	if (gone) {
+		pipe_destroy(p);
+	}
+	return 0;
+}
+
+/*
+ * Pipes are created by pipe(), not opened by name.
+ */
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+/*
+ * Read whatever is in the pipe, up to the size of the request,
+ * waiting only if it's empty.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	unsigned start;
+	size_t avail, resid;
+	int result;
+
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(p->pi_readlock);
+
+	avail = pipe_waitdata(p, &start);
+	if (avail > uio->uio_resid) {
+		avail = uio->uio_resid;
+	}
+
+	resid = uio->uio_resid;
+	result = pipe_uiomove(p, start, avail, uio);
+	pipe_consumed(p, resid - uio->uio_resid);
+
+	lock_release(p->pi_readlock);
+	return result;
+}
+
+/*
+ * Write the whole request, waiting for the reader as needed. If the
+ * read end goes away partway through, report what was written.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *p = v->vn_data;
+	unsigned start;
+	size_t total, need, space, resid;
+	bool atomic;
+	int result;
+
+	total = uio->uio_resid;
+	atomic = total <= PIPE_BUF;
+	result = 0;
+
+	lock_acquire(p->pi_writelock);
+
+	while (uio->uio_resid > 0) {
+		need = atomic ? uio->uio_resid : 1;
+		result = pipe_waitspace(p, need, &start, &space);
+		if (result) {
+			break;
+		}
+		if (space > uio->uio_resid) {
+			space = uio->uio_resid;
+		}
+
+		resid = uio->uio_resid;
+		result = pipe_uiomove(p, start, space, uio);
+		pipe_produced(p, resid - uio->uio_resid);
+		if (result) {
+			break;
+		}
+	}
+
+	lock_release(p->pi_writelock);
+
+	if (result == EPIPE && uio->uio_resid < total) {
+		/* short write */
+		result = 0;
+	}
+	return result;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * The read end is readable if there's data, or if there are no
+ * writers left (then it's at EOF, and also hung up). The write end
+ * is writable if an atomic-sized write would go through right away,
+ * and in error if there are no readers left.
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, int *revents, struct pollwaiter *pw)
+{
+	struct pipe *p = v->vn_data;
+	int result;
+
+	result = pollwaiter_register(pw, &p->pi_pollhead);
+	if (result) {
+		return result;
+	}
+
+	*revents = 0;
+	spinlock_acquire(&p->pi_lock);
+	if (v == &p->pi_readvn) {
+		if (p->pi_count > 0 || !p->pi_writer) {
+			*revents |= events & (POLLIN | POLLRDNORM);
+		}
+		if (!p->pi_writer) {
+			*revents |= POLLHUP;
+		}
+	}
+	else {
+		if (!p->pi_reader) {
+			*revents |= POLLERR;
+		}
+		else if (PIPE_SIZE - p->pi_count >= PIPE_BUF) {
+			*revents |= events & (POLLOUT | POLLWRNORM);
+		}
+	}
+	spinlock_release(&p->pi_lock);
+
+	return 0;
+}
+
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *p = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	spinlock_acquire(&p->pi_lock);
+	statbuf->st_size = p->pi_count;
+	spinlock_release(&p->pi_lock);
+
+	statbuf->st_mode = _S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_SIZE;
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = _S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+static const struct vnode_ops pipe_readops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = vopfail_uio_inval,
+	.vop_append = vopfail_uio_inval,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = pipe_poll,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+static const struct vnode_ops pipe_writeops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+
+	.vop_read = vopfail_uio_inval,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_append = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_readahead = vopnop_readahead,
+	.vop_copyrange = vopfail_copyrange_xdev,
+	.vop_poll = pipe_poll,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+//
+// Splice
+
+/*
+ * Pipe to something else: hand the data sitting in the ring straight
+ * to the other vnode's VOP_WRITE, or VOP_APPEND if APPEND.
+ */
+static
+int
+pipe_splice_out(struct pipe *p, struct vnode *to, off_t *pos, bool append,
+		size_t len, size_t *moved)
+{
+	struct iovec iov[2];
+	struct uio ku;
+	unsigned start;
+	size_t avail;
+	int result;
+
+	lock_acquire(p->pi_readlock);
+
+	avail = pipe_waitdata(p, &start);
+	if (avail > len) {
+		avail = len;
+	}
+	if (avail == 0) {
+		/* EOF */
+		lock_release(p->pi_readlock);
+		*moved = 0;
+		return 0;
+	}
+
+	pipe_kuio(p, start, avail, iov, &ku, *pos, UIO_WRITE);
+	result = append ? VOP_APPEND(to, &ku) : VOP_WRITE(to, &ku);
+	*moved = avail - ku.uio_resid;
+	pipe_consumed(p, *moved);
+	*pos = ku.uio_offset;
+
+	lock_release(p->pi_readlock);
+
+	/* if anything moved, report that instead of the error */
+	return *moved > 0 ? 0 : result;
+}
+
+/*
+ * Something else to pipe: have the other vnode's VOP_READ fill the
+ * free part of the ring directly.
+ */
+static
+int
+pipe_splice_in(struct pipe *p, struct vnode *from, off_t *pos,
+	       size_t len, size_t *moved)
+{
+	struct iovec iov[2];
+	struct uio ku;
+	unsigned start;
+	size_t space;
+	int result;
+
+	lock_acquire(p->pi_writelock);
+
+	result = pipe_waitspace(p, 1, &start, &space);
+	if (result) {
+		lock_release(p->pi_writelock);
+		return result;
+	}
+	if (space > len) {
+		space = len;
+	}
+
+	pipe_kuio(p, start, space, iov, &ku, *pos, UIO_READ);
+	result = VOP_READ(from, &ku);
+	*moved = space - ku.uio_resid;
+	pipe_produced(p, *moved);
+	*pos = ku.uio_offset;
+
+	lock_release(p->pi_writelock);
+
+	return *moved > 0 ? 0 : result;
+}
+
+int
+pipe_splice(struct vnode *from, struct vnode *to, off_t *pos, bool append,
+	    size_t len, size_t *moved)
+{
+	*moved = 0;
+
+	if (from->vn_ops == &pipe_readops) {
+		if (to->vn_ops == &pipe_writeops &&
+		    to->vn_data == from->vn_data) {
+			/* into itself; would deadlock once full */
+			return EINVAL;
+		}
+		if (len == 0) {
+			return 0;
+		}
+		return pipe_splice_out(from->vn_data, to, pos, append, len,
+				       moved);
+	}
+	if (to->vn_ops == &pipe_writeops) {
+		KASSERT(!append);
+		if (len == 0) {
+			return 0;
+		}
+		return pipe_splice_in(to->vn_data, from, pos, len, moved);
+	}
+	return EINVAL;
+}
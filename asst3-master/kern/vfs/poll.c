@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Readiness notification for poll(). See poll.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <poll.h>
+
+/*
+ * One registration of a waiter on a pollhead. It is on two lists:
+ * the pollhead's, so wakeups can find the waiter, and the waiter's,
+ * so it can find and remove all its registrations when done.
+ */
+struct pollentry {
+	struct pollwaiter *pe_waiter;
+	struct pollhead *pe_head;
+	struct pollentry *pe_headnext;		/* on pe_head's list */
+	struct pollentry *pe_waiternext;	/* on pe_waiter's list */
+};
+
+////////////////////////////////////////////////////////////
+//
+// Pollheads
+
+void
+pollhead_init(struct pollhead *ph)
+{
+	spinlock_init(&ph->ph_lock);
+	ph->ph_entries = NULL;
+}
+
+void
+pollhead_cleanup(struct pollhead *ph)
+{
+	KASSERT(ph->ph_entries == NULL);
+	spinlock_cleanup(&ph->ph_lock);
+}
+
+/*
+ * Wake everyone polling this object. Lock order is pollhead, then
+ * waiter.
+ */
+void
+pollhead_wakeup(struct pollhead *ph)
+{
+	struct pollentry *pe;
+	struct pollwaiter *pw;
+
+	spinlock_acquire(&ph->ph_lock);
+	for (pe = ph->ph_entries; pe != NULL; pe = pe->pe_headnext) {
+		pw = pe->pe_waiter;
+		spinlock_acquire(&pw->pw_lock);
+		pw->pw_woken = true;
+		wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+		spinlock_release(&pw->pw_lock);
+	}
+	spinlock_release(&ph->ph_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Waiters
+
+int
+pollwaiter_init(struct pollwaiter *pw)
+{
+	pw->pw_wchan = wchan_create("poll");
+	if (pw->pw_wchan == NULL) {
+		return ENOMEM;
+	}
+	spinlock_init(&pw->pw_lock);
+	pw->pw_woken = false;
+	pw->pw_timedout = false;
+	pw->pw_timeoutset = false;
+	timeout_init(&pw->pw_timeout);
+	pw->pw_entries = NULL;
+	return 0;
+}
+
+/*
+ * Timer callback; runs in interrupt context.
+ */
+static
+void
+pollwaiter_timedout(void *vpw)
+{
+	struct pollwaiter *pw = vpw;
+
+	spinlock_acquire(&pw->pw_lock);
+	pw->pw_timedout = true;
+	wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+	spinlock_release(&pw->pw_lock);
+}
+
+void
+pollwaiter_settimeout(struct pollwaiter *pw, uint64_t nsecs)
+{
+	KASSERT(!pw->pw_timeoutset);
+
+	timeout(&pw->pw_timeout, pollwaiter_timedout, pw, nsecs);
+	pw->pw_timeoutset = true;
+}
+
+void
+pollwaiter_cleanup(struct pollwaiter *pw)
+{
+	struct pollentry *pe, **pp;
+	struct pollhead *ph;
+
+	/*
+	 * If the timeout can't be cancelled it has fired or is firing;
+	 * wait until the callback is done with us.
+	 */
+	if (pw->pw_timeoutset && !untimeout(&pw->pw_timeout)) {
+		spinlock_acquire(&pw->pw_lock);
+		while (!pw->pw_timedout) {
+			wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+		}
+		spinlock_release(&pw->pw_lock);
+	}
+
+	while (pw->pw_entries != NULL) {
+		pe = pw->pw_entries;
+		pw->pw_entries = pe->pe_waiternext;
+
+		ph = pe->pe_head;
+		spinlock_acquire(&ph->ph_lock);
+		for (pp = &ph->ph_entries; *pp != pe; pp = &(*pp)->pe_headnext) {
+			KASSERT(*pp != NULL);
+		}
+		*pp = pe->pe_headnext;
+		spinlock_release(&ph->ph_lock);
+
+		kfree(pe);
+	}
+
+	spinlock_cleanup(&pw->pw_lock);
+	wchan_destroy(pw->pw_wchan);
+}
+
+int
+pollwaiter_register(struct pollwaiter *pw, struct pollhead *ph)
+{
+	struct pollentry *pe;
+
+	if (pw == NULL) {
+		return 0;
+	}
+
+	pe = kmalloc(sizeof(*pe));
+	if (pe == NULL) {
+		return ENOMEM;
+	}
+	pe->pe_waiter = pw;
+	pe->pe_head = ph;
+
+	spinlock_acquire(&ph->ph_lock);
+	pe->pe_headnext = ph->ph_entries;
+	ph->ph_entries = pe;
+	spinlock_release(&ph->ph_lock);
+
+	/* only the owning thread touches this list */
+	pe->pe_waiternext = pw->pw_entries;
+	pw->pw_entries = pe;
+
+	return 0;
+}
+
+void
+pollwaiter_reset(struct pollwaiter *pw)
+{
+	spinlock_acquire(&pw->pw_lock);
+	pw->pw_woken = false;
+	spinlock_release(&pw->pw_lock);
+}
+
+bool
+pollwaiter_sleep(struct pollwaiter *pw)
+{
+	bool timedout;
+
+	spinlock_acquire(&pw->pw_lock);
+	while (!pw->pw_woken && !pw->pw_timedout) {
+		wchan_sleep(pw->pw_wchan, &pw->pw_lock);
+	}
+	timedout = pw->pw_timedout;
+	spinlock_release(&pw->pw_lock);
+
+	return !timedout;
+}
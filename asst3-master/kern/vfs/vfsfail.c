@@ -29,6 +29,7 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <vnode.h>
 
 /*
@@ -79,6 +80,60 @@ vopfail_uio_nosys(struct vnode *vn, struct uio *uio)
 	return ENOSYS;
 }
 
+////////////////////////////////////////////////////////////
+// readahead
+
+/*
+ * Readahead is only a hint, so objects that don't do it quietly
+ * succeed rather than fail.
+ */
+int
+vopnop_readahead(struct vnode *vn, off_t pos, off_t len)
+{
+	(void)vn;
+	(void)pos;
+	(void)len;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// copyrange
+
+/*
+ * For objects with no fast way to copy: EXDEV sends the caller back
+ * to plain reads and writes.
+ */
+int
+vopfail_copyrange_xdev(struct vnode *vn, off_t pos,
+		       struct vnode *src, off_t srcpos,
+		       size_t len, size_t *copied)
+{
+	(void)vn;
+	(void)pos;
+	(void)src;
+	(void)srcpos;
+	(void)len;
+	*copied = 0;
+	return EXDEV;
+}
+
+////////////////////////////////////////////////////////////
+// poll
+
+/*
+ * For objects that never block, such as regular files: always ready
+ * for reading and writing.
+ */
+int
+vopnop_poll(struct vnode *vn, int events, int *revents,
+	    struct pollwaiter *pw)
+{
+	(void)vn;
+	(void)pw;
+	*revents = events & (POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM);
+	return 0;
+}
+
 ////////////////////////////////////////////////////////////
 // mmap
 
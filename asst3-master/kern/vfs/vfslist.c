@@ -43,6 +43,8 @@
 #include <fs.h>
 #include <vnode.h>
 #include <device.h>
+#include <bio.h>
+#include <buf.h>
 
 /*
  * Structure for a single named device.
@@ -112,7 +114,12 @@ vfs_bootstrap(void)
 	}
 	vfs_biglock_depth = 0;
 
+	bio_bootstrap();
+	buffer_bootstrap();
+	vfs_ncache_bootstrap();
+
 	devnull_create();
+	devschedstat_create();
 	semfs_bootstrap();
 }
 
@@ -211,8 +218,9 @@ vfs_getroot(const char *devname, struct vnode **ret)
 		 * DEVNAME names either the filesystem or the device,
 		 * return the root of the filesystem.
 		 *
-		 * If it has no mounted filesystem, it's mountable,
-		 * and DEVNAME names the device, return ENXIO.
+		 * If it has no mounted filesystem, it's mountable (or
+		 * is a device-less fs that has been unmounted), and
+		 * DEVNAME names the device, return ENXIO.
 		 */
 
 		if (kd->kd_fs != NULL && kd->kd_fs != SWAP_FS) {
@@ -225,7 +233,7 @@ vfs_getroot(const char *devname, struct vnode **ret)
 			}
 		}
 		else {
-			if (kd->kd_rawname!=NULL &&
+			if ((kd->kd_rawname!=NULL || kd->kd_device==NULL) &&
 			    !strcmp(kd->kd_name, devname)) {
 				return ENXIO;
 			}
@@ -380,6 +388,32 @@ badnames(const char *n1, const char *n2, const char *n3)
 	return 0;
 }
 
+/*
+ * Look for a filesystem with no device under it (one added with
+ * vfs_addfs) named DEVNAME. Should already hold knowndevs_lock.
+ */
+static
+int
+findfs(const char *devname, struct knowndev **result)
+{
+	struct knowndev *kd;
+	unsigned i, num;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	num = knowndevarray_num(knowndevs);
+	for (i=0; i<num; i++) {
+		kd = knowndevarray_get(knowndevs, i);
+		if (kd->kd_device == NULL && !strcmp(devname, kd->kd_name)) {
+			KASSERT(kd->kd_rawname == NULL);
+			*result = kd;
+			return 0;
+		}
+	}
+
+	return ENODEV;
+}
+
 /*
  * Add a new device to the VFS layer's device table.
  *
@@ -492,6 +526,28 @@ vfs_adddev(const char *devname, struct device *dev, int mountable)
 int
 vfs_addfs(const char *devname, struct fs *fs)
 {
+	struct knowndev *kd;
+	const char *volname;
+	int result;
+
+	vfs_biglock_acquire();
+
+	/* Reuse the slot of one that was unmounted, if any. */
+	if (findfs(devname, &kd) == 0) {
+		volname = FSOP_GETVOLNAME(fs);
+		if (kd->kd_fs != NULL ||
+		    (volname != NULL && badnames(volname, NULL, NULL))) {
+			result = EEXIST;
+		}
+		else {
+			kd->kd_fs = fs;
+			result = 0;
+		}
+		vfs_biglock_release();
+		return result;
+	}
+
+	vfs_biglock_release();
 	return vfs_doadd(devname, 0, NULL, fs);
 }
 
@@ -644,15 +700,24 @@ vfs_unmount(const char *devname)
 
 	result = findmount(devname, &kd);
 	if (result) {
-		goto fail;
+		/*
+		 * Filesystems without a device (added with
+		 * vfs_addfs) can be unmounted too, if they agree to.
+		 */
+		result = findfs(devname, &kd);
+		if (result) {
+			goto fail;
+		}
 	}
 
 	if (kd->kd_fs == NULL || kd->kd_fs == SWAP_FS) {
 		result = EINVAL;
 		goto fail;
 	}
-	KASSERT(kd->kd_rawname != NULL);
-	KASSERT(kd->kd_device != NULL);
+	KASSERT(kd->kd_rawname != NULL || kd->kd_device == NULL);
+
+	/* the name cache holds vnodes; let go of them */
+	vfs_ncache_purgefs(kd->kd_fs);
 
 	/* sync the fs */
 	result = FSOP_SYNC(kd->kd_fs);
@@ -745,6 +810,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		vfs_ncache_purgefs(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
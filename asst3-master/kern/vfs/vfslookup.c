@@ -35,6 +35,7 @@
 #include <kern/errno.h>
 #include <limits.h>
 #include <lib.h>
+#include <stat.h>
 #include <synch.h>
 #include <vfs.h>
 #include <fs.h>
@@ -234,6 +235,86 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Look up the single component NAME in DIR, asking the name cache
+ * first and telling it what the filesystem said if it didn't know.
+ */
+static
+int
+lookup_component(struct vnode *dir, char *name, struct vnode **ret)
+{
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	result = vfs_ncache_lookup(dir, name, ret);
+	if (result == EAGAIN) {
+		result = VOP_LOOKUP(dir, name, ret);
+		if (result == 0) {
+			vfs_ncache_enter(dir, name, *ret);
+		}
+		else if (result == ENOENT) {
+			vfs_ncache_enter(dir, name, NULL);
+		}
+	}
+	return result;
+}
+
+/*
+ * Walk PATH from STARTVN up to (but not including) its last
+ * component, one component at a time. Hands back the directory
+ * reached in *DIR and the last component in *LAST, which is empty if
+ * PATH has no components, and in *TRAILING whether PATH ended with a
+ * slash (so the last component must be a directory). Consumes the
+ * caller's reference to STARTVN; *DIR comes with one. PATH is
+ * destroyed.
+ */
+static
+int
+lookup_walk(struct vnode *startvn, char *path, struct vnode **dir,
+	    char **last, bool *trailing)
+{
+	struct vnode *vn, *next;
+	char *name, *slash;
+	size_t len;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	/* Trailing slashes don't name anything, but remember them. */
+	len = strlen(path);
+	*trailing = false;
+	while (len > 0 && path[len-1] == '/') {
+		path[--len] = 0;
+		*trailing = true;
+	}
+
+	vn = startvn;
+	name = path;
+	while (1) {
+		while (*name == '/') {
+			name++;
+		}
+		slash = strchr(name, '/');
+		if (slash == NULL) {
+			break;
+		}
+		*slash = 0;
+
+		result = lookup_component(vn, name, &next);
+		VOP_DECREF(vn);
+		if (result) {
+			return result;
+		}
+		vn = next;
+		name = slash + 1;
+	}
+
+	*dir = vn;
+	*last = name;
+	return 0;
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
@@ -243,7 +324,9 @@ int
 vfs_lookparent(char *path, struct vnode **retval,
 	       char *buf, size_t buflen)
 {
-	struct vnode *startvn;
+	struct vnode *startvn, *dir;
+	char *name;
+	bool trailing;
 	int result;
 
 	vfs_biglock_acquire();
@@ -254,7 +337,14 @@ vfs_lookparent(char *path, struct vnode **retval,
 		return result;
 	}
 
-	if (strlen(path)==0) {
+	/* A trailing slash is fine here, as in mkdir("foo/"). */
+	result = lookup_walk(startvn, path, &dir, &name, &trailing);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	if (strlen(name)==0) {
 		/*
 		 * It does not make sense to use just a device name in
 		 * a context where "lookparent" is the desired
@@ -263,10 +353,11 @@ vfs_lookparent(char *path, struct vnode **retval,
 		result = EINVAL;
 	}
 	else {
-		result = VOP_LOOKPARENT(startvn, path, retval, buf, buflen);
+		/* Let the filesystem check DIR and copy out the name */
+		result = VOP_LOOKPARENT(dir, name, retval, buf, buflen);
 	}
 
-	VOP_DECREF(startvn);
+	VOP_DECREF(dir);
 
 	vfs_biglock_release();
 	return result;
@@ -275,7 +366,10 @@ vfs_lookparent(char *path, struct vnode **retval,
 int
 vfs_lookup(char *path, struct vnode **retval)
 {
-	struct vnode *startvn;
+	struct vnode *startvn, *dir;
+	char *name;
+	bool trailing;
+	mode_t type;
 	int result;
 
 	vfs_biglock_acquire();
@@ -286,15 +380,32 @@ vfs_lookup(char *path, struct vnode **retval)
 		return result;
 	}
 
-	if (strlen(path)==0) {
-		*retval = startvn;
+	result = lookup_walk(startvn, path, &dir, &name, &trailing);
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+
+	if (strlen(name)==0) {
+		*retval = dir;
 		vfs_biglock_release();
 		return 0;
 	}
 
-	result = VOP_LOOKUP(startvn, path, retval);
+	result = lookup_component(dir, name, retval);
+	VOP_DECREF(dir);
+
+	if (result == 0 && trailing) {
+		/* "name/" has to be a directory */
+		result = VOP_GETTYPE(*retval, &type);
+		if (result == 0 && (type & S_IFMT) != S_IFDIR) {
+			result = ENOTDIR;
+		}
+		if (result) {
+			VOP_DECREF(*retval);
+		}
+	}
 
-	VOP_DECREF(startvn);
 	vfs_biglock_release();
 	return result;
 }
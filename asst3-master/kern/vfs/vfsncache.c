@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * VFS name cache.
+ *
+ * Remembers the results of single-component lookups as
+ * (directory vnode, name) -> vnode, including names that were
+ * looked up and found not to exist (negative entries). Each entry
+ * holds a reference to its directory and, unless negative, to the
+ * vnode it names, so the vnode pointers in the cache are always
+ * valid.
+ *
+ * The cache knows nothing about how the filesystems below it change
+ * their directories, so every VFS-level operation that creates or
+ * destroys a name calls vfs_ncache_invalidate for it, within the
+ * same biglock hold as the operation so no lookup can slip in and
+ * cache the old state, and unmount purges everything belonging to
+ * the filesystem first. All of this is protected by the vfs biglock.
+ *
+ * vfs_lookup and vfs_lookparent walk paths a component at a time so
+ * that every step can be answered from here.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <limits.h>
+#include <lib.h>
+#include <vfs.h>
+#include <fs.h>
+#include <vnode.h>
+
+#define NCACHE_SIZE	128	/* number of entries */
+#define NCACHE_HASHSIZE	61	/* number of hash chains */
+
+struct ncentry {
+	struct vnode *nc_dir;		/* directory (NULL if free) */
+	struct vnode *nc_vn;		/* result, or NULL if negative */
+	struct ncentry *nc_hashnext;	/* hash chain */
+	struct ncentry *nc_lruprev;	/* LRU list, most recent first */
+	struct ncentry *nc_lrunext;
+	char nc_name[NAME_MAX+1];
+};
+
+static struct ncentry ncache_entries[NCACHE_SIZE];
+static struct ncentry *ncache_hash[NCACHE_HASHSIZE];
+static struct ncentry *ncache_lruhead, *ncache_lrutail;
+static struct ncentry *ncache_freelist;	/* chained through nc_hashnext */
+
+/* Statistics */
+static unsigned ncache_hits;
+static unsigned ncache_neghits;
+static unsigned ncache_misses;
+static unsigned ncache_enters;
+static unsigned ncache_invals;
+
+////////////////////////////////////////////////////////////
+//
+// Internal tools
+
+static
+unsigned
+ncache_hashfunc(struct vnode *dir, const char *name)
+{
+	unsigned h;
+
+	h = (unsigned)(uintptr_t)dir >> 4;
+	while (*name) {
+		h = h * 33 + (unsigned char)*name++;
+	}
+	return h % NCACHE_HASHSIZE;
+}
+
+/*
+ * A name is cacheable if it is a single component. We leave "." and
+ * ".." to the filesystem; they are cheap there and ".." would need
+ * invalidating whenever a directory moves.
+ */
+static
+bool
+ncache_cacheable(struct vnode *dir, const char *name)
+{
+	if (dir->vn_fs == NULL) {
+		/* device */
+		return false;
+	}
+	if (name[0] == 0 || strlen(name) > NAME_MAX) {
+		return false;
+	}
+	if (strchr(name, '/') != NULL) {
+		return false;
+	}
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+		return false;
+	}
+	return true;
+}
+
+static
+struct ncentry *
+ncache_find(struct vnode *dir, const char *name)
+{
+	struct ncentry *nc;
+
+	nc = ncache_hash[ncache_hashfunc(dir, name)];
+	for (; nc != NULL; nc = nc->nc_hashnext) {
+		if (nc->nc_dir == dir && !strcmp(nc->nc_name, name)) {
+			return nc;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+ncache_lru_remove(struct ncentry *nc)
+{
+	if (nc->nc_lruprev != NULL) {
+		nc->nc_lruprev->nc_lrunext = nc->nc_lrunext;
+	}
+	else {
+		ncache_lruhead = nc->nc_lrunext;
+	}
+	if (nc->nc_lrunext != NULL) {
+		nc->nc_lrunext->nc_lruprev = nc->nc_lruprev;
+	}
+	else {
+		ncache_lrutail = nc->nc_lruprev;
+	}
+	nc->nc_lruprev = nc->nc_lrunext = NULL;
+}
+
+static
+void
+ncache_lru_addhead(struct ncentry *nc)
+{
+	nc->nc_lruprev = NULL;
+	nc->nc_lrunext = ncache_lruhead;
+	if (ncache_lruhead != NULL) {
+		ncache_lruhead->nc_lruprev = nc;
+	}
+	else {
+		ncache_lrutail = nc;
+	}
+	ncache_lruhead = nc;
+}
+
+/*
+ * Take an entry out of the cache, drop its references, and put it
+ * on the free list.
+ *
+ * Dropping the references can call into the filesystem's reclaim;
+ * we unlink the entry completely first so nothing can find it in a
+ * half-torn-down state.
+ */
+static
+void
+ncache_drop(struct ncentry *nc)
+{
+	struct ncentry **pp;
+	struct vnode *dir, *vn;
+
+	KASSERT(nc->nc_dir != NULL);
+
+	pp = &ncache_hash[ncache_hashfunc(nc->nc_dir, nc->nc_name)];
+	while (*pp != nc) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->nc_hashnext;
+	}
+	*pp = nc->nc_hashnext;
+	ncache_lru_remove(nc);
+
+	dir = nc->nc_dir;
+	vn = nc->nc_vn;
+	nc->nc_dir = NULL;
+	nc->nc_vn = NULL;
+	nc->nc_hashnext = ncache_freelist;
+	ncache_freelist = nc;
+
+	if (vn != NULL) {
+		VOP_DECREF(vn);
+	}
+	VOP_DECREF(dir);
+}
+
+/*
+ * Drop every entry looked up in DIR. Needed when DIR itself is
+ * going away, because those entries hold references to it.
+ */
+static
+void
+ncache_purgedir(struct vnode *dir)
+{
+	unsigned i;
+
+	for (i=0; i<NCACHE_SIZE; i++) {
+		if (ncache_entries[i].nc_dir == dir) {
+			ncache_drop(&ncache_entries[i]);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+//
+// Interface
+
+/*
+ * Set up the (empty) cache. Called from vfs_bootstrap.
+ */
+void
+vfs_ncache_bootstrap(void)
+{
+	unsigned i;
+
+	ncache_freelist = NULL;
+	for (i=0; i<NCACHE_SIZE; i++) {
+		ncache_entries[i].nc_dir = NULL;
+		ncache_entries[i].nc_vn = NULL;
+		ncache_entries[i].nc_hashnext = ncache_freelist;
+		ncache_freelist = &ncache_entries[i];
+	}
+	for (i=0; i<NCACHE_HASHSIZE; i++) {
+		ncache_hash[i] = NULL;
+	}
+	ncache_lruhead = ncache_lrutail = NULL;
+}
+
+/*
+ * Look up NAME in DIR in the cache. Returns 0 with a new reference
+ * in *RET on a positive hit, ENOENT on a negative hit, and EAGAIN
+ * if the cache doesn't know (the caller should ask the filesystem).
+ */
+int
+vfs_ncache_lookup(struct vnode *dir, const char *name, struct vnode **ret)
+{
+	struct ncentry *nc;
+	int result;
+
+	vfs_biglock_acquire();
+
+	if (!ncache_cacheable(dir, name)) {
+		vfs_biglock_release();
+		return EAGAIN;
+	}
+
+	nc = ncache_find(dir, name);
+	if (nc == NULL) {
+		ncache_misses++;
+		vfs_biglock_release();
+		return EAGAIN;
+	}
+
+	ncache_lru_remove(nc);
+	ncache_lru_addhead(nc);
+
+	if (nc->nc_vn == NULL) {
+		ncache_neghits++;
+		result = ENOENT;
+	}
+	else {
+		ncache_hits++;
+		VOP_INCREF(nc->nc_vn);
+		*ret = nc->nc_vn;
+		result = 0;
+	}
+
+	vfs_biglock_release();
+	return result;
+}
+
+/*
+ * Record the result of looking up NAME in DIR. VN is the vnode found,
+ * or NULL if the name doesn't exist. The cache takes its own
+ * references; the caller's are unaffected.
+ */
+void
+vfs_ncache_enter(struct vnode *dir, const char *name, struct vnode *vn)
+{
+	struct ncentry *nc;
+
+	vfs_biglock_acquire();
+
+	if (!ncache_cacheable(dir, name)) {
+		vfs_biglock_release();
+		return;
+	}
+
+	nc = ncache_find(dir, name);
+	if (nc != NULL) {
+		/* Replace whatever was there. */
+		ncache_drop(nc);
+	}
+
+	if (ncache_freelist == NULL) {
+		KASSERT(ncache_lrutail != NULL);
+		ncache_drop(ncache_lrutail);
+	}
+	nc = ncache_freelist;
+	KASSERT(nc != NULL);
+	ncache_freelist = nc->nc_hashnext;
+
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	nc->nc_dir = dir;
+	nc->nc_vn = vn;
+	strcpy(nc->nc_name, name);
+
+	nc->nc_hashnext = ncache_hash[ncache_hashfunc(dir, name)];
+	ncache_hash[ncache_hashfunc(dir, name)] = nc;
+	ncache_lru_addhead(nc);
+
+	ncache_enters++;
+
+	vfs_biglock_release();
+}
+
+/*
+ * Forget NAME in DIR, because it was (or may have been) created,
+ * removed, or renamed. If it named a directory, also forget
+ * everything looked up inside that directory.
+ */
+void
+vfs_ncache_invalidate(struct vnode *dir, const char *name)
+{
+	struct ncentry *nc;
+	struct vnode *vn;
+
+	vfs_biglock_acquire();
+
+	nc = ncache_find(dir, name);
+	if (nc != NULL) {
+		vn = nc->nc_vn;
+		if (vn != NULL) {
+			/* keep it alive while we purge under it */
+			VOP_INCREF(vn);
+		}
+		ncache_drop(nc);
+		if (vn != NULL) {
+			ncache_purgedir(vn);
+			VOP_DECREF(vn);
+		}
+		ncache_invals++;
+	}
+
+	vfs_biglock_release();
+}
+
+/*
+ * Forget everything belonging to FS. Called before unmounting it, as
+ * otherwise the cache's references would keep it busy.
+ */
+void
+vfs_ncache_purgefs(struct fs *fs)
+{
+	struct ncentry *nc;
+	unsigned i;
+
+	vfs_biglock_acquire();
+
+	for (i=0; i<NCACHE_SIZE; i++) {
+		nc = &ncache_entries[i];
+		if (nc->nc_dir == NULL) {
+			continue;
+		}
+		if (nc->nc_dir->vn_fs == fs ||
+		    (nc->nc_vn != NULL && nc->nc_vn->vn_fs == fs)) {
+			ncache_drop(nc);
+		}
+	}
+
+	vfs_biglock_release();
+}
+
+void
+vfs_ncache_printstats(void)
+{
+	unsigned lookups, used, neg, i;
+
+	vfs_biglock_acquire();
+
+	used = neg = 0;
+	for (i=0; i<NCACHE_SIZE; i++) {
+		if (ncache_entries[i].nc_dir != NULL) {
+			used++;
+			if (ncache_entries[i].nc_vn == NULL) {
+				neg++;
+			}
+		}
+	}
+
+	lookups = ncache_hits + ncache_neghits + ncache_misses;
+	kprintf("Name cache: %u/%u entries (%u negative)\n",
+		used, NCACHE_SIZE, neg);
+	kprintf("    %u lookups, %u hits, %u negative hits, %u misses "
+		"(%u%% hit rate)\n",
+		lookups, ncache_hits, ncache_neghits, ncache_misses,
+		lookups ? (ncache_hits + ncache_neghits) * 100 / lookups : 0);
+	kprintf("    %u entries made, %u invalidations\n",
+		ncache_enters, ncache_invals);
+
+	vfs_biglock_release();
+}
@@ -85,6 +85,116 @@ void vm_freePTE(paddr_t **oldPTE)
     // panic("vm: vm_freePTE DONE\n");
 }
 
+/*
+ * Page table indices for ADDR, worked out the same way as in vm_fault.
+ */
+static void vm_ptindex(vaddr_t addr, uint32_t *msb, uint32_t *lsb)
+{
+    paddr_t pbase = KVADDR_TO_PADDR(addr);
+
+    *msb = pbase >> 22;
+    *lsb = pbase << 10 >> 22;
+}
+
+/*
+ * Can the process write at ADDR? The same test vm_fault makes: a
+ * writeable region, or the stack.
+ */
+static bool vm_writeable(struct addrspace *as, vaddr_t addr)
+{
+    int stack_size = 16 * PAGE_SIZE;
+    region *curr;
+
+    for (curr = as -> as_regions; curr != NULL; curr = curr -> next) {
+        if (addr >= curr -> as_vbase && addr - curr -> as_vbase < curr -> size) {
+            return (curr -> flags & PF_W) == PF_W;
+        }
+    }
+    return addr < as -> as_stack && addr > (as -> as_stack - stack_size);
+}
+
+/*
+ * Replace the TLB entry for ADDR if there is one, else load it.
+ */
+static void vm_tlbupdate(vaddr_t addr, uint32_t entrylo)
+{
+    uint32_t entryhi = addr & TLBHI_VPAGE;
+    int spl, index;
+
+    spl = splhigh();
+    index = tlb_probe(entryhi, 0);
+    if (index >= 0) tlb_write(entryhi, entrylo, index);
+    else tlb_random(entryhi, entrylo);
+    splx(spl);
+}
+
+/*
+ * Write to a page mapped without TLBLO_DIRTY in a writeable part of
+ * the address space: a page lent to us by vm_sharepage. Take our own
+ * copy, or if nobody else has the page any more, just keep it.
+ */
+static int vm_cowfault(struct addrspace *as, vaddr_t faultaddress)
+{
+    uint32_t msb, lsb;
+    paddr_t pte;
+    vaddr_t oldpage, newpage;
+
+    if (!vm_writeable(as, faultaddress)) return EFAULT;
+
+    vm_ptindex(faultaddress, &msb, &lsb);
+    if (as -> as_pte[msb] == NULL || as -> as_pte[msb][lsb] == 0) return EFAULT;
+
+    pte = as -> as_pte[msb][lsb];
+    oldpage = PADDR_TO_KVADDR(pte & PAGE_FRAME);
+
+    if (kpage_refcount(oldpage) > 1) {
+        newpage = alloc_kpages(1);
+        if (newpage == 0) return ENOMEM;
+        memmove((void *)newpage, (const void *)oldpage, PAGE_SIZE);
+        free_kpages(oldpage); // drop our share of the old one
+        pte = KVADDR_TO_PADDR(newpage);
+    }
+
+    as -> as_pte[msb][lsb] = (pte & PAGE_FRAME) | TLBLO_DIRTY | TLBLO_VALID;
+    vm_tlbupdate(faultaddress, as -> as_pte[msb][lsb]);
+    return 0;
+}
+
+/*
+ * Map KPAGE, a page from alloc_kpages(1), read-only at UADDR in the
+ * current address space in place of whatever was there, so data can
+ * be handed to the process without copying it. The first write to it
+ * goes through vm_cowfault. Fails (and the caller should copy
+ * instead) if UADDR isn't somewhere the process could write anyway.
+ */
+int vm_sharepage(vaddr_t kpage, vaddr_t uaddr)
+{
+    struct addrspace *as = proc_getas();
+    uint32_t msb, lsb;
+    paddr_t old;
+    int result;
+
+    KASSERT((kpage & ~(vaddr_t)PAGE_FRAME) == 0);
+    KASSERT((uaddr & ~(vaddr_t)PAGE_FRAME) == 0);
+
+    if (as == NULL || as -> as_pte == NULL) return EFAULT;
+    if (uaddr >= USERSPACETOP || !vm_writeable(as, uaddr)) return EFAULT;
+
+    vm_ptindex(uaddr, &msb, &lsb);
+    if (as -> as_pte[msb] == NULL) {
+        result = vm_initPT(as -> as_pte, msb);
+        if (result) return result;
+    }
+
+    old = as -> as_pte[msb][lsb];
+    kpage_incref(kpage);
+    as -> as_pte[msb][lsb] = (KVADDR_TO_PADDR(kpage) & PAGE_FRAME) | TLBLO_VALID;
+    vm_tlbupdate(uaddr, as -> as_pte[msb][lsb]);
+
+    if (old != 0) free_kpages(PADDR_TO_KVADDR(old & PAGE_FRAME));
+    return 0;
+}
+
 /* Initialization function */
 void vm_bootstrap(void)
 {
@@ -130,13 +240,13 @@ vm_fault(int faulttype, vaddr_t faultaddress)
      * ROUGH STRUCTURE
      */
 
-    /* if VM_FAULT_READONLY, return EFAULT */
+    /* VM_FAULT_READONLY is a write to a lent page, see vm_cowfault */
     switch(faulttype) {
         case VM_FAULT_READ:
         case VM_FAULT_WRITE:
             break;
         case VM_FAULT_READONLY:
-            return EFAULT;  // Bad memory reference
+            break;          // copy-on-write, see below
         default: 
             return EINVAL;  // invalid arg
     }
@@ -148,6 +258,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
     if (as -> as_pte == NULL) return EFAULT; // no PTE
 
+    if (faulttype == VM_FAULT_READONLY) return vm_cowfault(as, faultaddress);
 
     // find region where faultaddress locates
     region *curr = as->as_regions;
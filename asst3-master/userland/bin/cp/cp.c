@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -36,28 +37,20 @@
  */
 
 
-/* Copy one file to another. */
+/* How much to ask copy_file_range for at once. */
+#define COPY_CHUNK (64*1024)
+
+/*
+ * Copy the rest of FROMFD to TOFD by reading and writing through a
+ * buffer. For files copy_file_range won't take, like devices.
+ */
 static
 void
-copy(const char *from, const char *to)
+copy_rw(int fromfd, const char *from, int tofd, const char *to)
 {
-	int fromfd;
-	int tofd;
 	char buf[1024];
 	int len, wr, wrtot;
 
-	/*
-	 * Open the files, and give up if they won't open
-	 */
-	fromfd = open(from, O_RDONLY);
-	if (fromfd<0) {
-		err(1, "%s", from);
-	}
-	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
-	if (tofd<0) {
-		err(1, "%s", to);
-	}
-
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -84,6 +77,43 @@ copy(const char *from, const char *to)
 	if (len<0) {
 		err(1, "%s", from);
 	}
+}
+
+/* Copy one file to another. */
+static
+void
+copy(const char *from, const char *to)
+{
+	int fromfd;
+	int tofd;
+	ssize_t len;
+
+	/*
+	 * Open the files, and give up if they won't open
+	 */
+	fromfd = open(from, O_RDONLY);
+	if (fromfd<0) {
+		err(1, "%s", from);
+	}
+	tofd = open(to, O_WRONLY|O_CREAT|O_TRUNC);
+	if (tofd<0) {
+		err(1, "%s", to);
+	}
+
+	/*
+	 * Let the kernel move the data without it coming out here.
+	 * Zero means EOF. If it can't do these files at all (they're
+	 * not seekable, say), fall back to reading and writing.
+	 */
+	while ((len = copy_file_range(fromfd, tofd, COPY_CHUNK))>0) {
+		/* nothing */
+	}
+	if (len<0) {
+		if (errno != ESPIPE && errno != ENOSYS) {
+			err(1, "%s to %s", from, to);
+		}
+		copy_rw(fromfd, from, tofd, to);
+	}
 
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
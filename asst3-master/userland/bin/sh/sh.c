@@ -69,6 +69,9 @@ struct exitinfo {
 /* set to nonzero if __time syscall seems to work */
 static int timing = 0;
 
+/* most commands allowed in one pipeline */
+#define MAXPIPE 16
+
 /* array of backgrounded jobs (allows "foregrounding") */
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
@@ -355,12 +358,117 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * runpipeline
+ * runs "cmd1 | cmd2 | ..." (the "|" must be a separate word, like
+ * "&") with each command's standard output connected by a pipe to
+ * the next one's standard input, then waits for all of them. The
+ * exit status is that of the last command. Builtins are not special
+ * here; there's little sense in cd'ing in a subprocess.
+ */
+static
+void
+runpipeline(char **args, int nargs, struct exitinfo *ei)
+{
+	char **cmds[MAXPIPE];
+	pid_t pids[MAXPIPE];
+	int ncmds, started, i, status;
+	int fds[2], infd;
+
+	ncmds = 0;
+	cmds[ncmds++] = args;
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			if (ncmds >= MAXPIPE) {
+				printf("%s: Too many commands in pipeline\n",
+				       args[0]);
+				exitinfo_exit(ei, 1);
+				return;
+			}
+			args[i] = NULL;
+			cmds[ncmds++] = &args[i+1];
+		}
+	}
+	for (i=0; i<ncmds; i++) {
+		if (cmds[i][0] == NULL) {
+			printf("Invalid null command in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
+	infd = -1;
+	for (started=0; started<ncmds; started++) {
+		if (started < ncmds-1) {
+			if (pipe(fds) < 0) {
+				warn("pipe");
+				break;
+			}
+		}
+		else {
+			fds[0] = fds[1] = -1;
+		}
+
+		pids[started] = fork();
+		if (pids[started] < 0) {
+			warn("fork");
+			if (fds[0] >= 0) {
+				close(fds[0]);
+				close(fds[1]);
+			}
+			break;
+		}
+		if (pids[started] == 0) {
+			/* child */
+			if (infd >= 0) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (fds[1] >= 0) {
+				dup2(fds[1], STDOUT_FILENO);
+				close(fds[1]);
+				close(fds[0]);
+			}
+			execvp(cmds[started][0], cmds[started]);
+			warn("%s", cmds[started][0]);
+			/* see docommand for why this is _exit */
+			_exit(1);
+		}
+
+		/* parent: done with the previous read end and this write end */
+		if (infd >= 0) {
+			close(infd);
+		}
+		if (fds[1] >= 0) {
+			close(fds[1]);
+		}
+		infd = fds[0];
+	}
+	if (infd >= 0) {
+		close(infd);
+	}
+
+	if (started < ncmds) {
+		exitinfo_exit(ei, 255);
+	}
+	for (i=0; i<started; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else if (i == ncmds-1) {
+			readstatus(status, ei);
+		}
+	}
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
  * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * the job if possible; if there's a '|' hand off to runpipeline; otherwise
+ * just run it and wait on it.
  */
 static
 void
@@ -417,6 +525,22 @@ docommand(char *buf, struct exitinfo *ei)
 		bg = 1;
 	}
 
+	for (i=0; i<nargs; i++) {
+		if (!strcmp(args[i], "|")) {
+			break;
+		}
+	}
+	if (i < nargs) {
+		if (bg) {
+			printf("%s: Background pipelines are not supported\n",
+			       args[0]);
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		runpipeline(args, nargs, ei);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
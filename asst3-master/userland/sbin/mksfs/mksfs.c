@@ -139,6 +139,7 @@ writesuper(const char *volname, uint32_t nblocks)
 	/* Initialize the superblock structure */
 	sb.sb_magic = SWAP32(SFS_MAGIC);
 	sb.sb_nblocks = SWAP32(nblocks);
+	sb.sb_version = SWAP32(SFS_VERSION);
 	strcpy(sb.sb_volname, volname);
 
 	/* and write it out. */
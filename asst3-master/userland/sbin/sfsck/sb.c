@@ -54,6 +54,10 @@ sb_load(void)
 	if (sb.sb_magic != SFS_MAGIC) {
 		errx(EXIT_FATAL, "Not an sfs filesystem");
 	}
+	if (sb.sb_version > SFS_VERSION) {
+		errx(EXIT_FATAL, "Unsupported sfs format revision %lu",
+		     (unsigned long) sb.sb_version);
+	}
 
 	assert(sb.sb_nblocks > 0);
 	assert(SFS_FREEMAPBLOCKS(sb.sb_nblocks) > 0);
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * appendtest - check that O_APPEND writes from several processes at
+ * once don't clobber each other.
+ *
+ * Some of the writers open the file themselves; the rest write
+ * through a single O_APPEND handle opened before forking and dup2'd
+ * onto another descriptor, so they share one seek position. Either
+ * way every record should end up in the file exactly once, intact,
+ * and each writer's records should be in the order it wrote them.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define FILENAME	"appendtest.out"
+#define NPROCS		6
+#define NOWNOPEN	3	/* writers 0..NOWNOPEN-1 open their own */
+#define NRECS		200
+#define RECSIZE		32
+#define DUPFD		10
+
+/*
+ * A record is the writer's letter, the record number in five digits,
+ * filler in the writer's lowercase letter, and a newline.
+ */
+static
+void
+mkrec(char *buf, unsigned proc, unsigned rec)
+{
+	unsigned i;
+
+	snprintf(buf, RECSIZE, "%c%05u", 'A' + proc, rec);
+	for (i=6; i<RECSIZE-1; i++) {
+		buf[i] = 'a' + proc;
+	}
+	buf[RECSIZE-1] = '\n';
+}
+
+static
+void
+writer(unsigned proc, int sharedfd)
+{
+	char buf[RECSIZE];
+	unsigned rec;
+	ssize_t r;
+	int fd;
+
+	if (proc < NOWNOPEN) {
+		close(sharedfd);
+		fd = open(FILENAME, O_WRONLY|O_APPEND);
+		if (fd < 0) {
+			err(1, "writer %u: %s", proc, FILENAME);
+		}
+	}
+	else {
+		if (dup2(sharedfd, DUPFD) < 0) {
+			err(1, "writer %u: dup2", proc);
+		}
+		close(sharedfd);
+		fd = DUPFD;
+	}
+
+	for (rec=0; rec<NRECS; rec++) {
+		mkrec(buf, proc, rec);
+		r = write(fd, buf, RECSIZE);
+		if (r < 0) {
+			err(1, "writer %u: write", proc);
+		}
+		if (r != RECSIZE) {
+			errx(1, "writer %u: short write (%zd)", proc, r);
+		}
+	}
+	close(fd);
+	_exit(0);
+}
+
+static
+void
+check(void)
+{
+	char buf[RECSIZE], want[RECSIZE];
+	unsigned next[NPROCS];
+	unsigned proc, rec, i, n;
+	ssize_t r;
+	int fd, bad;
+
+	for (proc=0; proc<NPROCS; proc++) {
+		next[proc] = 0;
+	}
+
+	fd = open(FILENAME, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	bad = 0;
+	for (n=0; ; n++) {
+		r = read(fd, buf, RECSIZE);
+		if (r < 0) {
+			err(1, "%s: read", FILENAME);
+		}
+		if (r == 0) {
+			break;
+		}
+		if (r != RECSIZE) {
+			errx(1, "%s: record %u: short read (%zd)",
+			     FILENAME, n, r);
+		}
+
+		proc = buf[0] - 'A';
+		rec = 0;
+		for (i=1; i<6; i++) {
+			rec = rec*10 + (buf[i] - '0');
+		}
+		if (proc >= NPROCS || rec >= NRECS) {
+			warnx("record %u: garbage", n);
+			bad = 1;
+			continue;
+		}
+		mkrec(want, proc, rec);
+		if (memcmp(buf, want, RECSIZE) != 0) {
+			warnx("record %u: writer %u record %u is damaged",
+			      n, proc, rec);
+			bad = 1;
+		}
+		if (rec != next[proc]) {
+			warnx("record %u: writer %u record %u, expected %u",
+			      n, proc, rec, next[proc]);
+			bad = 1;
+		}
+		next[proc] = rec + 1;
+	}
+	close(fd);
+
+	if (n != NPROCS * NRECS) {
+		warnx("%u records, expected %u", n, NPROCS * NRECS);
+		bad = 1;
+	}
+	if (bad) {
+		errx(1, "FAILED");
+	}
+}
+
+int
+main(void)
+{
+	pid_t pids[NPROCS];
+	unsigned i;
+	int fd, status, failed;
+
+	fd = open(FILENAME, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	printf("appendtest: %u writers x %u records (%u with their own "
+	       "open)\n", NPROCS, NRECS, NOWNOPEN);
+
+	for (i=0; i<NPROCS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			writer(i, fd);
+		}
+	}
+	close(fd);
+
+	failed = 0;
+	for (i=0; i<NPROCS; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			warnx("writer %u failed", i);
+			failed = 1;
+		}
+	}
+	if (failed) {
+		errx(1, "FAILED");
+	}
+
+	check();
+	printf("Passed.\n");
+	(void)remove(FILENAME);
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fileiotest - check the results of pread/pwrite, readv/writev and
+ * copy_file_range on an ordinary file.
+ *
+ * Positional I/O must neither use nor move the seek position;
+ * readv/writev and copy_file_range must move it by exactly the
+ * amount transferred, which is short (or zero) at end of file.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILE1 "fileiotest.1"
+#define FILE2 "fileiotest.2"
+
+static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz";
+#define ALEN 26
+
+static
+void
+checkpos(int fd, off_t expected, const char *what)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0) {
+		err(1, "%s: lseek", what);
+	}
+	if (pos != expected) {
+		errx(1, "%s: seek position %lld, expected %lld", what,
+		     (long long)pos, (long long)expected);
+	}
+}
+
+static
+void
+checkret(ssize_t r, ssize_t expected, const char *what)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if (r != expected) {
+		errx(1, "%s: got %zd, expected %zd", what, r, expected);
+	}
+}
+
+static
+void
+checkdata(const char *buf, const char *expected, size_t len,
+	  const char *what)
+{
+	if (memcmp(buf, expected, len) != 0) {
+		errx(1, "%s: wrong data", what);
+	}
+}
+
+static
+void
+positional(int fd)
+{
+	char buf[16];
+	int p[2];
+
+	printf("pread/pwrite...\n");
+
+	checkret(write(fd, alphabet, ALEN), ALEN, "write");
+	if (lseek(fd, 5, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+
+	checkret(pwrite(fd, "XYZ", 3, 10), 3, "pwrite");
+	checkpos(fd, 5, "pwrite");
+
+	checkret(pread(fd, buf, 5, 8), 5, "pread");
+	checkdata(buf, "ijXYZ", 5, "pread");
+	checkpos(fd, 5, "pread");
+
+	/* short at EOF, then nothing */
+	checkret(pread(fd, buf, 10, ALEN - 2), 2, "pread at EOF-2");
+	checkdata(buf, "yz", 2, "pread at EOF-2");
+	checkret(pread(fd, buf, 10, ALEN), 0, "pread at EOF");
+	checkpos(fd, 5, "pread at EOF");
+
+	/* put it back */
+	checkret(pwrite(fd, alphabet + 10, 3, 10), 3, "pwrite");
+
+	if (pread(fd, buf, 1, -1) >= 0 || errno != EINVAL) {
+		errx(1, "pread at -1: expected EINVAL");
+	}
+	if (pipe(p) < 0) {
+		err(1, "pipe");
+	}
+	if (pread(p[0], buf, 1, 0) >= 0 || errno != ESPIPE) {
+		errx(1, "pread on a pipe: expected ESPIPE");
+	}
+	close(p[0]);
+	close(p[1]);
+}
+
+static
+void
+vectored(int fd)
+{
+	char a[4], b[4], c[32];
+	struct iovec iov[3];
+
+	printf("readv/writev...\n");
+
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	iov[0].iov_base = (void *)"ABC";
+	iov[0].iov_len = 3;
+	iov[1].iov_base = (void *)"";
+	iov[1].iov_len = 0;
+	iov[2].iov_base = (void *)"DEFG";
+	iov[2].iov_len = 4;
+	checkret(writev(fd, iov, 3), 7, "writev");
+	checkpos(fd, 7, "writev");
+
+	/* Read the whole file back across three buffers */
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	iov[0].iov_base = a;
+	iov[0].iov_len = 3;
+	iov[1].iov_base = b;
+	iov[1].iov_len = 4;
+	iov[2].iov_base = c;
+	iov[2].iov_len = sizeof(c);
+	checkret(readv(fd, iov, 3), ALEN, "readv");
+	checkdata(a, "ABC", 3, "readv iov 0");
+	checkdata(b, "DEFG", 4, "readv iov 1");
+	checkdata(c, alphabet + 7, ALEN - 7, "readv iov 2");
+	checkpos(fd, ALEN, "readv");
+
+	/* Short near EOF, then zero at EOF */
+	if (lseek(fd, ALEN - 5, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	iov[0].iov_len = 3;
+	iov[1].iov_len = 4;
+	checkret(readv(fd, iov, 2), 5, "readv near EOF");
+	checkdata(a, "vwx", 3, "readv near EOF");
+	checkdata(b, "yz", 2, "readv near EOF");
+	checkret(readv(fd, iov, 2), 0, "readv at EOF");
+	checkpos(fd, ALEN, "readv at EOF");
+
+	/* put it back */
+	checkret(pwrite(fd, alphabet, 7, 0), 7, "pwrite");
+}
+
+static
+void
+copyrange(int fd)
+{
+	char buf[ALEN];
+	int fd2;
+
+	printf("copy_file_range...\n");
+
+	fd2 = open(FILE2, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd2 < 0) {
+		err(1, "%s", FILE2);
+	}
+
+	if (lseek(fd, 3, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	/* asks for more than there is: short */
+	checkret(copy_file_range(fd, fd2, 100), ALEN - 3, "copy_file_range");
+	checkpos(fd, ALEN, "copy_file_range source");
+	checkpos(fd2, ALEN - 3, "copy_file_range destination");
+	checkret(copy_file_range(fd, fd2, 100), 0, "copy_file_range at EOF");
+
+	checkret(pread(fd2, buf, sizeof(buf), 0), ALEN - 3, "pread copy");
+	checkdata(buf, alphabet + 3, ALEN - 3, "copied data");
+
+	close(fd2);
+	(void)remove(FILE2);
+}
+
+int
+main(void)
+{
+	int fd;
+
+	fd = open(FILE1, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILE1);
+	}
+
+	positional(fd);
+	vectored(fd);
+	copyrange(fd);
+
+	close(fd);
+	(void)remove(FILE1);
+	printf("Passed.\n");
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipetest - check pipe end-of-file and error behaviour, poll on
+ * pipes (including a poll that times out), and splice.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <err.h>
+
+#define SPLICEFILE	"pipetest.out"
+#define TIMEOUT_MS	200
+
+static
+void
+mkpipe(int p[2])
+{
+	if (pipe(p) < 0) {
+		err(1, "pipe");
+	}
+}
+
+static
+void
+checkret(ssize_t r, ssize_t expected, const char *what)
+{
+	if (r < 0) {
+		err(1, "%s", what);
+	}
+	if (r != expected) {
+		errx(1, "%s: got %zd, expected %zd", what, r, expected);
+	}
+}
+
+/*
+ * Poll one fd for EVENTS with TIMEOUT and return its revents.
+ */
+static
+short
+poll1(int fd, short events, int timeout, int expectready)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	r = poll(&pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "poll");
+	}
+	if (r != expectready) {
+		errx(1, "poll: %d ready, expected %d", r, expectready);
+	}
+	return pfd.revents;
+}
+
+static
+void
+data(void)
+{
+	char buf[16];
+	int p[2];
+
+	printf("data through a pipe...\n");
+	mkpipe(p);
+
+	if (poll1(p[1], POLLOUT, 0, 1) != POLLOUT) {
+		errx(1, "empty pipe not writable");
+	}
+	checkret(write(p[1], "hello", 5), 5, "write");
+	if (poll1(p[0], POLLIN, 0, 1) != POLLIN) {
+		errx(1, "pipe with data not readable");
+	}
+	checkret(read(p[0], buf, sizeof(buf)), 5, "read");
+	if (memcmp(buf, "hello", 5) != 0) {
+		errx(1, "read: wrong data");
+	}
+
+	close(p[0]);
+	close(p[1]);
+}
+
+static
+void
+timeout(void)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned long ms;
+	int p[2];
+
+	printf("poll timeout...\n");
+	mkpipe(p);
+
+	__time(&s0, &ns0);
+	poll1(p[0], POLLIN, TIMEOUT_MS, 0);
+	__time(&s1, &ns1);
+
+	ms = (s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+	if (ms < TIMEOUT_MS / 2) {
+		errx(1, "poll timed out after only %lu ms (asked for %d)",
+		     ms, TIMEOUT_MS);
+	}
+
+	close(p[0]);
+	close(p[1]);
+}
+
+static
+void
+hangup(void)
+{
+	char buf[4];
+	short revents;
+	int p[2];
+
+	printf("EOF and POLLHUP...\n");
+	mkpipe(p);
+
+	checkret(write(p[1], "x", 1), 1, "write");
+	close(p[1]);
+
+	/* Data still there, and the writer's gone */
+	revents = poll1(p[0], POLLIN, 0, 1);
+	if ((revents & POLLHUP) == 0) {
+		errx(1, "no POLLHUP after writer closed");
+	}
+	checkret(read(p[0], buf, sizeof(buf)), 1, "read");
+	checkret(read(p[0], buf, sizeof(buf)), 0, "read at EOF");
+
+	close(p[0]);
+}
+
+static
+void
+brokenpipe(void)
+{
+	int p[2];
+
+	printf("EPIPE and POLLERR...\n");
+	mkpipe(p);
+
+	close(p[0]);
+	if (write(p[1], "x", 1) >= 0 || errno != EPIPE) {
+		errx(1, "write with no reader: expected EPIPE");
+	}
+	if ((poll1(p[1], POLLOUT, 0, 1) & POLLERR) == 0) {
+		errx(1, "no POLLERR with no reader");
+	}
+
+	close(p[1]);
+}
+
+static
+void
+splicefile(void)
+{
+	char buf[16];
+	int p[2], fd;
+
+	printf("splice...\n");
+	mkpipe(p);
+
+	fd = open(SPLICEFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", SPLICEFILE);
+	}
+
+	/* pipe to file */
+	checkret(write(p[1], "spliced", 7), 7, "write");
+	checkret(splice(p[0], fd, sizeof(buf)), 7, "splice to file");
+	checkret(pread(fd, buf, sizeof(buf), 0), 7, "pread");
+	if (memcmp(buf, "spliced", 7) != 0) {
+		errx(1, "splice to file: wrong data");
+	}
+
+	/* and back */
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		err(1, "lseek");
+	}
+	checkret(splice(fd, p[1], sizeof(buf)), 7, "splice from file");
+	checkret(read(p[0], buf, sizeof(buf)), 7, "read");
+	if (memcmp(buf, "spliced", 7) != 0) {
+		errx(1, "splice from file: wrong data");
+	}
+
+	close(fd);
+	close(p[0]);
+	close(p[1]);
+	(void)remove(SPLICEFILE);
+}
+
+int
+main(void)
+{
+	data();
+	timeout();
+	hangup();
+	brokenpipe();
+	splicefile();
+	printf("Passed.\n");
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * tmpfstest - round trip through a tmpfs: create and write a file,
+ * rename it (within a directory and into a subdirectory), read it
+ * back, then remove everything and check it's gone.
+ *
+ * Usage: tmpfstest [volume:]   (default tmp:, as in "mount tmpfs tmp")
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFVOLUME	"tmp:"
+#define NAMELEN		64
+
+static const char contents[] =
+	"Twas brillig, and the slithy toves did gyre and gimble.\n";
+#define CLEN (sizeof(contents) - 1)
+
+static char name1[NAMELEN], name2[NAMELEN], dirname[NAMELEN],
+	name3[NAMELEN];
+
+static
+void
+mkname(char *buf, const char *vol, const char *name)
+{
+	snprintf(buf, NAMELEN, "%s%s", vol, name);
+}
+
+static
+void
+checkgone(const char *path)
+{
+	if (open(path, O_RDONLY) >= 0 || errno != ENOENT) {
+		errx(1, "%s: still there, or wrong error", path);
+	}
+}
+
+static
+void
+checkfile(const char *path)
+{
+	char buf[CLEN + 16];
+	struct stat st;
+	ssize_t r;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", path);
+	}
+	if (fstat(fd, &st) < 0) {
+		err(1, "%s: fstat", path);
+	}
+	if (st.st_size != (off_t)CLEN) {
+		errx(1, "%s: size %lld, expected %zu", path,
+		     (long long)st.st_size, CLEN);
+	}
+	r = read(fd, buf, sizeof(buf));
+	if (r < 0) {
+		err(1, "%s: read", path);
+	}
+	if ((size_t)r != CLEN || memcmp(buf, contents, CLEN) != 0) {
+		errx(1, "%s: wrong contents", path);
+	}
+	close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *vol = DEFVOLUME;
+	ssize_t r;
+	int fd;
+
+	if (argc == 2) {
+		vol = argv[1];
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: tmpfstest [volume:]");
+	}
+	mkname(name1, vol, "tmpfstest.a");
+	mkname(name2, vol, "tmpfstest.b");
+	mkname(dirname, vol, "tmpfstest.d");
+	mkname(name3, vol, "tmpfstest.d/c");
+
+	printf("create %s...\n", name1);
+	fd = open(name1, O_WRONLY|O_CREAT|O_EXCL, 0664);
+	if (fd < 0) {
+		err(1, "%s", name1);
+	}
+	r = write(fd, contents, CLEN);
+	if (r < 0) {
+		err(1, "%s: write", name1);
+	}
+	if ((size_t)r != CLEN) {
+		errx(1, "%s: short write", name1);
+	}
+	close(fd);
+	checkfile(name1);
+
+	printf("rename to %s...\n", name2);
+	if (rename(name1, name2) < 0) {
+		err(1, "rename %s %s", name1, name2);
+	}
+	checkgone(name1);
+	checkfile(name2);
+
+	printf("rename into %s...\n", dirname);
+	if (mkdir(dirname, 0775) < 0) {
+		err(1, "%s: mkdir", dirname);
+	}
+	if (rename(name2, name3) < 0) {
+		err(1, "rename %s %s", name2, name3);
+	}
+	checkgone(name2);
+	checkfile(name3);
+	if (rmdir(dirname) >= 0 || errno != ENOTEMPTY) {
+		errx(1, "%s: rmdir of nonempty directory: expected "
+		     "ENOTEMPTY", dirname);
+	}
+
+	printf("remove...\n");
+	if (remove(name3) < 0) {
+		err(1, "%s: remove", name3);
+	}
+	checkgone(name3);
+	if (rmdir(dirname) < 0) {
+		err(1, "%s: rmdir", dirname);
+	}
+	checkgone(dirname);
+
+	printf("Passed.\n");
+	return 0;
+}